@@ -0,0 +1,14 @@
+/* This file is generated by util/getversion.sh */
+/* Version string for use by common/version.c */
+#ifdef SHIFT_CODE_FOR_TEST
+#define CROS_EC_VERSION "host_v0.0.57-9bafa3e_shift"
+#else
+#define CROS_EC_VERSION "host_v0.0.57-9bafa3e"
+#endif
+/* Version string, truncated to 31 chars (+ terminating null = 32) */
+#define CROS_EC_VERSION32 "host_v0.0.57-9bafa3e"
+/* Sub-fields for use in Makefile.rules and to form build info string
+ * in common/version.c. */
+#define VERSION "host_v0.0.57-9bafa3e"
+#define DATE "2026-10-17 06:15:30"
+#define BUILDER "@vm"
@@ -12,7 +12,8 @@
 #include "persistence.h"
 #include "util.h"
 
-char __host_flash[CONFIG_FLASH_PHYSICAL_SIZE];
+/* Page-aligned, so the flash storage file can be mapped over it */
+char __host_flash[CONFIG_FLASH_PHYSICAL_SIZE] __attribute__((aligned(4096)));
 uint8_t __host_flash_protect[PHYSICAL_BANKS];
 
 /* Override this function to make flash erase/write operation fail */
@@ -34,33 +35,24 @@ static int flash_check_protect(int offset, int size)
 	return 0;
 }
 
-static void flash_set_persistent(void)
-{
-	FILE *f = get_persistent_storage("flash", "wb");
-	int sz;
-
-	ASSERT(f != NULL);
-
-	sz = fwrite(__host_flash, sizeof(__host_flash), 1, f);
-	ASSERT(sz == 1);
-
-	release_persistent_storage(f);
-}
-
 static void flash_get_persistent(void)
 {
-	FILE *f = get_persistent_storage("flash", "rb");
-
-	if (f == NULL) {
+#ifdef CONFIG_FLASH_VOLATILE
+	int rv = 0;
+#else
+	int rv = map_persistent_storage("flash", __host_flash,
+					sizeof(__host_flash));
+
+	if (rv < 0)
+		fprintf(stderr, "Can't map flash storage. Keeping it in "
+			"memory.\n");
+	else if (rv == 0)
 		fprintf(stderr,
 			"No flash storage found. Initializing to 0xff.\n");
-		memset(__host_flash, 0xff, sizeof(__host_flash));
-		return;
-	}
+#endif
 
-	fread(__host_flash, sizeof(__host_flash), 1, f);
-
-	release_persistent_storage(f);
+	if (rv <= 0)
+		memset(__host_flash, 0xff, sizeof(__host_flash));
 }
 
 int flash_physical_write(int offset, int size, const char *data)
@@ -74,7 +66,6 @@ int flash_physical_write(int offset, int size, const char *data)
 		return EC_ERROR_ACCESS_DENIED;
 
 	memcpy(__host_flash + offset, data, size);
-	flash_set_persistent();
 
 	return EC_SUCCESS;
 }
@@ -90,7 +81,6 @@ int flash_physical_erase(int offset, int size)
 		return EC_ERROR_ACCESS_DENIED;
 
 	memset(__host_flash + offset, 0xff, size);
-	flash_set_persistent();
 
 	return EC_SUCCESS;
 }
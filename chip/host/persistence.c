@@ -5,9 +5,12 @@
 
 /* Persistence module for emulator */
 
+#include <fcntl.h>
 #include <unistd.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #define BUF_SIZE 1024
 
@@ -22,22 +25,57 @@ static void get_storage_path(char *out)
 		out[BUF_SIZE - 1] = '\0';
 }
 
-FILE *get_persistent_storage(const char *tag, const char *mode)
+static void get_tagged_storage_path(const char *tag, char *out)
 {
 	char buf[BUF_SIZE];
-	char path[BUF_SIZE];
 
 	/*
 	 * The persistent storage with tag 'foo' for test 'bar' would
 	 * be named 'bar_persist_foo'
 	 */
 	get_storage_path(buf);
-	if (snprintf(path, BUF_SIZE, "%s_%s", buf, tag) >= BUF_SIZE)
-		path[BUF_SIZE - 1] = '\0';
+	if (snprintf(out, BUF_SIZE, "%s_%s", buf, tag) >= BUF_SIZE)
+		out[BUF_SIZE - 1] = '\0';
+}
+
+FILE *get_persistent_storage(const char *tag, const char *mode)
+{
+	char path[BUF_SIZE];
+
+	get_tagged_storage_path(tag, path);
 
 	return fopen(path, mode);
 }
 
+int map_persistent_storage(const char *tag, void *buf, size_t size)
+{
+	char path[BUF_SIZE];
+	struct stat st;
+	void *p;
+	int fd;
+
+	get_tagged_storage_path(tag, path);
+
+	fd = open(path, O_RDWR | O_CREAT, 0644);
+	if (fd < 0)
+		return -1;
+
+	/* Storage of the wrong size is treated as new */
+	if (fstat(fd, &st) < 0 ||
+	    (st.st_size != size && ftruncate(fd, size) < 0)) {
+		close(fd);
+		return -1;
+	}
+
+	p = mmap(buf, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED,
+		 fd, 0);
+	close(fd);
+	if (p == MAP_FAILED)
+		return -1;
+
+	return st.st_size == size;
+}
+
 void release_persistent_storage(FILE *ps)
 {
 	fclose(ps);
@@ -45,12 +83,9 @@ void release_persistent_storage(FILE *ps)
 
 void remove_persistent_storage(const char *tag)
 {
-	char buf[BUF_SIZE];
 	char path[BUF_SIZE];
 
-	get_storage_path(buf);
-	if (snprintf(path, BUF_SIZE, "%s_%s", buf, tag) >= BUF_SIZE)
-		path[BUF_SIZE - 1] = '\0';
+	get_tagged_storage_path(tag, path);
 
 	unlink(path);
 }
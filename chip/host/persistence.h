@@ -14,6 +14,16 @@ FILE *get_persistent_storage(const char *tag, const char *mode);
 
 void release_persistent_storage(FILE *ps);
 
+/*
+ * Map persistent storage over a buffer, so writes to the buffer go straight
+ * to storage a page at a time.  The buffer must be page-aligned.  Storage is
+ * created if it doesn't exist yet, in which case it reads as zeros.
+ *
+ * Returns 1 if the storage already existed, 0 if it was just created, or -1
+ * if it couldn't be mapped.
+ */
+int map_persistent_storage(const char *tag, void *buf, size_t size);
+
 void remove_persistent_storage(const char *tag);
 
 #endif /* _PERSISTENCE_H */
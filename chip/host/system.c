@@ -16,11 +16,15 @@
 #include "timer.h"
 #include "util.h"
 
-#define SHARED_MEM_SIZE 512 /* bytes */
-char __shared_mem_buf[SHARED_MEM_SIZE];
-
+#define SHARED_MEM_SIZE 4096 /* bytes */
 #define RAM_DATA_SIZE (sizeof(struct panic_data) + 512) /* bytes */
-static char __ram_data[RAM_DATA_SIZE];
+
+/*
+ * As on real chips, the shared memory buffer runs right up to the jump data
+ * at the end of RAM, so system_usable_ram_end() bounds it.
+ */
+char __shared_mem_buf[SHARED_MEM_SIZE + RAM_DATA_SIZE] __aligned(8);
+#define __ram_data (__shared_mem_buf + SHARED_MEM_SIZE)
 
 static enum system_image_copy_t __running_copy;
 
@@ -31,7 +35,7 @@ static void ramdata_set_persistent(void)
 
 	ASSERT(f != NULL);
 
-	sz = fwrite(__ram_data, sizeof(__ram_data), 1, f);
+	sz = fwrite(__ram_data, RAM_DATA_SIZE, 1, f);
 	ASSERT(sz == 1);
 
 	release_persistent_storage(f);
@@ -44,11 +48,11 @@ static void ramdata_get_persistent(void)
 	if (f == NULL) {
 		fprintf(stderr,
 			"No RAM data found. Initializing to 0x00.\n");
-		memset(__ram_data, 0, sizeof(__ram_data));
+		memset(__ram_data, 0, RAM_DATA_SIZE);
 		return;
 	}
 
-	fread(__ram_data, sizeof(__ram_data), 1, f);
+	fread(__ram_data, RAM_DATA_SIZE, 1, f);
 
 	release_persistent_storage(f);
 
@@ -26,11 +26,7 @@ static pthread_t input_thread;
 #define INPUT_BUFFER_SIZE 16
 static int char_available;
 static char cached_char_buf[INPUT_BUFFER_SIZE];
-static struct queue cached_char = {
-	.buf_bytes  = INPUT_BUFFER_SIZE,
-	.unit_bytes = sizeof(char),
-	.buf        = cached_char_buf,
-};
+static struct queue cached_char = QUEUE(cached_char_buf);
 
 #define CONSOLE_CAPTURE_SIZE 2048
 static char capture_buf[CONSOLE_CAPTURE_SIZE];
@@ -73,7 +69,8 @@ static void trigger_interrupt(void)
 {
 	if (int_disabled)
 		return;
-	if (task_start_called())
+	/* Emulated interrupts don't nest, so run it directly from an ISR */
+	if (task_start_called() && !in_interrupt_context())
 		task_trigger_test_interrupt(uart_interrupt);
 	else
 		uart_interrupt();
@@ -173,6 +170,15 @@ void *uart_monitor_stdin(void *d)
 	while (1) {
 		tcsetattr(0, TCSANOW, &new_settings);
 		rv = read(0, buf, INPUT_BUFFER_SIZE);
+		if (rv <= 0) {
+			/*
+			 * End of input, e.g. stdin is /dev/null.  Stop here,
+			 * rather than spinning and clobbering char_available
+			 * under characters from uart_inject_char().
+			 */
+			tcsetattr(0, TCSANOW, &org_settings);
+			break;
+		}
 		if (queue_has_space(&cached_char, rv)) {
 			queue_add_units(&cached_char, buf, rv);
 			char_available = rv;
@@ -6,6 +6,7 @@
 /* Console module for Chrome EC */
 #include "clock.h"
 #include "console.h"
+#include "hooks.h"
 #include "link_defs.h"
 #include "system.h"
 #include "task.h"
@@ -103,12 +104,48 @@ static int split_words(char *input, int *argc, char **argv)
 	return EC_SUCCESS;
 }
 
+/*
+ * Set at init if the command table isn't in case-folded order, in which case
+ * find_command() falls back to a linear search.
+ */
+static int cmds_unsorted;
+
+/**
+ * Find the first command whose name sorts at or after a prefix.
+ *
+ * The linker sorts the command table by section name, which is the command
+ * name (see .rodata.cmds in ec.lds.S), and command names are lower case.  So
+ * the table is in case-folded order, and all the commands starting with a
+ * given prefix are adjacent, starting at the one this returns.
+ *
+ * @param prefix	Name or partial name to look for.
+ *
+ * @return A pointer into the command table; __cmds_end if the prefix sorts
+ *	after every command.
+ */
+static const struct console_command *find_first_command(const char *prefix)
+{
+	const struct console_command *lo = __cmds, *hi = __cmds_end;
+
+	while (lo < hi) {
+		const struct console_command *mid = lo + (hi - lo) / 2;
+
+		if (strcasecmp(mid->name, prefix) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
 /**
  * Find a command by name.
  *
  * Allows partial matches, as long as the partial match is unique to one
  * command.  So "foo" will match "foobar" as long as there isn't also a
- * command "food".
+ * command "food".  A full match always wins, so "foo" matches command "foo"
+ * even if there is also a command "foobar".
  *
  * @param name		Command name to find.
  *
@@ -119,23 +156,58 @@ static const struct console_command *find_command(char *name)
 	const struct console_command *cmd, *match = NULL;
 	int match_length = strlen(name);
 
-	for (cmd = __cmds; cmd < __cmds_end; cmd++) {
-		if (!strncasecmp(name, cmd->name, match_length)) {
-			if (match)
-				return NULL;
-			/*
-			 * Check if 'cmd->name' is of the same length as
-			 * 'name'. If yes, then we have a full match.
-			 */
+	if (cmds_unsorted) {
+		for (cmd = __cmds; cmd < __cmds_end; cmd++) {
+			if (strncasecmp(name, cmd->name, match_length))
+				continue;
 			if (cmd->name[match_length] == '\0')
 				return cmd;
-			match = cmd;
+			/* Partial match must be unique */
+			match = match ? __cmds_end : cmd;
 		}
+		return match == __cmds_end ? NULL : match;
 	}
 
-	return match;
+	cmd = find_first_command(name);
+	if (cmd == __cmds_end || strncasecmp(name, cmd->name, match_length))
+		return NULL;
+
+	/*
+	 * A full match sorts before any longer command it is a prefix of, so
+	 * it is always the first.
+	 */
+	if (cmd->name[match_length] == '\0')
+		return cmd;
+
+	/* Partial match must be unique */
+	if (cmd + 1 < __cmds_end &&
+	    !strncasecmp(name, cmd[1].name, match_length))
+		return NULL;
+
+	return cmd;
 }
 
+/**
+ * Check the linker really sorted the command table in case-folded order.
+ *
+ * It sorts by section name, which is only case-folded order if every command
+ * name is lower case; see DECLARE_CONSOLE_COMMAND().
+ */
+static void console_check_table(void)
+{
+	const struct console_command *cmd;
+
+	for (cmd = __cmds + 1; cmd < __cmds_end; cmd++) {
+		if (strcasecmp(cmd[-1].name, cmd->name) < 0)
+			continue;
+
+		ccprintf("Console command table unsorted at '%s'\n", cmd->name);
+		cmds_unsorted = 1;
+		ASSERT(0);
+		return;
+	}
+}
+DECLARE_HOOK(HOOK_INIT, console_check_table, HOOK_PRIO_FIRST);
 
 static const char const *errmsgs[] = {
 	"OK",
@@ -375,6 +447,79 @@ static int handle_esc(int c)
 	return -1;
 }
 
+#ifdef CONFIG_CONSOLE_TAB_COMPLETION
+
+/**
+ * Complete the command name on the input line.
+ *
+ * Extends the line by as much as all matching commands have in common, plus a
+ * space if only one matches.  If there is nothing to add and there are several
+ * matches, lists them and reprints the line.
+ */
+static void complete_command(void)
+{
+	const struct console_command *first, *cmd;
+	int common = 0;
+	int i;
+
+	/* Only the command name is completed, and only at the end of line */
+	if (input_pos != input_len)
+		return;
+	for (i = 0; i < input_len; i++) {
+		if (isspace(input_buf[i]))
+			return;
+	}
+
+	/* Matching commands are only adjacent if the table is sorted */
+	if (cmds_unsorted)
+		return;
+
+	/* Find the matching commands and the longest prefix they share */
+	first = find_first_command(input_buf);
+	for (cmd = first; cmd < __cmds_end &&
+		     !strncasecmp(input_buf, cmd->name, input_len); cmd++) {
+		if (cmd == first) {
+			common = strlen(cmd->name);
+			continue;
+		}
+		for (i = input_len; i < common &&
+			     tolower(cmd->name[i]) == tolower(first->name[i]);
+		     i++)
+			;
+		common = i;
+	}
+
+	if (cmd == first)
+		return;  /* No matches */
+
+	if (common > input_len || cmd == first + 1) {
+		for (i = input_len; i < common + (cmd == first + 1); i++) {
+			/* Leave room for terminating null */
+			if (input_len >= sizeof(input_buf) - 1)
+				break;
+
+			input_buf[input_len] = first->name[i] ? first->name[i]
+							      : ' ';
+			uart_putc(input_buf[input_len]);
+			input_buf[++input_len] = '\0';
+		}
+		input_pos = input_len;
+	} else if (cmd > first + 1) {
+		ccputs("\n");
+		for (i = 0; first + i < cmd; i++) {
+			ccprintf("%-15s", first[i].name);
+			if (i % 5 == 4 || first + i + 1 == cmd) {
+				ccputs("\n");
+				cflush();
+			}
+		}
+		ccputs(PROMPT);
+		ccputs(input_buf);
+	}
+}
+
+#endif /* CONFIG_CONSOLE_TAB_COMPLETION */
+
 static void console_handle_char(int c)
 {
 	/* Translate CR and CRLF to LF (newline) */
@@ -436,6 +581,12 @@ static void console_handle_char(int c)
 		ccputs(PROMPT);
 		break;
 
+#ifdef CONFIG_CONSOLE_TAB_COMPLETION
+	case '\t':
+		complete_command();
+		break;
+#endif
+
 	case CTRL('A'):
 	case KEY_HOME:
 		move_cursor_begin();
@@ -6,6 +6,10 @@
 /* Console output module for Chrome EC */
 
 #include "console.h"
+#include "hooks.h"
+#include "queue.h"
+#include "task.h"
+#include "timer.h"
 #include "uart.h"
 #include "util.h"
 
@@ -107,8 +111,106 @@ int cprints(enum console_channel channel, const char *format, ...)
 	return r ? r : rv;
 }
 
+#ifdef CONFIG_CONSOLE_DEFERRED
+
+/* Deferred output record */
+struct deferred_record {
+	timestamp_t time;
+	const char *format;
+	uint8_t channel;
+	uint8_t nargs;
+	int args[CONSOLE_DEFERRED_MAX_ARGS];
+};
+
+static struct deferred_record deferred_buf[CONFIG_CONSOLE_DEFERRED_RECORDS];
+static struct queue deferred_log = QUEUE(deferred_buf);
+
+/* Records dropped per channel since the last drain */
+static uint16_t deferred_dropped[CC_CHANNEL_COUNT];
+
+/**
+ * Format and print all queued deferred output.
+ *
+ * Records are removed with interrupts disabled, so cflush() can drain the
+ * queue from any context without racing the hook task.
+ */
+static void deferred_drain(void)
+{
+	struct deferred_record r;
+	int i, got, dropped, irq;
+
+	while (1) {
+		irq = interrupt_disable_save();
+		got = queue_remove_unit(&deferred_log, &r);
+		interrupt_restore(irq);
+		if (!got)
+			break;
+
+		/* Excess arguments are ignored by the format */
+		uart_printf("[%.6lu ", r.time.val);
+		uart_printf(r.format, r.args[0], r.args[1], r.args[2],
+			    r.args[3], r.args[4], r.args[5], r.args[6],
+			    r.args[7]);
+		uart_puts("]\n");
+	}
+
+	for (i = 0; i < CC_CHANNEL_COUNT; i++) {
+		if (!deferred_dropped[i])
+			continue;
+
+		irq = interrupt_disable_save();
+		dropped = deferred_dropped[i];
+		deferred_dropped[i] = 0;
+		interrupt_restore(irq);
+
+		uart_printf("[%T %s: %d deferred msgs dropped]\n",
+			    channel_names[i], dropped);
+	}
+}
+DECLARE_DEFERRED(deferred_drain);
+
+int cprints_deferred_args(enum console_channel channel, const char *format,
+			  int nargs, ...)
+{
+	struct deferred_record r;
+	va_list args;
+	int i, added, irq;
+
+	/* Filter out inactive channels */
+	if (!(CC_MASK(channel) & channel_mask))
+		return EC_SUCCESS;
+
+	r.time = get_time();
+	r.format = format;
+	r.channel = channel;
+	r.nargs = MIN(nargs, CONSOLE_DEFERRED_MAX_ARGS);
+
+	va_start(args, nargs);
+	for (i = 0; i < CONSOLE_DEFERRED_MAX_ARGS; i++)
+		r.args[i] = i < r.nargs ? va_arg(args, int) : 0;
+	va_end(args);
+
+	/* Producers may be tasks or interrupts, so serialize them */
+	irq = interrupt_disable_save();
+	added = queue_add_units(&deferred_log, &r, 1);
+	if (!added && deferred_dropped[channel] != 0xffff)
+		deferred_dropped[channel]++;
+	interrupt_restore(irq);
+
+	if (!added)
+		return EC_ERROR_OVERFLOW;
+
+	hook_call_deferred(deferred_drain, 0);
+	return EC_SUCCESS;
+}
+
+#endif /* CONFIG_CONSOLE_DEFERRED */
+
 void cflush(void)
 {
+#ifdef CONFIG_CONSOLE_DEFERRED
+	deferred_drain();
+#endif
 	uart_flush_output();
 }
 
@@ -9,9 +9,12 @@
 #include "console.h"
 #include "flash.h"
 #include "gpio.h"
+#include "hooks.h"
 #include "host_command.h"
+#include "sha256.h"
 #include "shared_mem.h"
 #include "system.h"
+#include "task.h"
 #include "util.h"
 #include "vboot_hash.h"
 
@@ -36,6 +39,45 @@ struct persist_state {
 /* Protect persist state and RO firmware at boot */
 #define PERSIST_FLAG_PROTECT_RO 0x02
 
+/*
+ * Cached vboot hash, stored in the pstate bank right after the persist state.
+ * It's kept out of struct persist_state so older images still find their
+ * flags where they expect them; when they rewrite pstate they only write
+ * persist_state, which drops the cached hash along the way.
+ */
+struct persist_hash {
+	uint32_t magic;             /* PERSIST_HASH_MAGIC */
+	uint32_t offset;            /* Hashed region of flash */
+	uint32_t size;              /* Size of hashed region; 0 if no hash */
+	uint32_t generation;        /* Write generation when hashed */
+	uint8_t digest[SHA256_DIGEST_SIZE];
+};
+
+#define PERSIST_HASH_MAGIC 0x48534856  /* "VHSH" */
+#define PERSIST_HASH_OFFSET (PSTATE_OFFSET + sizeof(struct persist_state))
+
+#ifdef CONFIG_VBOOT_HASH_CACHE
+/* The cached hash is written on its own, so must be whole flash words */
+BUILD_ASSERT(PERSIST_HASH_OFFSET % CONFIG_FLASH_WRITE_SIZE == 0);
+BUILD_ASSERT(sizeof(struct persist_hash) % CONFIG_FLASH_WRITE_SIZE == 0);
+BUILD_ASSERT(PERSIST_HASH_OFFSET + sizeof(struct persist_hash) <=
+	     PSTATE_OFFSET + PSTATE_SIZE);
+
+/*
+ * Lock for the cached hash.  Held while dropping the cached hash and then
+ * changing the flash it covers, and while caching a hash, so a hash can't
+ * be cached after a write to its region has started.
+ */
+static struct mutex hash_cache_lock;
+
+/*
+ * Bumped by every flash_write() and flash_erase().  Starts each boot from the
+ * generation of the cached hash, which is only trusted while nothing has been
+ * written since it was taken.
+ */
+static uint32_t write_generation;
+#endif
+
 /**
  * Get the physical memory address of a flash offset
  *
@@ -68,6 +110,68 @@ static void flash_read_pstate(struct persist_state *pstate)
 	}
 }
 
+#ifdef CONFIG_VBOOT_HASH_CACHE
+/**
+ * Read the cached hash into phash.
+ *
+ * @param phash		Destination for cached hash
+ */
+static void flash_read_phash(struct persist_hash *phash)
+{
+	memcpy(phash, flash_physical_dataptr(PERSIST_HASH_OFFSET),
+	       sizeof(*phash));
+
+	/* Start over if it was never written, or was erased */
+	if (phash->magic != PERSIST_HASH_MAGIC) {
+		memset(phash, 0, sizeof(*phash));
+		phash->magic = PERSIST_HASH_MAGIC;
+	}
+}
+
+/**
+ * Drop the hash in phash, so it doesn't match any region.
+ */
+static void flash_drop_phash(struct persist_hash *phash)
+{
+	phash->offset = 0;
+	phash->size = 0;
+	memset(phash->digest, 0, sizeof(phash->digest));
+}
+#endif
+
+/**
+ * Erase the pstate bank and write pstate, plus phash if not NULL.
+ *
+ * @param pstate	Source persistent state
+ * @param phash		Source cached hash, or NULL to leave it erased
+ * @return EC_SUCCESS, or nonzero if error.
+ */
+static int flash_rewrite_pstate(const struct persist_state *pstate,
+				const struct persist_hash *phash)
+{
+	int rv;
+
+	/* Erase pstate */
+	rv = flash_physical_erase(PSTATE_OFFSET, PSTATE_SIZE);
+	if (rv)
+		return rv;
+
+	/*
+	 * Note that if we lose power in here, we'll lose the pstate contents.
+	 * That's ok, because it's only possible to write the pstate before
+	 * it's protected.  Losing the cached hash just means recomputing it.
+	 */
+
+	/* Rewrite the data */
+	rv = flash_physical_write(PSTATE_OFFSET, sizeof(*pstate),
+				  (const char *)pstate);
+	if (rv || !phash)
+		return rv;
+
+	return flash_physical_write(PERSIST_HASH_OFFSET, sizeof(*phash),
+				    (const char *)phash);
+}
+
 /**
  * Write persistent state from pstate, erasing if necessary.
  *
@@ -77,28 +181,139 @@ static void flash_read_pstate(struct persist_state *pstate)
 static int flash_write_pstate(const struct persist_state *pstate)
 {
 	struct persist_state current_pstate;
+#ifdef CONFIG_VBOOT_HASH_CACHE
+	struct persist_hash phash;
 	int rv;
+#endif
 
 	/* Check if pstate has actually changed */
 	flash_read_pstate(&current_pstate);
 	if (!memcmp(&current_pstate, pstate, sizeof(*pstate)))
 		return EC_SUCCESS;
 
-	/* Erase pstate */
-	rv = flash_physical_erase(PSTATE_OFFSET, PSTATE_SIZE);
-	if (rv)
-		return rv;
+#ifdef CONFIG_VBOOT_HASH_CACHE
+	/*
+	 * Protection is changing, so drop the cached hash; see
+	 * flash_get_hash_cache() for why it's only used while unprotected.
+	 */
+	flash_lock_hash_cache(1);
+	flash_read_phash(&phash);
+	flash_drop_phash(&phash);
+	rv = flash_rewrite_pstate(pstate, &phash);
+	flash_lock_hash_cache(0);
+	return rv;
+#else
+	return flash_rewrite_pstate(pstate, NULL);
+#endif
+}
+
+#ifdef CONFIG_VBOOT_HASH_CACHE
+/**
+ * Drop the cached hash if it covers any of the specified region.
+ *
+ * @param offset	Region start offset in flash
+ * @param size		Size of region in bytes
+ * @return EC_SUCCESS, or nonzero if the cached hash couldn't be dropped.
+ */
+static int flash_invalidate_hash_cache(int offset, int size)
+{
+	struct persist_state pstate;
+	struct persist_hash phash;
+
+	flash_read_phash(&phash);
+	if (!phash.size || size <= 0 ||
+	    offset + size <= phash.offset ||
+	    offset >= phash.offset + phash.size)
+		return EC_SUCCESS;
+
+	flash_read_pstate(&pstate);
+	flash_drop_phash(&phash);
+	return flash_rewrite_pstate(&pstate, &phash);
+}
+
+void flash_lock_hash_cache(int lock)
+{
+	if (lock)
+		mutex_lock(&hash_cache_lock);
+	else
+		mutex_unlock(&hash_cache_lock);
+}
+
+int flash_get_hash_cache(uint32_t offset, uint32_t size, uint8_t *digest)
+{
+	struct persist_state pstate;
+	struct persist_hash phash;
 
 	/*
-	 * Note that if we lose power in here, we'll lose the pstate contents.
-	 * That's ok, because it's only possible to write the pstate before
-	 * it's protected.
+	 * Once RO is protected at boot, the pstate bank may be locked while
+	 * the rest of flash is still writable, and then a write couldn't drop
+	 * the cached hash.  So only trust it while pstate is unprotected;
+	 * turning protection on or off drops it anyway.
 	 */
+	flash_read_pstate(&pstate);
+	if ((pstate.flags & PERSIST_FLAG_PROTECT_RO) ||
+	    flash_physical_get_protect(PSTATE_BANK))
+		return EC_ERROR_ACCESS_DENIED;
 
-	/* Rewrite the data */
-	return flash_physical_write(PSTATE_OFFSET, sizeof(*pstate),
-				    (const char *)pstate);
+	flash_read_phash(&phash);
+	if (!size || phash.offset != offset || phash.size != size ||
+	    phash.generation != write_generation)
+		return EC_ERROR_UNKNOWN;
+
+	memcpy(digest, phash.digest, sizeof(phash.digest));
+	return EC_SUCCESS;
+}
+
+uint32_t flash_get_write_generation(void)
+{
+	return write_generation;
+}
+
+int flash_set_hash_cache(uint32_t offset, uint32_t size,
+			 const uint8_t *digest, uint32_t generation)
+{
+	struct persist_state pstate;
+	struct persist_hash phash;
+
+	flash_read_pstate(&pstate);
+	if ((pstate.flags & PERSIST_FLAG_PROTECT_RO) ||
+	    flash_physical_get_protect(PSTATE_BANK))
+		return EC_ERROR_ACCESS_DENIED;
+
+	/* Flash may have changed under the hash */
+	if (generation != write_generation)
+		return EC_ERROR_UNKNOWN;
+
+	/* Hash must be of something, and not of the cache itself */
+	if (!size || offset + size < offset ||
+	    (offset < PSTATE_OFFSET + PSTATE_SIZE &&
+	     offset + size > PSTATE_OFFSET))
+		return EC_ERROR_INVAL;
+
+	/* Don't wear out flash rewriting the same hash every boot */
+	flash_read_phash(&phash);
+	if (phash.offset == offset && phash.size == size &&
+	    phash.generation == generation &&
+	    !memcmp(phash.digest, digest, sizeof(phash.digest)))
+		return EC_SUCCESS;
+
+	phash.offset = offset;
+	phash.size = size;
+	phash.generation = generation;
+	memcpy(phash.digest, digest, sizeof(phash.digest));
+	return flash_rewrite_pstate(&pstate, &phash);
+}
+
+static void flash_hash_cache_init(void)
+{
+	struct persist_hash phash;
+
+	/* Carry on counting from when the cached hash was taken */
+	flash_read_phash(&phash);
+	write_generation = phash.generation;
 }
+DECLARE_HOOK(HOOK_INIT, flash_hash_cache_init, HOOK_PRIO_FIRST);
+#endif  /* CONFIG_VBOOT_HASH_CACHE */
 
 int flash_dataptr(int offset, int size_req, int align, const char **ptrp)
 {
@@ -129,26 +344,60 @@ int flash_is_erased(uint32_t offset, int size)
 
 int flash_write(int offset, int size, const char *data)
 {
+#ifdef CONFIG_VBOOT_HASH_CACHE
+	int rv;
+#endif
+
 	if (flash_dataptr(offset, size, CONFIG_FLASH_WRITE_SIZE, NULL) < 0)
 		return EC_ERROR_INVAL;  /* Invalid range */
 
+#ifdef CONFIG_VBOOT_HASH_CACHE
+	/* Don't touch the data unless the cached hash of it is gone */
+	flash_lock_hash_cache(1);
+	rv = flash_invalidate_hash_cache(offset, size);
+	if (!rv) {
+		write_generation++;
+		vboot_hash_invalidate(offset, size);
+		rv = flash_physical_write(offset, size, data);
+	}
+	flash_lock_hash_cache(0);
+	return rv;
+#else
 #ifdef CONFIG_VBOOT_HASH
 	vboot_hash_invalidate(offset, size);
 #endif
 
 	return flash_physical_write(offset, size, data);
+#endif
 }
 
 int flash_erase(int offset, int size)
 {
+#ifdef CONFIG_VBOOT_HASH_CACHE
+	int rv;
+#endif
+
 	if (flash_dataptr(offset, size, CONFIG_FLASH_ERASE_SIZE, NULL) < 0)
 		return EC_ERROR_INVAL;  /* Invalid range */
 
+#ifdef CONFIG_VBOOT_HASH_CACHE
+	/* Don't touch the data unless the cached hash of it is gone */
+	flash_lock_hash_cache(1);
+	rv = flash_invalidate_hash_cache(offset, size);
+	if (!rv) {
+		write_generation++;
+		vboot_hash_invalidate(offset, size);
+		rv = flash_physical_erase(offset, size);
+	}
+	flash_lock_hash_cache(0);
+	return rv;
+#else
 #ifdef CONFIG_VBOOT_HASH
 	vboot_hash_invalidate(offset, size);
 #endif
 
 	return flash_physical_erase(offset, size);
+#endif
 }
 
 int flash_protect_ro_at_boot(int enable)
@@ -417,8 +666,8 @@ static int command_flash_write(int argc, char **argv)
 	if (rv)
 		return rv;
 
-	if (size > shared_mem_size())
-		size = shared_mem_size();
+	if (size > shared_mem_available())
+		size = shared_mem_available();
 
 	/* Acquire the shared memory buffer */
 	rv = shared_mem_acquire(size, &data);
@@ -49,11 +49,29 @@ static const struct hook_ptrs hook_list[] = {
 	{__hooks_second, __hooks_second_end},
 };
 
-/* Times for deferrable functions */
+/* Marks the end of a hook list, in hook_first[] and hook_state.next */
+#define HOOK_LIST_END 0xff
+
+/* Index of the highest-priority hook of each type */
+static uint8_t hook_first[ARRAY_SIZE(hook_list)];
+static int hooks_sorted;
+
+/* Times for deferrable functions; 0 if not pending */
 static uint64_t defer_until[DEFERRABLE_MAX_COUNT];
 static int defer_new_call;
 static int hook_task_started;
 
+/*
+ * Min-heap of pending deferred functions, ordered by defer_until[], so the
+ * hook task can find the next one due without scanning them all.  Only
+ * touched with interrupts disabled, since deferred calls can be scheduled
+ * from interrupt context.
+ */
+static uint8_t defer_heap[DEFERRABLE_MAX_COUNT];
+static int defer_heap_count;
+/* Position of each pending deferred function in defer_heap[] */
+static uint8_t defer_heap_pos[DEFERRABLE_MAX_COUNT];
+
 #ifdef CONFIG_HOOK_DEBUG
 /* Stats for hooks */
 static uint64_t max_hook_tick_delay;
@@ -64,6 +82,9 @@ static uint64_t avg_hook_tick_delay;
 static uint64_t avg_hook_second_delay;
 static uint64_t avg_hook_run_time[ARRAY_SIZE(hook_list)];
 
+static uint64_t max_defer_delay[DEFERRABLE_MAX_COUNT];
+static uint64_t avg_defer_delay[DEFERRABLE_MAX_COUNT];
+
 static inline void update_hook_average(uint64_t *avg, uint64_t time)
 {
 	*avg = (*avg * 7 + time) >> 3;
@@ -88,38 +109,131 @@ static void record_hook_delay(uint64_t now, uint64_t last, uint64_t interval,
 }
 #endif
 
+static void defer_heap_swap(int a, int b)
+{
+	uint8_t ia = defer_heap[a];
+	uint8_t ib = defer_heap[b];
+
+	defer_heap[a] = ib;
+	defer_heap_pos[ib] = a;
+	defer_heap[b] = ia;
+	defer_heap_pos[ia] = b;
+}
+
+/**
+ * Move a heap entry up or down until it's in order.
+ *
+ * @param pos		Position in defer_heap[] of an entry whose time changed
+ */
+static void defer_heap_fix(int pos)
+{
+	int child;
+
+	while (pos > 0 && defer_until[defer_heap[pos]] <
+	       defer_until[defer_heap[(pos - 1) / 2]]) {
+		defer_heap_swap(pos, (pos - 1) / 2);
+		pos = (pos - 1) / 2;
+	}
+
+	while ((child = pos * 2 + 1) < defer_heap_count) {
+		/* Pick the earlier child */
+		if (child + 1 < defer_heap_count &&
+		    defer_until[defer_heap[child + 1]] <
+		    defer_until[defer_heap[child]])
+			child++;
+
+		if (defer_until[defer_heap[pos]] <=
+		    defer_until[defer_heap[child]])
+			break;
+
+		defer_heap_swap(pos, child);
+		pos = child;
+	}
+}
+
+/**
+ * Remove a pending deferred function from the heap.
+ *
+ * @param i		Index of the function in __deferred_funcs
+ */
+static void defer_heap_remove(int i)
+{
+	int pos = defer_heap_pos[i];
+
+	/* Move the last entry into the hole, then put it in order */
+	defer_heap_count--;
+	if (pos < defer_heap_count) {
+		defer_heap_swap(pos, defer_heap_count);
+		defer_heap_fix(pos);
+	}
+}
+
+/**
+ * Link each type's hooks into a list in priority order.
+ *
+ * Hooks with the same priority stay in link order.  The lists live in RAM
+ * because the hook data is const, so this has to run once per boot before
+ * any hooks are called.
+ */
+static void hook_sort(void)
+{
+	const struct hook_data *start;
+	uint8_t *link;
+	int type, count, i;
+
+	for (type = 0; type < ARRAY_SIZE(hook_list); type++) {
+		start = hook_list[type].start;
+		count = hook_list[type].end - start;
+		ASSERT(count < HOOK_LIST_END);
+
+		hook_first[type] = HOOK_LIST_END;
+		for (i = 0; i < count; i++) {
+			/* Insert after hooks of the same or higher priority */
+			link = hook_first + type;
+			while (*link != HOOK_LIST_END &&
+			       start[*link].priority <= start[i].priority)
+				link = &start[*link].state->next;
+
+			start[i].state->next = *link;
+			*link = i;
+		}
+	}
+
+	hooks_sorted = 1;
+}
+
 void hook_notify(enum hook_type type)
 {
-	const struct hook_data *start, *end, *p;
-	int count, called = 0;
-	int last_prio = HOOK_PRIO_FIRST - 1, prio;
+	const struct hook_data *start, *p;
+	int i;
 #ifdef CONFIG_HOOK_DEBUG
 	uint64_t start_time = get_time().val;
+	uint64_t hook_start_time;
 	uint64_t run_time;
 #endif
 
 	CPRINTS("hook notify %d", type);
 
+	/* Some chips notify frequency changes before hook_init() */
+	if (!hooks_sorted)
+		hook_sort();
+
 	start = hook_list[type].start;
-	end = hook_list[type].end;
-	count = end - start;
 
 	/* Call all the hooks in priority order */
-	while (called < count) {
-		/* Find the lowest remaining priority */
-		for (p = start, prio = HOOK_PRIO_LAST + 1; p < end; p++) {
-			if (p->priority < prio && p->priority > last_prio)
-				prio = p->priority;
-		}
-		last_prio = prio;
-
-		/* Call all the hooks with that priority */
-		for (p = start; p < end; p++) {
-			if (p->priority == prio) {
-				called++;
-				p->routine();
-			}
-		}
+	for (i = hook_first[type]; i != HOOK_LIST_END; i = p->state->next) {
+		p = start + i;
+#ifdef CONFIG_HOOK_DEBUG
+		hook_start_time = get_time().val;
+		p->routine();
+		run_time = get_time().val - hook_start_time;
+		if (run_time > p->state->max_run_time)
+			p->state->max_run_time = run_time;
+		p->state->avg_run_time =
+			(p->state->avg_run_time * 7 + run_time) >> 3;
+#else
+		p->routine();
+#endif
 	}
 
 #ifdef CONFIG_HOOK_DEBUG
@@ -132,13 +246,14 @@ void hook_notify(enum hook_type type)
 
 void hook_init(void)
 {
+	hook_sort();
 	hook_notify(HOOK_INIT);
 }
 
 int hook_call_deferred(void (*routine)(void), int us)
 {
 	const struct deferred_data *p;
-	int i;
+	int i, irq;
 
 	/* Find the index of the routine */
 	for (p = __deferred_funcs; p < __deferred_funcs_end; p++) {
@@ -150,24 +265,40 @@ int hook_call_deferred(void (*routine)(void), int us)
 
 	i = p - __deferred_funcs;
 
+	/* May be called from interrupt context; keep its interrupt state */
+	irq = interrupt_disable_save();
+
 	if (us == -1) {
 		/* Cancel */
-		defer_until[i] = 0;
+		if (defer_until[i]) {
+			defer_heap_remove(i);
+			defer_until[i] = 0;
+		}
 	} else {
+		/* Queue the routine if it isn't already pending */
+		if (!defer_until[i]) {
+			defer_heap_pos[i] = defer_heap_count;
+			defer_heap[defer_heap_count++] = i;
+		}
+
 		/* Set alarm */
 		defer_until[i] = get_time().val + us;
+		defer_heap_fix(defer_heap_pos[i]);
+
 		/*
 		 * Flag that hook_call_deferred() has been called.  If the hook
 		 * task is already active, this will allow it to go through the
 		 * loop one more time before sleeping.
 		 */
 		defer_new_call = 1;
-
-		/* Wake task so it can re-sleep for the proper time */
-		if (hook_task_started)
-			task_wake(TASK_ID_HOOKS);
 	}
 
+	interrupt_restore(irq);
+
+	/* Wake task so it can re-sleep for the proper time */
+	if (us != -1 && hook_task_started)
+		task_wake(TASK_ID_HOOKS);
+
 	return EC_SUCCESS;
 }
 
@@ -181,22 +312,36 @@ void hook_task(void)
 
 	while (1) {
 		uint64_t t = get_time().val;
+		uint64_t until;
 		int next = 0;
 		int i;
 
-		/* Handle deferred routines */
-		for (i = 0; i < DEFERRED_FUNCS_COUNT; i++) {
-			if (defer_until[i] && defer_until[i] < t) {
-				CPRINTS("hook call deferred 0x%p",
-					__deferred_funcs[i].routine);
-				/*
-				 * Call deferred function.  Clear timer first,
-				 * so it can request itself be called later.
-				 */
-				defer_until[i] = 0;
-				__deferred_funcs[i].routine();
-			}
+		/* Handle deferred routines, earliest first */
+		interrupt_disable();
+		while (defer_heap_count && defer_until[defer_heap[0]] < t) {
+			i = defer_heap[0];
+#ifdef CONFIG_HOOK_DEBUG
+			/* How late the routine is getting called */
+			until = t - defer_until[i];
+			if (until > max_defer_delay[i])
+				max_defer_delay[i] = until;
+			update_hook_average(avg_defer_delay + i, until);
+#endif
+			/*
+			 * Clear timer before calling the deferred function, so
+			 * it can request itself be called later.
+			 */
+			defer_heap_remove(i);
+			defer_until[i] = 0;
+			interrupt_enable();
+
+			CPRINTS("hook call deferred 0x%p",
+				__deferred_funcs[i].routine);
+			__deferred_funcs[i].routine();
+
+			interrupt_disable();
 		}
+		interrupt_enable();
 
 		if (t - last_tick >= HOOK_TICK_INTERVAL) {
 #ifdef CONFIG_HOOK_DEBUG
@@ -223,16 +368,16 @@ void hook_task(void)
 		if (last_tick + HOOK_TICK_INTERVAL > t)
 			next = last_tick + HOOK_TICK_INTERVAL - t;
 
-		/* Wake earlier if needed by a deferred routine */
+		/* Wake earlier if needed by the next deferred routine */
 		defer_new_call = 0;
-		for (i = 0; i < DEFERRED_FUNCS_COUNT && next > 0; i++) {
-			if (!defer_until[i])
-				continue;
-
-			if (defer_until[i] < t)
+		interrupt_disable();
+		until = defer_heap_count ? defer_until[defer_heap[0]] : 0;
+		interrupt_enable();
+		if (until && next > 0) {
+			if (until < t)
 				next = 0;
-			else if (defer_until[i] - t < next)
-				next = defer_until[i] - t;
+			else if (until - t < next)
+				next = until - t;
 		}
 
 		/*
@@ -261,7 +406,8 @@ static void print_hook_delay(uint32_t interval, uint32_t delay, uint32_t avg)
 
 static int command_stats(int argc, char **argv)
 {
-	int i;
+	const struct hook_data *p;
+	int i, j;
 
 	ccprintf("HOOK_TICK:\n");
 	print_hook_delay(HOOK_TICK_INTERVAL, max_hook_tick_delay,
@@ -270,12 +416,31 @@ static int command_stats(int argc, char **argv)
 	ccprintf("HOOK_SECOND:\n");
 	print_hook_delay(SECOND, max_hook_second_delay, avg_hook_second_delay);
 
+	ccprintf("Deferred call lateness:\n");
+	for (i = 0; i < DEFERRED_FUNCS_COUNT; i++)
+		ccprintf("  %p:%6d us (Avg: %5d us)\n",
+			 __deferred_funcs[i].routine,
+			 (uint32_t)max_defer_delay[i],
+			 (uint32_t)avg_defer_delay[i]);
+	ccprintf("\n");
+
 	ccprintf("Max run time for each hook:\n");
-	for (i = 0; i < ARRAY_SIZE(hook_list); ++i)
+	for (i = 0; i < ARRAY_SIZE(hook_list); ++i) {
 		ccprintf("%3d:%6d us (Avg: %5d us)\n", i,
 			 (uint32_t)max_hook_run_time[i],
 			 (uint32_t)avg_hook_run_time[i]);
 
+		/* Break it down by routine, in the order they're called */
+		for (j = hook_first[i]; j != HOOK_LIST_END;
+		     j = p->state->next) {
+			p = hook_list[i].start + j;
+			ccprintf("    %p:%6d us (Avg: %5d us)\n", p->routine,
+				 p->state->max_run_time,
+				 p->state->avg_run_time);
+		}
+		cflush();
+	}
+
 	return EC_SUCCESS;
 }
 DECLARE_CONSOLE_COMMAND(hookstats, command_stats,
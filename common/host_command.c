@@ -8,6 +8,7 @@
 #include "ap_hang_detect.h"
 #include "common.h"
 #include "console.h"
+#include "hooks.h"
 #include "host_command.h"
 #include "link_defs.h"
 #include "lpc.h"
@@ -26,6 +27,10 @@
 /* Maximum delay to skip printing repeated host command debug output */
 #define HCDEBUG_MAX_REPEAT_DELAY (50 * MSEC)
 
+/*
+ * Command handed to the host command task, or NULL if it's idle.  Cleared
+ * once the task is done with the command, not when it first responds.
+ */
 static struct host_cmd_handler_args *pending_args;
 
 #ifndef CONFIG_LPC
@@ -58,16 +63,167 @@ static uint8_t command_pending;
 
 /* The result of the last 'slow' operation */
 static uint8_t saved_result = EC_RES_UNAVAILABLE;
+
+/*
+ * Response data from the last 'slow' operation, stashed in shared memory
+ * until the host fetches it with EC_CMD_RESEND_RESPONSE or moves on to some
+ * other command.
+ */
+static char *saved_response;
+static uint16_t saved_response_size;
 #endif
 
 /*
- * Host command args passed to command handler.  Static to keep it off the
+ * Host command packet from host, for protocol version 3+, and the args passed
+ * to its command handler.
+ */
+struct host_packet_slot {
+	/* Must be first; host_packet_respond() gets the slot from the args */
+	struct host_cmd_handler_args args;
+	struct host_packet *pkt;
+};
+
+/*
+ * Slot for the command the host command task runs.  Static to keep it off the
  * stack.  Note this means we can handle only one host command at a time.
  */
-static struct host_cmd_handler_args args0;
+static struct host_packet_slot slot0;
+
+#ifdef CONFIG_HOST_COMMAND_STATS
+/*
+ * Timing statistics for each command, in the same order as the host command
+ * table.  Times are in microseconds.
+ */
+static struct host_command_stats {
+	uint32_t calls;
+	uint32_t errors;
+	uint32_t min_us;
+	uint32_t avg_us;
+	uint32_t max_us;
+	uint32_t max_latency_us;
+} hc_stats[CONFIG_HOST_COMMAND_STATS];
+
+#define HC_STATS_COUNT MIN(__hcmds_end - __hcmds, CONFIG_HOST_COMMAND_STATS)
+
+test_export_static const struct host_command *find_host_command(int command);
+
+/**
+ * Return the stats for a command.
+ *
+ * @param cmd		Command, or NULL
+ * @return The stats for the command, or NULL if it isn't tracked.
+ */
+static struct host_command_stats *get_stats(const struct host_command *cmd)
+{
+	if (!cmd || cmd - __hcmds >= HC_STATS_COUNT)
+		return NULL;
+
+	return hc_stats + (cmd - __hcmds);
+}
+
+static void stats_record_run(const struct host_command *cmd, int rv,
+			     uint32_t run_time)
+{
+	struct host_command_stats *st = get_stats(cmd);
+
+	if (!st)
+		return;
+
+	if (!st->calls || run_time < st->min_us)
+		st->min_us = run_time;
+	if (run_time > st->max_us)
+		st->max_us = run_time;
+	if (st->calls)
+		st->avg_us = (st->avg_us * 7 + run_time) >> 3;
+	else
+		st->avg_us = run_time;
+
+	st->calls++;
+	if (rv != EC_RES_SUCCESS)
+		st->errors++;
+}
+
+static void stats_record_latency(struct host_cmd_handler_args *args)
+{
+	struct host_command_stats *st;
+	uint32_t latency;
+
+	if (!args->received_time)
+		return;
+
+	latency = get_time().le.lo - args->received_time;
+	args->received_time = 0;
+
+	st = get_stats(find_host_command(args->command));
+	if (st && latency > st->max_latency_us)
+		st->max_latency_us = latency;
+}
+#endif
+
+#ifdef CONFIG_HOST_COMMAND_STATUS
+/**
+ * Discard stashed response data, freeing its shared memory.
+ */
+static void saved_response_drop(void)
+{
+	if (!saved_response)
+		return;
+
+	shared_mem_release(saved_response);
+	saved_response = NULL;
+	saved_response_size = 0;
+	saved_result = EC_RES_UNAVAILABLE;
+}
+
+/**
+ * Move a 'slow' command's response into a private buffer.
+ *
+ * Once the early EC_RES_IN_PROGRESS response has gone out, the interface
+ * owns its buffer again and may reuse it for the next command, so the rest
+ * of the response is written to shared memory instead.
+ *
+ * @param args		Command which has just sent EC_RES_IN_PROGRESS
+ */
+static void saved_response_redirect(struct host_cmd_handler_args *args)
+{
+	if (args->response_max &&
+	    !shared_mem_acquire(args->response_max, &saved_response)) {
+		args->response = saved_response;
+		return;
+	}
+
+	/* Nowhere to put the data, so the handler mustn't write any */
+	saved_response = NULL;
+	args->response_max = 0;
+}
+
+/**
+ * Stash the result and response data of a completed 'slow' command.
+ *
+ * @param args		Command which has completed
+ */
+static void saved_response_stash(struct host_cmd_handler_args *args)
+{
+	if (args->result == EC_RES_SUCCESS && args->response_size) {
+		if (!saved_response) {
+			/* Nowhere to put the data, so the response is lost */
+			saved_result = EC_RES_UNAVAILABLE;
+		} else if (args->response_size > args->response_max) {
+			saved_response_drop();
+			saved_result = EC_RES_RESPONSE_TOO_BIG;
+		} else {
+			/* The handler wrote it to the private buffer */
+			saved_response_size = args->response_size;
+			saved_result = EC_RES_SUCCESS;
+		}
+		return;
+	}
 
-/* Current host command packet from host, for protocol version 3+ */
-static struct host_packet *pkt0;
+	/* Error results don't have data */
+	saved_response_drop();
+	saved_result = args->result;
+}
+#endif
 
 uint8_t *host_get_memmap(int offset)
 {
@@ -78,8 +234,22 @@ uint8_t *host_get_memmap(int offset)
 #endif
 }
 
+static void batch_sub_respond(struct host_cmd_handler_args *args);
+
 test_mockable void host_send_response(struct host_cmd_handler_args *args)
 {
+	/*
+	 * Commands run from a batch answer as part of the batch response, so
+	 * an early response from one of them (e.g. EC_RES_IN_PROGRESS) goes
+	 * nowhere, and doesn't make the batch itself look pending.
+	 */
+	if (args->send_response == batch_sub_respond)
+		return;
+
+#ifdef CONFIG_HOST_COMMAND_STATS
+	stats_record_latency(args);
+#endif
+
 #ifdef CONFIG_HOST_COMMAND_STATUS
 	/*
 	 *
@@ -102,14 +272,8 @@ test_mockable void host_send_response(struct host_cmd_handler_args *args)
 			CPRINTS("HC pending done, size=%d, result=%d",
 				args->response_size, args->result);
 
-			/*
-			 * We don't support stashing response data, so mark the
-			 * response as unavailable in that case.
-			 */
-			if (args->response_size != 0)
-				saved_result = EC_RES_UNAVAILABLE;
-			else
-				saved_result = args->result;
+			/* Keep the result and data until the host asks */
+			saved_response_stash(args);
 
 			/*
 			 * We can't send the response back to the host now
@@ -122,18 +286,44 @@ test_mockable void host_send_response(struct host_cmd_handler_args *args)
 		} else if (args->result == EC_RES_IN_PROGRESS) {
 			command_pending = 1;
 			CPRINTS("HC pending");
+			args->send_response(args);
+
+			/* Finish the command into a private buffer */
+			saved_response_redirect(args);
+			return;
 		}
 	}
 #endif
 	args->send_response(args);
 }
 
+/**
+ * Hand a command to the host command task.
+ *
+ * @param args		Command to run
+ * @return non-zero if handed over, 0 if the task already has a command.
+ */
+static int pending_args_set(struct host_cmd_handler_args *args)
+{
+	int ok = 0;
+	int irq;
+
+	/* Called from interface interrupt handlers as well as tasks */
+	irq = interrupt_disable_save();
+	if (!pending_args) {
+		pending_args = args;
+		ok = 1;
+	}
+	interrupt_restore(irq);
+
+	return ok;
+}
+
 void host_command_received(struct host_cmd_handler_args *args)
 {
-	/*
-	 * TODO(crosbug.com/p/23806): should warn if we already think we're in
-	 * a command.
-	 */
+#ifdef CONFIG_HOST_COMMAND_STATS
+	args->received_time = get_time().le.lo;
+#endif
 
 	/*
 	 * If this is the reboot command, reboot immediately.  This gives the
@@ -157,13 +347,20 @@ void host_command_received(struct host_cmd_handler_args *args)
 	} else if (args->command == EC_CMD_GET_COMMS_STATUS) {
 		args->result = host_command_process(args);
 #endif
-	} else {
-		/* Save the command */
-		pending_args = args;
-
+	} else if (pending_args_set(args)) {
 		/* Wake up the task to handle the command */
 		task_set_event(TASK_ID_HOSTCMD, TASK_EVENT_CMD_PENDING, 0);
 		return;
+	} else {
+		/*
+		 * Don't overwrite the command which is still running.  Answer
+		 * directly; host_send_response() would take this for that
+		 * command's final response.
+		 */
+		CPRINTS("HC busy");
+		args->result = EC_RES_UNAVAILABLE;
+		args->send_response(args);
+		return;
 	}
 
 	/* Send the response now */
@@ -172,16 +369,16 @@ void host_command_received(struct host_cmd_handler_args *args)
 
 void host_packet_respond(struct host_cmd_handler_args *args)
 {
-	struct ec_host_response *r = (struct ec_host_response *)pkt0->response;
-	uint8_t *out = (uint8_t *)pkt0->response;
-	int csum = 0;
-	int i;
+	struct host_packet_slot *slot = (struct host_packet_slot *)args;
+	struct host_packet *pkt = slot->pkt;
+	struct ec_host_response *r = (struct ec_host_response *)pkt->response;
+	int csum;
 
 	/* Clip result size to what we can accept */
 	if (args->result) {
 		/* Error results don't have data */
 		args->response_size = 0;
-	} else if (args->response_size > pkt0->response_max - sizeof(*r)) {
+	} else if (args->response_size > pkt->response_max - sizeof(*r)) {
 		/* Too much data */
 		args->result = EC_RES_RESPONSE_TOO_BIG;
 		args->response_size = 0;
@@ -194,20 +391,15 @@ void host_packet_respond(struct host_cmd_handler_args *args)
 	r->data_len = args->response_size;
 	r->reserved = 0;
 
-	/* Start checksum; this also advances *out to end of response */
-	for (i = sizeof(*r); i > 0; i--)
-		csum += *out++;
-
-	/* Checksum response data, if any */
-	for (i = args->response_size; i > 0; i--)
-		csum += *out++;
+	/* Checksum response header and data, if any */
+	csum = memcpy_sum(NULL, r, sizeof(*r) + args->response_size);
 
 	/* Write checksum field so the entire packet sums to 0 */
 	r->checksum = (uint8_t)(-csum);
 
-	pkt0->response_size = sizeof(*r) + r->data_len;
-	pkt0->driver_result = args->result;
-	pkt0->send_response(pkt0);
+	pkt->response_size = sizeof(*r) + r->data_len;
+	pkt->driver_result = args->result;
+	pkt->send_response(pkt);
 }
 
 int host_request_expected_size(const struct ec_host_request *r)
@@ -229,27 +421,38 @@ void host_packet_receive(struct host_packet *pkt)
 		(const struct ec_host_request *)pkt->request;
 	const uint8_t *in = (const uint8_t *)pkt->request;
 	uint8_t *itmp = (uint8_t *)pkt->request_temp;
-	int csum = 0;
-	int i;
+	struct host_packet_slot tmp, *slot = &slot0;
+	struct host_cmd_handler_args *args;
+	int csum;
+
+	/*
+	 * If the task is still running a command (e.g. one which has already
+	 * answered EC_RES_IN_PROGRESS), leave its args alone.  Anything that
+	 * arrives meanwhile is answered before we return, so a slot on the
+	 * stack is enough.
+	 */
+	if (pending_args)
+		slot = &tmp;
 
 	/* Track the packet we're handling */
-	pkt0 = pkt;
+	slot->pkt = pkt;
+	args = &slot->args;
 
 	/* If driver indicates error, don't even look at the data */
 	if (pkt->driver_result) {
-		args0.result = pkt->driver_result;
+		args->result = pkt->driver_result;
 		goto host_packet_bad;
 	}
 
 	if (pkt->request_size < sizeof(*r)) {
 		/* Packet too small for even a header */
-		args0.result = EC_RES_REQUEST_TRUNCATED;
+		args->result = EC_RES_REQUEST_TRUNCATED;
 		goto host_packet_bad;
 	}
 
 	if (pkt->request_size > pkt->request_max) {
 		/* Got a bigger request than the interface can handle */
-		args0.result = EC_RES_REQUEST_TRUNCATED;
+		args->result = EC_RES_REQUEST_TRUNCATED;
 		goto host_packet_bad;
 	}
 
@@ -259,23 +462,20 @@ void host_packet_receive(struct host_packet *pkt)
 	 */
 	ASSERT(pkt->response_max >= sizeof(struct ec_host_response));
 
-	/* Start checksum and copy request header if necessary */
+	/*
+	 * Start checksum and copy request header if necessary.  With no temp
+	 * buffer memcpy_sum() just checksums.
+	 */
+	csum = memcpy_sum(itmp, in, sizeof(*r));
+	in += sizeof(*r);
 	if (pkt->request_temp) {
-		/* Copy to temp buffer and checksum */
-		for (i = sizeof(*r); i > 0; i--) {
-			*itmp = *in++;
-			csum += *itmp++;
-		}
+		itmp += sizeof(*r);
 		r = (const struct ec_host_request *)pkt->request_temp;
-	} else {
-		/* Just checksum */
-		for (i = sizeof(*r); i > 0; i--)
-			csum += *in++;
 	}
 
 	if (r->struct_version != EC_HOST_REQUEST_VERSION) {
 		/* Request header we don't know how to handle */
-		args0.result = EC_RES_INVALID_HEADER;
+		args->result = EC_RES_INVALID_HEADER;
 		goto host_packet_bad;
 	}
 
@@ -286,73 +486,106 @@ void host_packet_receive(struct host_packet *pkt)
 		 * the data at the end (SPI) or may not know how big the
 		 * received data is (LPC).
 		 */
-		args0.result = EC_RES_REQUEST_TRUNCATED;
+		args->result = EC_RES_REQUEST_TRUNCATED;
 		goto host_packet_bad;
 	}
 
-	/* Copy request data and validate checksum */
-	if (pkt->request_temp) {
-		/* Params go in temporary buffer */
-		args0.params = itmp;
-
-		/* Copy request data and checksum */
-		for (i = r->data_len; i > 0; i--) {
-			*itmp = *in++;
-			csum += *itmp++;
-		}
-	} else {
-		/* Params read directly from request */
-		args0.params = in;
-
-		/* Just checksum */
-		for (i = r->data_len; i > 0; i--)
-			csum += *in++;
-	}
+	/*
+	 * Copy request data and checksum.  Params go in the temporary buffer
+	 * if there is one, else they're read directly from the request.
+	 */
+	args->params = itmp ? itmp : in;
+	csum += memcpy_sum(itmp, in, r->data_len);
 
 	/* Validate checksum */
 	if ((uint8_t)csum) {
-		args0.result = EC_RES_INVALID_CHECKSUM;
+		args->result = EC_RES_INVALID_CHECKSUM;
 		goto host_packet_bad;
 	}
 
 	/* Set up host command handler args */
-	args0.send_response = host_packet_respond;
-	args0.command = r->command;
-	args0.version = r->command_version;
-	args0.params_size = r->data_len;
-	args0.response = (struct ec_host_response *)(pkt->response) + 1;
-	args0.response_max = pkt->response_max -
+	args->send_response = host_packet_respond;
+	args->command = r->command;
+	args->version = r->command_version;
+	args->params_size = r->data_len;
+	args->response = (struct ec_host_response *)(pkt->response) + 1;
+	args->response_max = pkt->response_max -
 		sizeof(struct ec_host_response);
-	args0.response_size = 0;
-	args0.result = EC_RES_SUCCESS;
+	args->response_size = 0;
+	args->result = EC_RES_SUCCESS;
 
 	/* Chain to host command received */
-	host_command_received(&args0);
+	host_command_received(args);
 	return;
 
 host_packet_bad:
 	/* Improperly formed packet from host, so send an error response */
-	host_packet_respond(&args0);
+	host_packet_respond(args);
 }
 
+/*
+ * Set at init if the host command table isn't in command order, in which case
+ * find_host_command() falls back to a linear search.
+ */
+static int hcmds_unsorted;
+
 /**
  * Find a command by command number.
  *
+ * The linker sorts the host command table by command number (see
+ * DECLARE_HOST_COMMAND()), so this is a binary search.
+ *
  * @param command	Command number to find
  * @return The command structure, or NULL if no match found.
  */
-static const struct host_command *find_host_command(int command)
+test_export_static const struct host_command *find_host_command(int command)
 {
-	const struct host_command *cmd;
+	const struct host_command *lo = __hcmds;
+	const struct host_command *hi = __hcmds_end;
+
+	if (hcmds_unsorted) {
+		for (; lo < hi; lo++)
+			if (lo->command == command)
+				return lo;
+		return NULL;
+	}
+
+	while (lo < hi) {
+		const struct host_command *cmd = lo + (hi - lo) / 2;
 
-	for (cmd = __hcmds; cmd < __hcmds_end; cmd++) {
-		if (command == cmd->command)
+		if (cmd->command == command)
 			return cmd;
+		else if (cmd->command < command)
+			lo = cmd + 1;
+		else
+			hi = cmd;
 	}
 
 	return NULL;
 }
 
+/**
+ * Check the linker really sorted the host command table by command number.
+ *
+ * It sorts by section name, which only matches numeric order if every command
+ * number is spelled the same way; see DECLARE_HOST_COMMAND().
+ */
+static void host_command_check_table(void)
+{
+	const struct host_command *cmd;
+
+	for (cmd = __hcmds + 1; cmd < __hcmds_end; cmd++) {
+		if (cmd[-1].command < cmd->command)
+			continue;
+
+		CPRINTS("HC table unsorted at 0x%02x", cmd->command);
+		hcmds_unsorted = 1;
+		ASSERT(0);
+		return;
+	}
+}
+DECLARE_HOOK(HOOK_INIT, host_command_check_table, HOOK_PRIO_FIRST);
+
 static void host_command_init(void)
 {
 	/* Initialize memory map ID area */
@@ -373,12 +606,25 @@ void host_command_task(void)
 		/* Wait for the next command event */
 		int evt = task_wait_event(-1);
 
+		struct host_cmd_handler_args *args = pending_args;
+
 		/* Process it */
-		if ((evt & TASK_EVENT_CMD_PENDING) && pending_args) {
-			pending_args->result =
-					host_command_process(pending_args);
-			host_send_response(pending_args);
-		}
+		if (!(evt & TASK_EVENT_CMD_PENDING) || !args)
+			continue;
+
+#ifdef CONFIG_HOST_COMMAND_STATUS
+		/*
+		 * Stashed response data only lasts until the host moves on to
+		 * another command.
+		 */
+		if (args->command != EC_CMD_RESEND_RESPONSE)
+			saved_response_drop();
+#endif
+		args->result = host_command_process(args);
+		host_send_response(args);
+
+		/* Now we can take another command */
+		pending_args = NULL;
 	}
 }
 
@@ -526,12 +772,20 @@ enum ec_status host_command_process(struct host_cmd_handler_args *args)
 	if (hcdebug)
 		host_command_debug_request(args);
 
-	if (!cmd)
+	if (!cmd) {
 		rv = EC_RES_INVALID_COMMAND;
-	else if (!(EC_VER_MASK(args->version) & cmd->version_mask))
+	} else if (!(EC_VER_MASK(args->version) & cmd->version_mask)) {
 		rv = EC_RES_INVALID_VERSION;
-	else
+	} else {
+#ifdef CONFIG_HOST_COMMAND_STATS
+		uint32_t start_time = get_time().le.lo;
+
 		rv = cmd->handler(args);
+		stats_record_run(cmd, rv, get_time().le.lo - start_time);
+#else
+		rv = cmd->handler(args);
+#endif
+	}
 
 	if (rv != EC_RES_SUCCESS)
 		CPRINTS("HC err %d", rv);
@@ -562,13 +816,23 @@ DECLARE_HOST_COMMAND(EC_CMD_GET_COMMS_STATUS,
 /* Resend the last saved response */
 static int host_command_resend_response(struct host_cmd_handler_args *args)
 {
-	/* Handle resending response */
-	args->result = saved_result;
-	args->response_size = 0;
+	int result = saved_result;
+
+	if (saved_response) {
+		if (saved_response_size > args->response_max) {
+			result = EC_RES_RESPONSE_TOO_BIG;
+		} else {
+			memcpy(args->response, saved_response,
+			       saved_response_size);
+			args->response_size = saved_response_size;
+		}
+	}
 
+	/* A response can only be resent once */
+	saved_response_drop();
 	saved_result = EC_RES_UNAVAILABLE;
 
-	return EC_SUCCESS;
+	return result;
 }
 
 DECLARE_HOST_COMMAND(EC_CMD_RESEND_RESPONSE,
@@ -593,6 +857,183 @@ DECLARE_HOST_COMMAND(EC_CMD_TEST_PROTOCOL,
 		     host_command_test_protocol,
 		     EC_VER_MASK(0));
 
+/**
+ * Check that a batch request is well-formed before running any of it.
+ *
+ * @param args		Batch command args
+ * @return EC_RES_SUCCESS if ok, or the error to return to the host.
+ */
+static int batch_validate(const struct host_cmd_handler_args *args)
+{
+	const struct ec_params_batch *p = args->params;
+	const uint8_t *in = (const uint8_t *)(p + 1);
+	const uint8_t *in_end = (const uint8_t *)args->params +
+		args->params_size;
+	int i;
+
+	for (i = 0; i < p->count; i++) {
+		const struct ec_batch_request *req =
+			(const struct ec_batch_request *)in;
+
+		if (in + sizeof(*req) > in_end ||
+		    in + sizeof(*req) + req->data_len > in_end)
+			return EC_RES_REQUEST_TRUNCATED;
+
+		/* Batches don't nest */
+		if (req->command == EC_CMD_BATCH)
+			return EC_RES_INVALID_PARAM;
+
+		in += sizeof(*req) + EC_BATCH_ALIGN(req->data_len);
+	}
+
+	return EC_RES_SUCCESS;
+}
+
+/* See host_send_response() */
+static void batch_sub_respond(struct host_cmd_handler_args *args)
+{
+}
+
+/* Run a list of commands and pack their responses together */
+static int host_command_batch(struct host_cmd_handler_args *args)
+{
+	const struct ec_params_batch *p = args->params;
+	struct ec_response_batch *r = args->response;
+	const uint8_t *in = (const uint8_t *)(p + 1);
+	uint8_t *out = (uint8_t *)(r + 1);
+	uint8_t *out_end = (uint8_t *)args->response + args->response_max;
+	struct host_cmd_handler_args sub;
+	char *bounce;
+	int count;
+	int rv;
+
+	if (args->params_size < sizeof(*p) || args->response_max < sizeof(*r))
+		return EC_RES_INVALID_PARAM;
+
+	/*
+	 * Responses are written while later params are still being read, so
+	 * they can't share a buffer as they do with protocol version 2.
+	 */
+	if ((const uint8_t *)args->params < out_end &&
+	    (uint8_t *)args->response <
+	    (const uint8_t *)args->params + args->params_size)
+		return EC_RES_INVALID_COMMAND;
+
+	rv = batch_validate(args);
+	if (rv != EC_RES_SUCCESS)
+		return rv;
+
+	/*
+	 * Many handlers write their whole response without checking
+	 * response_max, so each command runs into a buffer as big as the
+	 * interface's, and only what fits is copied into the batch response.
+	 */
+	if (shared_mem_acquire(args->response_max, &bounce))
+		return EC_RES_ERROR;
+
+	for (count = 0; count < p->count; count++) {
+		const struct ec_batch_request *req =
+			(const struct ec_batch_request *)in;
+		struct ec_batch_response *rsp = (struct ec_batch_response *)out;
+		int len;
+
+		/* Stop if there's no room left for even an empty response */
+		if (out + sizeof(*rsp) > out_end)
+			break;
+
+		sub.send_response = batch_sub_respond;
+		sub.command = req->command;
+		sub.version = req->command_version;
+		sub.params = req + 1;
+		sub.params_size = req->data_len;
+		sub.response = bounce;
+		sub.response_max = MIN(req->response_max, args->response_max);
+		sub.response_size = 0;
+#ifdef CONFIG_HOST_COMMAND_STATS
+		sub.received_time = 0;
+#endif
+
+		rv = host_command_process(&sub);
+		if (rv != EC_RES_SUCCESS) {
+			/* Error results don't have data */
+			sub.response_size = 0;
+		} else if (sub.response_size > sub.response_max ||
+			   EC_BATCH_ALIGN(sub.response_size) >
+			   out_end - out - sizeof(*rsp)) {
+			rv = EC_RES_RESPONSE_TOO_BIG;
+			sub.response_size = 0;
+		}
+
+		rsp->result = rv;
+		rsp->data_len = sub.response_size;
+		len = EC_BATCH_ALIGN(sub.response_size);
+		memcpy(rsp + 1, bounce, sub.response_size);
+		memset((uint8_t *)(rsp + 1) + sub.response_size, 0,
+		       len - sub.response_size);
+
+		in += sizeof(*req) + EC_BATCH_ALIGN(req->data_len);
+		out += sizeof(*rsp) + len;
+	}
+
+	shared_mem_release(bounce);
+
+	r->count = count;
+	memset(r->reserved, 0, sizeof(r->reserved));
+	args->response_size = out - (uint8_t *)args->response;
+
+	return EC_RES_SUCCESS;
+}
+DECLARE_HOST_COMMAND(EC_CMD_BATCH,
+		     host_command_batch,
+		     EC_VER_MASK(0));
+
+#ifdef CONFIG_HOST_COMMAND_STATS
+static void stats_reset(void)
+{
+	memset(hc_stats, 0, sizeof(hc_stats));
+}
+
+static int host_command_get_cmd_stats(struct host_cmd_handler_args *args)
+{
+	const struct ec_params_get_cmd_stats *p = args->params;
+	struct ec_response_get_cmd_stats *r = args->response;
+	int index = p->index;
+	int i;
+
+	if (p->flags & EC_CMD_STATS_FLAG_RESET) {
+		stats_reset();
+		index = HC_STATS_COUNT;
+	}
+
+	r->total = HC_STATS_COUNT;
+	r->reserved[0] = r->reserved[1] = 0;
+
+	for (i = 0; index + i < HC_STATS_COUNT &&
+		     sizeof(*r) + (i + 1) * sizeof(r->stats[0]) <=
+		     args->response_max; i++) {
+		const struct host_command_stats *st = hc_stats + index + i;
+		struct ec_cmd_stats *out = r->stats + i;
+
+		out->command = __hcmds[index + i].command;
+		out->reserved = 0;
+		out->calls = st->calls;
+		out->errors = st->errors;
+		out->min_us = st->min_us;
+		out->avg_us = st->avg_us;
+		out->max_us = st->max_us;
+		out->max_latency_us = st->max_latency_us;
+	}
+
+	r->count = i;
+	args->response_size = sizeof(*r) + i * sizeof(r->stats[0]);
+
+	return EC_RES_SUCCESS;
+}
+DECLARE_HOST_COMMAND(EC_CMD_GET_CMD_STATS,
+		     host_command_get_cmd_stats,
+		     EC_VER_MASK(0));
+#endif /* CONFIG_HOST_COMMAND_STATS */
+
 /*****************************************************************************/
 /* Console commands */
 
@@ -721,3 +1162,36 @@ DECLARE_CONSOLE_COMMAND(hcdebug, command_hcdebug,
 			"hcdebug [off | normal | every | params]",
 			"Set host command debug output mode",
 			NULL);
+
+#ifdef CONFIG_HOST_COMMAND_STATS
+static int command_hcstats(int argc, char **argv)
+{
+	int i;
+
+	if (argc > 1) {
+		if (strcasecmp(argv[1], "reset"))
+			return EC_ERROR_PARAM1;
+		stats_reset();
+		return EC_SUCCESS;
+	}
+
+	ccputs("Cmd      Calls   Errs  Min us  Avg us  Max us  MaxLat us\n");
+	for (i = 0; i < HC_STATS_COUNT; i++) {
+		const struct host_command_stats *st = hc_stats + i;
+
+		if (!st->calls)
+			continue;
+
+		ccprintf("0x%02x %9d %6d %7d %7d %7d %10d\n",
+			 __hcmds[i].command, st->calls, st->errors, st->min_us,
+			 st->avg_us, st->max_us, st->max_latency_us);
+		cflush();
+	}
+
+	return EC_SUCCESS;
+}
+DECLARE_CONSOLE_COMMAND(hcstats, command_hcstats,
+			"[reset]",
+			"Print or reset host command timing stats",
+			NULL);
+#endif
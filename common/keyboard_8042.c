@@ -63,17 +63,14 @@ enum scancode_set_list {
 #define KB_TO_HOST_RETRIES 3
 
 /*
- * Mutex to control write access to the to-host buffer head.  Don't need to
- * mutex the tail because reads are only done in one place.
+ * Mutex to serialize producers of the to-host queue; scan codes come from both
+ * the keyboard scan task and the protocol task.  The queue is safe against its
+ * single consumer (keyboard_protocol_task) without a lock.
  */
 static struct mutex to_host_mutex;
 
 static uint8_t to_host_buffer[16];
-static struct queue to_host = {
-	.buf_bytes  = sizeof(to_host_buffer),
-	.unit_bytes = sizeof(uint8_t),
-	.buf        = to_host_buffer,
-};
+static struct queue to_host = QUEUE(to_host_buffer);
 
 /* Queue command/data from the host */
 enum {
@@ -96,12 +93,9 @@ struct host_byte {
  *
  * Hence, 5 (actually 4 plus one spare) is large enough, but use 8 for safety.
  */
-static uint8_t from_host_buffer[8 * sizeof(struct host_byte)];
-static struct queue from_host = {
-	.buf_bytes  = sizeof(from_host_buffer),
-	.unit_bytes = sizeof(struct host_byte),
-	.buf        = from_host_buffer,
-};
+static struct host_byte from_host_buffer[8];
+/* Filled from the LPC interrupt; drained only by keyboard_protocol_task. */
+static struct queue from_host = QUEUE(from_host_buffer);
 
 static int i8042_irq_enabled;
 
@@ -1171,6 +1165,8 @@ DECLARE_CONSOLE_COMMAND(kbd, command_keyboard,
 
 static int command_8042_internal(int argc, char **argv)
 {
+	struct host_byte h;
+	uint8_t chr;
 	int i;
 
 	ccprintf("data_port_state=%d\n", data_port_state);
@@ -1186,17 +1182,14 @@ static int command_8042_internal(int argc, char **argv)
 	ccprintf("controller_ram_address=0x%02x\n", controller_ram_address);
 	ccprintf("A20_status=%d\n", A20_status);
 
-	ccprintf("from_host.buf[]={");
-	for (i = from_host.head; i != from_host.tail;
-			i = (i + 1) % from_host.buf_bytes)
-		ccprintf("0x%02x, ", from_host.buf[i]);
+	ccprintf("from_host[]={");
+	for (i = 0; queue_peek_units(&from_host, &h, i, 1); i++)
+		ccprintf("0x%02x 0x%02x, ", h.type, h.byte);
 	ccprintf("}\n");
 
-	ccprintf("to_host.buf[]={");
-	for (i = to_host.head;
-			i != to_host.tail;
-			i = (i + 1) % to_host.buf_bytes)
-		ccprintf("0x%02x, ", to_host.buf[i]);
+	ccprintf("to_host[]={");
+	for (i = 0; queue_peek_units(&to_host, &chr, i, 1); i++)
+		ccprintf("0x%02x, ", chr);
 	ccprintf("}\n");
 
 	return EC_SUCCESS;
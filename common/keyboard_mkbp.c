@@ -27,10 +27,12 @@
 /*
  * Keyboard FIFO depth.  This needs to be big enough not to overflow if a
  * series of keys is pressed in rapid succession and the kernel is too busy
- * to read them out right away.
+ * to read them out right away.  If it does fill up, new state is merged into
+ * the newest entry.
  *
- * RAM usage is (depth * #cols); see kb_fifo[][] below.  A 16-entry FIFO will
- * consume 16x13=208 bytes, which is non-trivial but not horrible.
+ * RAM usage is (depth * (#cols + timestamp)); see kb_fifo[] below.  A
+ * 16-entry FIFO will consume 16x20=320 bytes, which is non-trivial but not
+ * horrible.
  */
 #define KB_FIFO_DEPTH 16
 
@@ -41,10 +43,16 @@
 #define BATTERY_KEY_ROW 7
 #define BATTERY_KEY_ROW_MASK (1 << BATTERY_KEY_ROW)
 
+struct kb_fifo_entry {
+	uint32_t time;			/* when the state was added */
+	uint8_t state[KEYBOARD_COLS];
+};
+
 static uint32_t kb_fifo_start;		/* first entry */
 static uint32_t kb_fifo_end;		/* last entry */
 static uint32_t kb_fifo_entries;	/* number of existing entries */
-static uint8_t kb_fifo[KB_FIFO_DEPTH][KEYBOARD_COLS];
+static uint32_t kb_fifo_coalesced;	/* merges since last batch read */
+static struct kb_fifo_entry kb_fifo[KB_FIFO_DEPTH];
 static struct mutex fifo_mutex;
 
 /* Config for mkbp protocol; does not include fields from scan config */
@@ -74,10 +82,13 @@ static struct ec_mkbp_protocol_config config = {
  */
 static int kb_fifo_remove(uint8_t *buffp)
 {
+	mutex_lock(&fifo_mutex);
+
 	if (!kb_fifo_entries) {
 		/* no entry remaining in FIFO : return last known state */
 		int last = (kb_fifo_start + KB_FIFO_DEPTH - 1) % KB_FIFO_DEPTH;
-		memcpy(buffp, kb_fifo[last], KEYBOARD_COLS);
+		memcpy(buffp, kb_fifo[last].state, KEYBOARD_COLS);
+		mutex_unlock(&fifo_mutex);
 
 		/*
 		 * Bail out without changing any FIFO indices and let the
@@ -86,12 +97,13 @@ static int kb_fifo_remove(uint8_t *buffp)
 		 */
 		return EC_ERROR_UNKNOWN;
 	}
-	memcpy(buffp, kb_fifo[kb_fifo_start], KEYBOARD_COLS);
+	memcpy(buffp, kb_fifo[kb_fifo_start].state, KEYBOARD_COLS);
 
 	kb_fifo_start = (kb_fifo_start + 1) % KB_FIFO_DEPTH;
 
 	atomic_sub(&kb_fifo_entries, 1);
 
+	mutex_unlock(&fifo_mutex);
 	return EC_SUCCESS;
 }
 
@@ -116,13 +128,14 @@ void keyboard_clear_buffer(void)
 	kb_fifo_start = 0;
 	kb_fifo_end = 0;
 	kb_fifo_entries = 0;
+	kb_fifo_coalesced = 0;
 	for (i = 0; i < KB_FIFO_DEPTH; i++)
-		memset(kb_fifo[i], 0, KEYBOARD_COLS);
+		memset(kb_fifo[i].state, 0, KEYBOARD_COLS);
 }
 
 test_mockable int keyboard_fifo_add(const uint8_t *buffp)
 {
-	int ret = EC_SUCCESS;
+	struct kb_fifo_entry *entry;
 
 	/*
 	 * If keyboard protocol is not enabled, don't save the state to the
@@ -131,25 +144,39 @@ test_mockable int keyboard_fifo_add(const uint8_t *buffp)
 	if (!(config.flags & EC_MKBP_FLAGS_ENABLE))
 		return EC_SUCCESS;
 
-	if (kb_fifo_entries >= config.fifo_max_depth) {
+	if (!config.fifo_max_depth) {
 		CPRINTS("KB FIFO depth %d reached",
 			config.fifo_max_depth);
-		ret = EC_ERROR_OVERFLOW;
-		goto kb_fifo_push_done;
+		return EC_ERROR_OVERFLOW;
 	}
 
 	mutex_lock(&fifo_mutex);
-	memcpy(kb_fifo[kb_fifo_end], buffp, KEYBOARD_COLS);
-	kb_fifo_end = (kb_fifo_end + 1) % KB_FIFO_DEPTH;
-	atomic_add(&kb_fifo_entries, 1);
-	mutex_unlock(&fifo_mutex);
 
-kb_fifo_push_done:
+	if (kb_fifo_entries >= config.fifo_max_depth) {
+		/*
+		 * Dropping the new state could leave a key stuck down on the
+		 * host, so merge it into the newest entry instead.  The host
+		 * misses the state in between, but ends up in the right one.
+		 */
+		CPRINTS("KB FIFO depth %d reached; coalescing",
+			config.fifo_max_depth);
+		entry = kb_fifo +
+			(kb_fifo_end + KB_FIFO_DEPTH - 1) % KB_FIFO_DEPTH;
+		kb_fifo_coalesced++;
+	} else {
+		entry = kb_fifo + kb_fifo_end;
+		kb_fifo_end = (kb_fifo_end + 1) % KB_FIFO_DEPTH;
+		atomic_add(&kb_fifo_entries, 1);
+	}
 
-	if (ret == EC_SUCCESS)
-		set_host_interrupt(1);
+	entry->time = get_time().le.lo;
+	memcpy(entry->state, buffp, KEYBOARD_COLS);
+
+	mutex_unlock(&fifo_mutex);
 
-	return ret;
+	set_host_interrupt(1);
+
+	return EC_SUCCESS;
 }
 
 void keyboard_send_battery_key(void)
@@ -182,6 +209,53 @@ DECLARE_HOST_COMMAND(EC_CMD_MKBP_STATE,
 		     keyboard_get_scan,
 		     EC_VER_MASK(0));
 
+static int keyboard_get_fifo(struct host_cmd_handler_args *args)
+{
+	struct ec_response_mkbp_get_fifo *r = args->response;
+	const int entry_size = sizeof(struct ec_mkbp_fifo_entry) +
+		KEYBOARD_COLS;
+	uint8_t *out = (uint8_t *)(r + 1);
+	int count = 0;
+
+	if (args->response_max < sizeof(*r))
+		return EC_RES_INVALID_PARAM;
+
+	mutex_lock(&fifo_mutex);
+
+	while (kb_fifo_entries && count < 0xff &&
+	       sizeof(*r) + (count + 1) * entry_size <= args->response_max) {
+		const struct kb_fifo_entry *e = kb_fifo + kb_fifo_start;
+		struct ec_mkbp_fifo_entry *o = (struct ec_mkbp_fifo_entry *)
+			(out + count * entry_size);
+
+		o->time = e->time;
+		memcpy(o->state, e->state, KEYBOARD_COLS);
+
+		kb_fifo_start = (kb_fifo_start + 1) % KB_FIFO_DEPTH;
+		atomic_sub(&kb_fifo_entries, 1);
+		count++;
+	}
+
+	r->count = count;
+	r->remaining = kb_fifo_entries;
+	r->cols = KEYBOARD_COLS;
+	r->reserved = 0;
+	r->coalesced = kb_fifo_coalesced;
+	kb_fifo_coalesced = 0;
+
+	if (!kb_fifo_entries)
+		set_host_interrupt(0);
+
+	mutex_unlock(&fifo_mutex);
+
+	args->response_size = sizeof(*r) + count * entry_size;
+
+	return EC_RES_SUCCESS;
+}
+DECLARE_HOST_COMMAND(EC_CMD_MKBP_GET_FIFO,
+		     keyboard_get_fifo,
+		     EC_VER_MASK(0));
+
 static int keyboard_get_info(struct host_cmd_handler_args *args)
 {
 	struct ec_response_mkbp_info *r = args->response;
@@ -26,6 +26,8 @@
 #define CPUTS(outstr) cputs(CC_KEYSCAN, outstr)
 #define CPRINTF(format, args...) cprintf(CC_KEYSCAN, format, ## args)
 #define CPRINTS(format, args...) cprints(CC_KEYSCAN, format, ## args)
+#define CPRINTS_DEFERRED(format, args...) \
+	cprints_deferred(CC_KEYSCAN, format, ## args)
 
 #define SCAN_TIME_COUNT 32  /* Number of last scan times to track */
 
@@ -69,16 +71,53 @@ static const struct boot_key_entry boot_key_list[] = {
 };
 static enum boot_key boot_key_value = BOOT_KEY_OTHER;
 
-static uint8_t debounced_state[KEYBOARD_COLS]; /* Debounced key matrix */
-static uint8_t prev_state[KEYBOARD_COLS];    /* Matrix from previous scan */
-static uint8_t debouncing[KEYBOARD_COLS];    /* Mask of keys being debounced */
+/*
+ * Key matrices used by the debounce logic are padded to whole words, so they
+ * can be processed four columns at a time.
+ */
+#define KB_WORDS ((KEYBOARD_COLS + 3) / 4)
+#define KB_MATRIX(name) uint8_t name[KB_WORDS * 4] __aligned(4)
+#define KB_WORD(name, w) (((uint32_t *)(name))[w])
+
+static KB_MATRIX(debounced_state);	/* Debounced key matrix */
+static KB_MATRIX(prev_state);		/* Matrix from previous scan */
+static KB_MATRIX(debouncing);		/* Mask of keys being debounced */
 static uint8_t simulated_key[KEYBOARD_COLS]; /* Keys simulated-pressed */
 
 static uint32_t scan_time[SCAN_TIME_COUNT];  /* Times of last scans */
 static int scan_time_index;                  /* Current scan_time[] index */
 
-/* Index into scan_time[] when each key started debouncing */
-static uint8_t scan_edge_index[KEYBOARD_COLS][KEYBOARD_ROWS];
+/*
+ * Keys which started debouncing on the same scan form a debounce group, with
+ * the time of that scan and a mask of the keys.  Groups are kept oldest
+ * first, so expiry is checked once per group, a whole matrix at a time,
+ * rather than once per key.  If a key bounces again it moves to the newest
+ * group.  Groups left empty are dropped, wherever they are.
+ *
+ * Keys rarely change on more than a few scans within one debounce window, so
+ * there are only CONFIG_KEYBOARD_DEBOUNCE_GROUPS groups.  If more are needed,
+ * the oldest group is merged into the next oldest.  That only ever makes keys
+ * debounce for longer.
+ */
+#define DEBOUNCE_GROUPS CONFIG_KEYBOARD_DEBOUNCE_GROUPS
+
+struct debounce_group {
+	uint32_t time;			/* Scan time of the edge */
+	uint32_t keys[KB_WORDS];	/* Keys which changed on that scan */
+};
+
+static struct debounce_group debounce_group[DEBOUNCE_GROUPS];
+static int debounce_first;		/* Index of oldest group */
+static int debounce_count;		/* Number of groups in use */
+
+/* Has prev_state been checked for ghosting? */
+static int prev_state_ghost_free;
+
+#ifdef CONFIG_KEYBOARD_PARTIAL_SCAN
+/* Rows read from each column when it was last scanned, before masking */
+static uint8_t raw_state[KEYBOARD_COLS];
+static int scans_since_full;		/* Partial scans since a full scan */
+#endif
 
 /* Minimum delay between keyboard scans based on current clock frequency */
 static uint32_t post_scan_clock_us;
@@ -107,7 +146,7 @@ void keyboard_scan_enable(int enable, enum kb_scan_disable_masks mask)
 					 (disable_scanning_mask | mask);
 
 	if (disable_scanning_mask != old_disable_scanning)
-		CPRINTS("KB disable_scanning_mask changed: 0x%08x",
+		CPRINTS_DEFERRED("KB disable_scanning_mask changed: 0x%08x",
 				disable_scanning_mask);
 
 	if (old_disable_scanning && !disable_scanning_mask) {
@@ -200,6 +239,54 @@ static void simulate_key(int row, int col, int pressed)
 	ensure_keyboard_scanned(kbd_polls);
 }
 
+#ifdef CONFIG_KEYBOARD_PARTIAL_SCAN
+/**
+ * Return non-zero if a column needs rescanning on a partial scan.
+ */
+static int column_active(int c)
+{
+	return prev_state[c] | debouncing[c] | simulated_key[c];
+}
+
+/**
+ * Decide whether the next scan must cover the whole matrix.
+ *
+ * Drives all columns at once, which shows every row with a key down in any
+ * column.  A row which no column had down last time it was scanned means a
+ * key went down in a column a partial scan would skip.
+ *
+ * @return 1 if a full scan is needed, 0 if a partial scan will do.
+ */
+static int need_full_scan(void)
+{
+	uint8_t rows, known = 0;
+	int c;
+
+	if (++scans_since_full >= CONFIG_KEYBOARD_FULL_SCAN_PERIOD)
+		return 1;
+
+	keyboard_raw_drive_column(KEYBOARD_COLUMN_ALL);
+	udelay(keyscan_config.output_settle_us);
+	rows = keyboard_raw_read_rows();
+
+	for (c = 0; c < KEYBOARD_COLS; c++) {
+		rows |= simulated_key[c];
+		known |= raw_state[c];
+	}
+
+	return (rows & ~known) ? 1 : 0;
+}
+
+/* Make the next scan a full one */
+static void force_full_scan(void)
+{
+	scans_since_full = CONFIG_KEYBOARD_FULL_SCAN_PERIOD;
+}
+#else
+#define need_full_scan() 1
+#define force_full_scan()
+#endif
+
 /**
  * Read the raw keyboard matrix state.
  *
@@ -207,15 +294,23 @@ static void simulate_key(int row, int col, int pressed)
  * is ok because it's a spin-loop.
  *
  * @param state		Destination for new state (must be KEYBOARD_COLS long).
+ * @param full		Scan all columns.  If zero, only columns with keys
+ *			pressed or debouncing are scanned; the others keep
+ *			their state from prev_state.
  *
  * @return 1 if at least one key is pressed, else zero.
  */
-static int read_matrix(uint8_t *state)
+static int read_matrix(uint8_t *state, int full)
 {
 	int c;
 	uint8_t r;
 	int pressed = 0;
 
+#ifdef CONFIG_KEYBOARD_TEST
+	/* Test sequences expect every column to be read */
+	full = 1;
+#endif
+
 	for (c = 0; c < KEYBOARD_COLS; c++) {
 		/*
 		 * Stop if scanning becomes disabled. Note, scanning is enabled
@@ -224,6 +319,14 @@ static int read_matrix(uint8_t *state)
 		if (!keyboard_scan_is_enabled())
 			break;
 
+#ifdef CONFIG_KEYBOARD_PARTIAL_SCAN
+		if (!full && !column_active(c)) {
+			pressed |= raw_state[c];
+			state[c] = prev_state[c];
+			continue;
+		}
+#endif
+
 		/* Select column, then wait a bit for it to settle */
 		keyboard_raw_drive_column(c);
 		udelay(keyscan_config.output_settle_us);
@@ -241,6 +344,10 @@ static int read_matrix(uint8_t *state)
 		 */
 		pressed |= r;
 
+#ifdef CONFIG_KEYBOARD_PARTIAL_SCAN
+		raw_state[c] = r;
+#endif
+
 		/* Mask off keys that don't exist on the actual keyboard */
 		r &= keyscan_config.actual_key_mask[c];
 
@@ -253,6 +360,11 @@ static int read_matrix(uint8_t *state)
 		state[c] = r;
 	}
 
+#ifdef CONFIG_KEYBOARD_PARTIAL_SCAN
+	if (full)
+		scans_since_full = 0;
+#endif
+
 	keyboard_raw_drive_column(KEYBOARD_COLUMN_NONE);
 
 	return pressed ? 1 : 0;
@@ -318,6 +430,9 @@ static int check_runtime_keys(const uint8_t *state)
  * that coords which don't correspond with actual keys don't trigger ghosting
  * detection.
  *
+ * Once prev_state has passed this check, only pairs of columns where at least
+ * one column changed since prev_state need checking.
+ *
  * @param state		Keyboard state to check.
  *
  * @return 1 if ghosting detected, else 0.
@@ -329,8 +444,10 @@ static int has_ghosting(const uint8_t *state)
 	for (c = 0; c < KEYBOARD_COLS; c++) {
 		if (!state[c])
 			continue;
+		if (prev_state_ghost_free && state[c] == prev_state[c])
+			continue;
 
-		for (c2 = c + 1; c2 < KEYBOARD_COLS; c2++) {
+		for (c2 = 0; c2 < KEYBOARD_COLS; c2++) {
 			/*
 			 * A little bit of cleverness here.  Ghosting happens
 			 * if 2 columns share at least 2 keys.  So we OR the
@@ -340,7 +457,7 @@ static int has_ghosting(const uint8_t *state)
 			 */
 			uint8_t common = state[c] & state[c2];
 
-			if (common & (common - 1))
+			if (c2 != c && (common & (common - 1)))
 				return 1;
 		}
 	}
@@ -348,19 +465,163 @@ static int has_ghosting(const uint8_t *state)
 	return 0;
 }
 
+/**
+ * Drop debounce groups which have no keys left, keeping the rest in order.
+ */
+static void debounce_compact(void)
+{
+	struct debounce_group *g, *to;
+	uint32_t left;
+	int n, w, kept = 0;
+
+	for (n = 0; n < debounce_count; n++) {
+		g = debounce_group + (debounce_first + n) % DEBOUNCE_GROUPS;
+		for (w = 0, left = 0; w < KB_WORDS; w++)
+			left |= g->keys[w];
+		if (!left)
+			continue;
+
+		to = debounce_group + (debounce_first + kept) % DEBOUNCE_GROUPS;
+		if (to != g)
+			*to = *g;
+		kept++;
+	}
+
+	debounce_count = kept;
+}
+
+/**
+ * Start debouncing keys which changed on this scan.
+ *
+ * @param diff		Packed mask of keys which changed
+ * @param tnow		Time of this scan
+ */
+static void debounce_start(const uint32_t *diff, uint32_t tnow)
+{
+	struct debounce_group *g;
+	int n, w;
+
+	/* Keys which bounced restart debouncing in the new group */
+	for (n = 0; n < debounce_count; n++) {
+		g = debounce_group + (debounce_first + n) % DEBOUNCE_GROUPS;
+		for (w = 0; w < KB_WORDS; w++)
+			g->keys[w] &= ~diff[w];
+	}
+	debounce_compact();
+
+	if (debounce_count == DEBOUNCE_GROUPS) {
+		/* Merge the oldest group into the next */
+		struct debounce_group *oldest = debounce_group + debounce_first;
+
+		debounce_first = (debounce_first + 1) % DEBOUNCE_GROUPS;
+		debounce_count--;
+		g = debounce_group + debounce_first;
+		for (w = 0; w < KB_WORDS; w++)
+			g->keys[w] |= oldest->keys[w];
+	}
+
+	g = debounce_group +
+		(debounce_first + debounce_count) % DEBOUNCE_GROUPS;
+	debounce_count++;
+	g->time = tnow;
+	for (w = 0; w < KB_WORDS; w++) {
+		g->keys[w] = diff[w];
+		KB_WORD(debouncing, w) |= diff[w];
+	}
+}
+
+/**
+ * Find keys which are done debouncing.
+ *
+ * @param new_state	Key matrix from this scan
+ * @param done		Destination for packed mask of keys done debouncing
+ * @param tnow		Time of this scan
+ *
+ * @return 1 if any keys are done debouncing, else 0.
+ */
+static int debounce_check(const uint8_t *new_state, uint32_t *done,
+			  uint32_t tnow)
+{
+	const uint32_t down_us = keyscan_config.debounce_down_us;
+	const uint32_t up_us = keyscan_config.debounce_up_us;
+	struct debounce_group *g;
+	uint32_t age, pressed, released, any_done = 0;
+	int n, w;
+
+	memset(done, 0, KB_WORDS * sizeof(uint32_t));
+
+	for (n = 0; n < debounce_count; n++) {
+		g = debounce_group + (debounce_first + n) % DEBOUNCE_GROUPS;
+		age = tnow - g->time;
+
+		/*
+		 * Pressed keys wait debounce_down_us, released keys wait
+		 * debounce_up_us.  Once a group is too young for both, so are
+		 * all the groups after it.
+		 */
+		pressed = age >= down_us ? ~0 : 0;
+		released = age >= up_us ? ~0 : 0;
+		if (!pressed && !released)
+			break;
+
+		for (w = 0; w < KB_WORDS; w++) {
+			uint32_t state = KB_WORD(new_state, w);
+			uint32_t d = g->keys[w] &
+				((state & pressed) | (~state & released));
+
+			g->keys[w] &= ~d;
+			done[w] |= d;
+			any_done |= d;
+		}
+	}
+
+	if (!any_done)
+		return 0;
+
+	debounce_compact();
+
+	for (w = 0; w < KB_WORDS; w++)
+		KB_WORD(debouncing, w) &= ~done[w];
+
+	return 1;
+}
+
+#ifdef CONFIG_KEYBOARD_PROTOCOL_8042
+/**
+ * Tell the keyboard module about keys which changed state.
+ *
+ * @param changed	Mask of keys which changed
+ * @param state		New keyboard state
+ */
+static void report_changes(const uint8_t *changed, const uint8_t *state)
+{
+	int c, i;
+
+	for (c = 0; c < KEYBOARD_COLS; c++) {
+		for (i = 0; changed[c] >> i; i++) {
+			if (changed[c] & (1 << i))
+				keyboard_state_changed(i, c,
+						       (state[c] >> i) & 1);
+		}
+	}
+}
+#endif
+
 /**
  * Update keyboard state using low-level interface to read keyboard.
  *
- * @param state		Keyboard state to update.
+ * @param state		Keyboard state to update; must be a KB_MATRIX.
  *
  * @return 1 if any key is still pressed, 0 if no key is pressed.
  */
-static int check_keys_changed(uint8_t *state)
+test_export_static int check_keys_changed(uint8_t *state)
 {
 	int any_pressed = 0;
-	int c, i;
+	int i;
 	int any_change = 0;
-	static uint8_t new_state[KEYBOARD_COLS];
+	static KB_MATRIX(new_state);
+	uint32_t diff[KB_WORDS], changed[KB_WORDS];
+	uint32_t any_diff = 0;
 	uint32_t tnow = get_time().le.lo;
 
 	/* Save the current scan time */
@@ -369,63 +630,37 @@ static int check_keys_changed(uint8_t *state)
 	scan_time[scan_time_index] = tnow;
 
 	/* Read the raw key state */
-	any_pressed = read_matrix(new_state);
+	any_pressed = read_matrix(new_state, need_full_scan());
 
 	/* Ignore if so many keys are pressed that we're ghosting. */
 	if (has_ghosting(new_state))
 		return any_pressed;
 
 	/* Check for changes between previous scan and this one */
-	for (c = 0; c < KEYBOARD_COLS; c++) {
-		int diff = new_state[c] ^ prev_state[c];
-
-		if (!diff)
-			continue;
-
-		for (i = 0; i < KEYBOARD_ROWS; i++) {
-			if (diff & (1 << i))
-				scan_edge_index[c][i] = scan_time_index;
+	for (i = 0; i < KB_WORDS; i++) {
+		diff[i] = KB_WORD(new_state, i) ^ KB_WORD(prev_state, i);
+		any_diff |= diff[i];
+		KB_WORD(prev_state, i) = KB_WORD(new_state, i);
+	}
+	prev_state_ghost_free = 1;
+	if (any_diff)
+		debounce_start(diff, tnow);
+
+	/* Check for keys which are done debouncing and changed state */
+	if (debounce_check(new_state, changed, tnow)) {
+		for (i = 0; i < KB_WORDS; i++) {
+			changed[i] &= KB_WORD(state, i) ^ KB_WORD(new_state, i);
+			KB_WORD(state, i) ^= changed[i];
+			if (changed[i])
+				any_change = 1;
 		}
-
-		debouncing[c] |= diff;
-		prev_state[c] = new_state[c];
 	}
 
-	/* Check for keys which are done debouncing */
-	for (c = 0; c < KEYBOARD_COLS; c++) {
-		int debc = debouncing[c];
-
-		if (!debc)
-			continue;
-
-		for (i = 0; i < KEYBOARD_ROWS; i++) {
-			int mask = 1 << i;
-			int new_mask = new_state[c] & mask;
-
-			/* Are we done debouncing this key? */
-			if (!(debc & mask))
-				continue;  /* Not debouncing this key */
-			if (tnow - scan_time[scan_edge_index[c][i]] <
-			    (new_mask ? keyscan_config.debounce_down_us :
-					keyscan_config.debounce_up_us))
-				continue;  /* Not done debouncing */
-
-			debouncing[c] &= ~mask;
-
-			/* Did the key change from its previous state? */
-			if ((state[c] & mask) == new_mask)
-				continue;  /* No */
-
-			state[c] ^= mask;
-			any_change = 1;
-
 #ifdef CONFIG_KEYBOARD_PROTOCOL_8042
-			/* Inform keyboard module if scanning is enabled */
-			if (keyboard_scan_is_enabled())
-				keyboard_state_changed(i, c, new_mask ? 1 : 0);
+	/* Inform keyboard module if scanning is enabled */
+	if (any_change && keyboard_scan_is_enabled())
+		report_changes((const uint8_t *)changed, state);
 #endif
-		}
-	}
 
 	if (any_change) {
 
@@ -559,8 +794,9 @@ void keyboard_scan_init(void)
 	keyboard_raw_drive_column(KEYBOARD_COLUMN_NONE);
 
 	/* Initialize raw state */
-	read_matrix(debounced_state);
+	read_matrix(debounced_state, 1);
 	memcpy(prev_state, debounced_state, sizeof(prev_state));
+	prev_state_ghost_free = 0;
 
 	/* Check for keys held down at boot */
 	boot_key_value = check_boot_key(debounced_state);
@@ -584,7 +820,7 @@ void keyboard_scan_task(void)
 
 	while (1) {
 		/* Enable all outputs */
-		CPRINTS("KB wait");
+		CPRINTS_DEFERRED("KB wait");
 		if (keyboard_scan_is_enabled())
 			keyboard_raw_drive_column(KEYBOARD_COLUMN_ALL);
 		keyboard_raw_enable_interrupt(1);
@@ -603,9 +839,10 @@ void keyboard_scan_task(void)
 		} while (!keyboard_scan_is_enabled());
 
 		/* Enter polling mode */
-		CPRINTS("KB poll");
+		CPRINTS_DEFERRED("KB poll");
 		keyboard_raw_enable_interrupt(0);
 		keyboard_raw_drive_column(KEYBOARD_COLUMN_NONE);
+		force_full_scan();
 
 		/* Busy polling keyboard state. */
 		while (keyboard_scan_is_enabled()) {
@@ -20,6 +20,8 @@
 /* Console output macros */
 #define CPUTS(outstr) cputs(CC_MOTION_SENSE, outstr)
 #define CPRINTS(format, args...) cprints(CC_MOTION_SENSE, format, ## args)
+#define CPRINTS_DEFERRED(format, args...) \
+	cprints_deferred(CC_MOTION_SENSE, format, ## args)
 
 /* Minimum time in between running motion sense task loop. */
 #define MIN_MOTION_SENSE_WAIT_TIME (1 * MSEC)
@@ -288,7 +290,7 @@ void motion_sense_task(void)
 
 #ifdef CONFIG_CMD_LID_ANGLE
 		if (accel_disp) {
-			CPRINTS("ACC base=%-5d, %-5d, %-5d  lid=%-5d, "
+			CPRINTS_DEFERRED("ACC base=%-5d, %-5d, %-5d  lid=%-5d, "
 					"%-5d, %-5d  a=%-6.1d r=%d",
 					acc_base[X], acc_base[Y], acc_base[Z],
 					acc_lid[X], acc_lid[Y], acc_lid[Z],
@@ -12,6 +12,8 @@
 #include "util.h"
 
 #define CPRINTF(format, args...) cprintf(CC_PORT80, format, ## args)
+#define CPRINTS_DEFERRED(format, args...) \
+	cprints_deferred(CC_PORT80, format, ## args)
 
 #define HISTORY_LEN 256
 
@@ -23,12 +25,21 @@ static int print_in_int = 1;
 
 void port_80_write(int data)
 {
+#ifdef CONFIG_CONSOLE_DEFERRED
+	/*
+	 * Only queue the code here; it is formatted later by the hook task.
+	 * Deferred output is always on its own line, so 'scroll' is ignored.
+	 */
+	if (print_in_int)
+		CPRINTS_DEFERRED("Port 80: 0x%02x", data);
+#else
 	/*
 	 * Note that this currently prints from inside the LPC interrupt
 	 * itself.  If you're dropping events, turn print_in_int off.
 	 */
 	if (print_in_int)
 		CPRINTF("%c[%T Port 80: 0x%02x]", scroll ? '\n' : '\r', data);
+#endif
 
 	/* Save current port80 code if system is resetting */
 	if (data == PORT_80_EVENT_RESET && writes) {
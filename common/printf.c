@@ -28,14 +28,127 @@ static int hexdigit(int c)
 	return c > 9 ? (c + 'a' - 10) : (c + '0');
 }
 
+/**
+ * Divide a number by 10 without a divide instruction.
+ *
+ * Uses the shift-and-add reciprocal from Hacker's Delight (divu10).  The
+ * quotient estimate is at most one too small; the remainder check corrects it.
+ * Cortex-M0 has no divide, and there is no cheap 64-bit divide anywhere.
+ *
+ * @param n	Number to divide; replaced with the quotient.
+ *
+ * @return The remainder (0 - 9).
+ */
+static int divmod10(uint64_t *n)
+{
+	uint64_t v = *n;
+	uint64_t q;
+	int r;
+
+	if (v <= 0xffffffff) {
+		uint32_t v32 = v, q32;
+
+		q32 = (v32 >> 1) + (v32 >> 2);
+		q32 += q32 >> 4;
+		q32 += q32 >> 8;
+		q32 += q32 >> 16;
+		q32 >>= 3;
+		r = v32 - ((q32 << 3) + (q32 << 1));
+		if (r > 9) {
+			q32++;
+			r -= 10;
+		}
+		*n = q32;
+		return r;
+	}
+
+	q = (v >> 1) + (v >> 2);
+	q += q >> 4;
+	q += q >> 8;
+	q += q >> 16;
+	q += q >> 32;
+	q >>= 3;
+	r = v - ((q << 3) + (q << 1));
+	if (r > 9) {
+		q++;
+		r -= 10;
+	}
+	*n = q;
+	return r;
+}
+
+/* Output functions and context passed through vfnprintf() */
+struct printf_output {
+	int (*addchar)(void *context, int c);
+	int (*addstr)(void *context, const char *s, int len);
+	void *context;
+};
+
+/**
+ * Output a run of characters.
+ *
+ * @return 0 if all characters were accepted, non-zero if any were dropped.
+ */
+static int out_str(const struct printf_output *out, const char *s, int len)
+{
+	if (out->addstr)
+		return len ? out->addstr(out->context, s, len) : 0;
+
+	while (len--) {
+		if (out->addchar(out->context, *s++))
+			return 1;
+	}
+	return 0;
+}
+
+/**
+ * Output a single character.
+ *
+ * @return 0 if the character was accepted, non-zero if it was dropped.
+ */
+static int out_char(const struct printf_output *out, int c)
+{
+	char ch = c;
+
+	if (out->addchar)
+		return out->addchar(out->context, c);
+
+	return out->addstr(out->context, &ch, 1);
+}
+
+/**
+ * Output a run of padding characters.
+ *
+ * @param c	Padding character; '0' or ' '
+ * @param len	Number of characters
+ * @return 0 if all characters were accepted, non-zero if any were dropped.
+ */
+static int out_pad(const struct printf_output *out, int c, int len)
+{
+	static const char zeros[] = "0000000000000000";
+	static const char spaces[] = "                ";
+	const char *run = (c == '0') ? zeros : spaces;
+	int n;
+
+	for (; len > 0; len -= n) {
+		n = MIN(len, sizeof(zeros) - 1);
+		if (out_str(out, run, n))
+			return 1;
+	}
+	return 0;
+}
+
 /* Flags for vfnprintf() flags */
 #define PF_LEFT		(1 << 0)  /* Left-justify */
 #define PF_PADZERO	(1 << 1)  /* Pad with 0's not spaces */
 #define PF_NEGATIVE	(1 << 2)  /* Number is negative */
 #define PF_64BIT	(1 << 3)  /* Number is 64-bit */
 
-int vfnprintf(int (*addchar)(void *context, int c), void *context,
-	      const char *format, va_list args)
+/**
+ * Common implementation for vfnprintf() and vfnprintf_str().
+ */
+static int __vfnprintf(const struct printf_output *out, const char *format,
+		       va_list args)
 {
 	/*
 	 * Longest uint64 in decimal = 20
@@ -51,14 +164,17 @@ int vfnprintf(int (*addchar)(void *context, int c), void *context,
 	int vlen;
 
 	while (*format) {
-		int c = *format++;
-
-		/* Copy normal characters */
-		if (c != '%') {
-			if (addchar(context, c))
-				return EC_ERROR_OVERFLOW;
-			continue;
-		}
+		const char *run = format;
+		int c;
+
+		/* Copy normal characters, a run at a time */
+		while (*format && *format != '%')
+			format++;
+		if (out_str(out, run, format - run))
+			return EC_ERROR_OVERFLOW;
+		if (!*format)
+			break;
+		format++;
 
 		/* Zero flags, now that we're in a format */
 		flags = 0;
@@ -68,15 +184,17 @@ int vfnprintf(int (*addchar)(void *context, int c), void *context,
 
 		/* Send "%" for "%%" input */
 		if (c == '%' || c == '\0') {
-			if (addchar(context, '%'))
+			if (out_char(out, '%'))
 				return EC_ERROR_OVERFLOW;
+			if (c == '\0')
+				break;
 			continue;
 		}
 
 		/* Handle %c */
 		if (c == 'c') {
 			c = va_arg(args, int);
-			if (addchar(context, c))
+			if (out_char(out, c))
 				return EC_ERROR_OVERFLOW;
 			continue;
 		}
@@ -145,8 +263,8 @@ int vfnprintf(int (*addchar)(void *context, int c), void *context,
 			}
 
 			for (; precision; precision--, vstr++) {
-				if (addchar(context, hexdigit(*vstr >> 4)) ||
-				    addchar(context, hexdigit(*vstr)))
+				if (out_char(out, hexdigit(*vstr >> 4)) ||
+				    out_char(out, hexdigit(*vstr)))
 					return EC_ERROR_OVERFLOW;
 			}
 
@@ -224,7 +342,7 @@ int vfnprintf(int (*addchar)(void *context, int c), void *context,
 			 * numbers.
 			 */
 			for (vlen = 0; vlen < precision; vlen++)
-				*(--vstr) = '0' + uint64divmod(&v, 10);
+				*(--vstr) = '0' + divmod10(&v);
 			if (precision)
 				*(--vstr) = '.';
 
@@ -232,7 +350,14 @@ int vfnprintf(int (*addchar)(void *context, int c), void *context,
 				*(--vstr) = '0';
 
 			while (v) {
-				int digit = uint64divmod(&v, base);
+				int digit;
+
+				if (base == 10) {
+					digit = divmod10(&v);
+				} else {
+					digit = v & (base - 1);
+					v >>= (base == 16) ? 4 : 1;
+				}
 				if (digit < 10)
 					*(--vstr) = '0' + digit;
 				else if (c == 'X')
@@ -262,18 +387,16 @@ int vfnprintf(int (*addchar)(void *context, int c), void *context,
 		if (!precision)
 			precision = MAX(vlen, pad_width);
 
-		while (vlen < pad_width && !(flags & PF_LEFT)) {
-			if (addchar(context, flags & PF_PADZERO ? '0' : ' '))
+		if (vlen < pad_width && !(flags & PF_LEFT)) {
+			if (out_pad(out, flags & PF_PADZERO ? '0' : ' ',
+				    pad_width - vlen))
 				return EC_ERROR_OVERFLOW;
-			vlen++;
 		}
-		while (*vstr && --precision >= 0)
-			if (addchar(context, *vstr++))
+		if (out_str(out, vstr, MIN(vlen, precision)))
+			return EC_ERROR_OVERFLOW;
+		if (vlen < pad_width && (flags & PF_LEFT)) {
+			if (out_pad(out, ' ', pad_width - vlen))
 				return EC_ERROR_OVERFLOW;
-		while (vlen < pad_width && flags & PF_LEFT) {
-			if (addchar(context, ' '))
-				return EC_ERROR_OVERFLOW;
-			vlen++;
 		}
 	}
 
@@ -281,6 +404,23 @@ int vfnprintf(int (*addchar)(void *context, int c), void *context,
 	return EC_SUCCESS;
 }
 
+int vfnprintf(int (*addchar)(void *context, int c), void *context,
+	      const char *format, va_list args)
+{
+	struct printf_output out = {addchar, NULL, context};
+
+	return __vfnprintf(&out, format, args);
+}
+
+int vfnprintf_str(int (*addchar)(void *context, int c),
+		  int (*addstr)(void *context, const char *s, int len),
+		  void *context, const char *format, va_list args)
+{
+	struct printf_output out = {addchar, addstr, context};
+
+	return __vfnprintf(&out, format, args);
+}
+
 /* Context for snprintf() */
 struct snprintf_context {
 	char *str;
@@ -306,6 +446,25 @@ static int snprintf_addchar(void *context, int c)
 	return 0;
 }
 
+/**
+ * Add a run of characters to the string context.
+ *
+ * @param context	Context receiving characters
+ * @param s		Characters to add
+ * @param len		Number of characters
+ * @return 0 if all characters added, 1 if any dropped because no space.
+ */
+static int snprintf_addstr(void *context, const char *s, int len)
+{
+	struct snprintf_context *ctx = (struct snprintf_context *)context;
+	int n = MIN(len, ctx->size);
+
+	memcpy(ctx->str, s, n);
+	ctx->str += n;
+	ctx->size -= n;
+	return n < len;
+}
+
 int snprintf(char *str, int size, const char *format, ...)
 {
 	struct snprintf_context ctx;
@@ -319,7 +478,8 @@ int snprintf(char *str, int size, const char *format, ...)
 	ctx.size = size - 1;  /* Reserve space for terminating '\0' */
 
 	va_start(args, format);
-	rv = vfnprintf(snprintf_addchar, &ctx, format, args);
+	rv = vfnprintf_str(snprintf_addchar, snprintf_addstr, &ctx, format,
+			   args);
 	va_end(args);
 
 	/* Terminate string */
@@ -7,9 +7,26 @@
 #include "queue.h"
 #include "util.h"
 
-void queue_reset(struct queue *queue)
+/*
+ * Keep the compiler from moving buffer accesses across a counter update.  The
+ * EC is single-core, so ordering as seen by an interrupt handler on the same
+ * CPU is all that is needed.
+ */
+#define queue_barrier() asm volatile("" : : : "memory")
+
+void queue_reset(struct queue *q)
+{
+	q->head = q->tail = 0;
+}
+
+int queue_count(const struct queue *q)
 {
-	queue->head = queue->tail = 0;
+	return q->tail - q->head;
+}
+
+int queue_space(const struct queue *q)
+{
+	return q->buffer_units - queue_count(q);
 }
 
 int queue_is_empty(const struct queue *q)
@@ -19,39 +36,94 @@ int queue_is_empty(const struct queue *q)
 
 int queue_has_space(const struct queue *q, int unit_count)
 {
-	if (q->tail >= q->head)
-		return (q->tail + unit_count * q->unit_bytes) <=
-		       (q->head + q->buf_bytes - 1);
-	else
-		return (q->tail + unit_count * q->unit_bytes) <=
-		       (q->head - 1);
+	return unit_count <= queue_space(q);
 }
 
-void queue_add_units(struct queue *q, const void *src, int unit_count)
+/**
+ * Copy units into the ring at free-running position pos.
+ *
+ * At most two memcpy() calls; the second only when the copy wraps.
+ */
+static void queue_write(const struct queue *q, unsigned int pos,
+			const uint8_t *src, int unit_count)
 {
-	const uint8_t *s = (const uint8_t *)src;
+	int index = pos & (q->buffer_units - 1);
+	int first = MIN(unit_count, q->buffer_units - index);
+
+	memcpy(q->buffer + index * q->unit_bytes, src, first * q->unit_bytes);
+	if (first < unit_count)
+		memcpy(q->buffer, src + first * q->unit_bytes,
+		       (unit_count - first) * q->unit_bytes);
+}
 
-	if (!queue_has_space(q, unit_count))
-		return;
+/**
+ * Copy units out of the ring from free-running position pos.
+ */
+static void queue_read(const struct queue *q, unsigned int pos,
+		       uint8_t *dest, int unit_count)
+{
+	int index = pos & (q->buffer_units - 1);
+	int first = MIN(unit_count, q->buffer_units - index);
 
-	for (unit_count *= q->unit_bytes; unit_count; unit_count--) {
-		q->buf[q->tail++] = *(s++);
-		q->tail %= q->buf_bytes;
-	}
+	memcpy(dest, q->buffer + index * q->unit_bytes, first * q->unit_bytes);
+	if (first < unit_count)
+		memcpy(dest + first * q->unit_bytes, q->buffer,
+		       (unit_count - first) * q->unit_bytes);
 }
 
-int queue_remove_unit(struct queue *q, void *dest)
+int queue_add_units(struct queue *q, const void *src, int unit_count)
 {
-	int count;
-	uint8_t *d = (uint8_t *)dest;
+	unsigned int tail = q->tail;
 
-	if (queue_is_empty(q))
+	if (unit_count <= 0 || !queue_has_space(q, unit_count))
 		return 0;
 
-	for (count = q->unit_bytes; count; count--) {
-		*(d++) = q->buf[q->head++];
-		q->head %= q->buf_bytes;
-	}
+	queue_write(q, tail, src, unit_count);
+
+	/* Publish the units only once they are in the buffer */
+	queue_barrier();
+	q->tail = tail + unit_count;
+
+	return unit_count;
+}
 
-	return 1;
+int queue_peek_units(const struct queue *q, void *dest, int offset,
+		     int unit_count)
+{
+	int available = queue_count(q) - offset;
+
+	if (unit_count > available)
+		unit_count = available;
+	if (unit_count <= 0)
+		return 0;
+
+	/* Read the counter before the data it covers */
+	queue_barrier();
+	queue_read(q, q->head + offset, dest, unit_count);
+
+	return unit_count;
+}
+
+int queue_remove_units(struct queue *q, void *dest, int unit_count)
+{
+	unsigned int head = q->head;
+
+	if (dest)
+		unit_count = queue_peek_units(q, dest, 0, unit_count);
+	else
+		unit_count = MIN(unit_count, queue_count(q));
+
+	if (unit_count <= 0)
+		return 0;
+
+	/* Release the space only once the units are copied out */
+	queue_barrier();
+	q->head = head + unit_count;
+
+	return unit_count;
+}
+
+int queue_remove_unit(struct queue *q, void *dest)
+{
+	return queue_remove_units(q, dest, 1);
 }
@@ -36,7 +36,13 @@
  */
 
 #include "sha256.h"
+
+#ifdef HOST_TOOLS_BUILD
+/* Also built into host tools, which use the C library */
+#include <string.h>
+#else
 #include "util.h"
+#endif
 
 #define SHFR(x, n)    (x >> n)
 #define ROTR(x, n)   ((x >> n) | (x << ((sizeof(x) << 3) - n)))
@@ -73,13 +79,30 @@
 			+ SHA256_F3(w[i - 15]) + w[i - 16];	\
 	}
 
-#define SHA256_EXP(a, b, c, d, e, f, g, h, j)				\
+/*
+ * One round.  Instead of shifting all eight working variables along every
+ * round, callers rotate the order of the arguments, so the variables can stay
+ * in registers and only d and h are written.
+ */
+#define SHA256_RND(a, b, c, d, e, f, g, h, j)				\
 	{								\
-		t1 = wv[h] + SHA256_F2(wv[e]) + CH(wv[e], wv[f], wv[g])	\
+		uint32_t t1 = h + SHA256_F2(e) + CH(e, f, g)		\
 			+ sha256_k[j] + w[j];				\
-		t2 = SHA256_F1(wv[a]) + MAJ(wv[a], wv[b], wv[c]);	\
-		wv[d] += t1;						\
-		wv[h] = t1 + t2;					\
+		d += t1;						\
+		h = t1 + SHA256_F1(a) + MAJ(a, b, c);			\
+	}
+
+/* Eight rounds, after which the variables are back in their places */
+#define SHA256_RND8(j)						\
+	{							\
+		SHA256_RND(a, b, c, d, e, f, g, h, (j) + 0);	\
+		SHA256_RND(h, a, b, c, d, e, f, g, (j) + 1);	\
+		SHA256_RND(g, h, a, b, c, d, e, f, (j) + 2);	\
+		SHA256_RND(f, g, h, a, b, c, d, e, (j) + 3);	\
+		SHA256_RND(e, f, g, h, a, b, c, d, (j) + 4);	\
+		SHA256_RND(d, e, f, g, h, a, b, c, (j) + 5);	\
+		SHA256_RND(c, d, e, f, g, h, a, b, (j) + 6);	\
+		SHA256_RND(b, c, d, e, f, g, h, a, (j) + 7);	\
 	}
 
 static const uint32_t sha256_h0[8] = {
@@ -123,77 +146,108 @@ void SHA256_init(struct sha256_ctx *ctx)
 	ctx->tot_len = 0;
 }
 
+/**
+ * Load a big-endian word from a 4-byte aligned address.
+ */
+static inline uint32_t load_be32(const uint8_t *p)
+{
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	return *(const uint32_t *)p;
+#else
+	return __builtin_bswap32(*(const uint32_t *)p);
+#endif
+}
+
 static void SHA256_transform(struct sha256_ctx *ctx, const uint8_t *message,
 			     unsigned int block_nb)
 {
 	/* Note: this function requires a considerable amount of stack */
 	uint32_t w[64];
-	uint32_t wv[8];
-	uint32_t t1, t2;
-	const unsigned char *sub_block;
-	int i, j;
-
-	for (i = 0; i < (int) block_nb; i++) {
-		sub_block = message + (i << 6);
-
-		for (j = 0; j < 16; j++)
-			PACK32(&sub_block[j << 2], &w[j]);
+	uint32_t a, b, c, d, e, f, g, h;
+	int j;
+
+	for (; block_nb; block_nb--, message += SHA256_BLOCK_SIZE) {
+		if (!((uintptr_t)message & 3)) {
+			for (j = 0; j < 16; j++)
+				w[j] = load_be32(message + (j << 2));
+		} else {
+			for (j = 0; j < 16; j++)
+				PACK32(&message[j << 2], &w[j]);
+		}
 
 		for (j = 16; j < 64; j++)
 			SHA256_SCR(j);
 
-		for (j = 0; j < 8; j++)
-			wv[j] = ctx->h[j];
-
-		for (j = 0; j < 64; j++) {
-			t1 = wv[7] + SHA256_F2(wv[4]) + CH(wv[4], wv[5], wv[6])
-				+ sha256_k[j] + w[j];
-			t2 = SHA256_F1(wv[0]) + MAJ(wv[0], wv[1], wv[2]);
-			wv[7] = wv[6];
-			wv[6] = wv[5];
-			wv[5] = wv[4];
-			wv[4] = wv[3] + t1;
-			wv[3] = wv[2];
-			wv[2] = wv[1];
-			wv[1] = wv[0];
-			wv[0] = t1 + t2;
-		}
-
-		for (j = 0; j < 8; j++)
-			ctx->h[j] += wv[j];
+		a = ctx->h[0];
+		b = ctx->h[1];
+		c = ctx->h[2];
+		d = ctx->h[3];
+		e = ctx->h[4];
+		f = ctx->h[5];
+		g = ctx->h[6];
+		h = ctx->h[7];
+
+#ifdef CONFIG_SHA256_UNROLLED
+		SHA256_RND8(0);
+		SHA256_RND8(8);
+		SHA256_RND8(16);
+		SHA256_RND8(24);
+		SHA256_RND8(32);
+		SHA256_RND8(40);
+		SHA256_RND8(48);
+		SHA256_RND8(56);
+#else
+		for (j = 0; j < 64; j += 8)
+			SHA256_RND8(j);
+#endif
+
+		ctx->h[0] += a;
+		ctx->h[1] += b;
+		ctx->h[2] += c;
+		ctx->h[3] += d;
+		ctx->h[4] += e;
+		ctx->h[5] += f;
+		ctx->h[6] += g;
+		ctx->h[7] += h;
 	}
 }
 
 void SHA256_update(struct sha256_ctx *ctx, const uint8_t *data, uint32_t len)
 {
 	unsigned int block_nb;
-	unsigned int new_len, rem_len, tmp_len;
-	const uint8_t *shifted_data;
-
-	tmp_len = SHA256_BLOCK_SIZE - ctx->len;
-	rem_len = len < tmp_len ? len : tmp_len;
-
-	memcpy(&ctx->block[ctx->len], data, rem_len);
-
-	if (ctx->len + len < SHA256_BLOCK_SIZE) {
-		ctx->len += len;
-		return;
+	unsigned int n;
+
+	/* Fill up a partial block left over from last time first */
+	if (ctx->len) {
+		n = SHA256_BLOCK_SIZE - ctx->len;
+		if (n > len)
+			n = len;
+		memcpy(&ctx->block[ctx->len], data, n);
+		ctx->len += n;
+		data += n;
+		len -= n;
+
+		if (ctx->len < SHA256_BLOCK_SIZE)
+			return;
+
+		SHA256_transform(ctx, ctx->block, 1);
+		ctx->tot_len += SHA256_BLOCK_SIZE;
+		ctx->len = 0;
 	}
 
-	new_len = len - rem_len;
-	block_nb = new_len / SHA256_BLOCK_SIZE;
-
-	shifted_data = data + rem_len;
-
-	SHA256_transform(ctx, ctx->block, 1);
-	SHA256_transform(ctx, shifted_data, block_nb);
-
-	rem_len = new_len % SHA256_BLOCK_SIZE;
-
-	memcpy(ctx->block, &shifted_data[block_nb << 6], rem_len);
+	/* Hash whole blocks straight from the caller's buffer */
+	block_nb = len / SHA256_BLOCK_SIZE;
+	if (block_nb) {
+		SHA256_transform(ctx, data, block_nb);
+		n = block_nb * SHA256_BLOCK_SIZE;
+		ctx->tot_len += n;
+		data += n;
+		len -= n;
+	}
 
-	ctx->len = rem_len;
-	ctx->tot_len += (block_nb + 1) << 6;
+	/* Keep the rest for next time */
+	memcpy(ctx->block, data, len);
+	ctx->len = len;
 }
 
 uint8_t *SHA256_final(struct sha256_ctx *ctx)
@@ -7,59 +7,322 @@
 
 #include "common.h"
 #include "console.h"
+#include "host_command.h"
 #include "link_defs.h"
 #include "shared_mem.h"
 #include "system.h"
+#include "task.h"
 #include "util.h"
 
-static int buf_in_use;
+/*
+ * The shared memory buffer is carved into contiguous blocks, each starting
+ * with a header.  Acquiring takes the first free block which is big enough,
+ * splitting off the remainder if it's worth keeping; releasing merges the
+ * block with its free neighbours, so there are never two free blocks in a row
+ * and once everything is released the buffer is a single block again.
+ *
+ * There are only ever a handful of blocks, so walking them is cheap.
+ */
+struct shmem_block {
+	uint32_t size;		/* Size in bytes, including this header */
+	uint8_t in_use;		/* Non-zero if acquired */
+	uint8_t client;		/* Index into clients[], if acquired */
+	uint16_t reserved;
+};
+
+/* Block alignment; also the granularity of block sizes */
+#define SHMEM_ALIGN 8
+#define SHMEM_ROUNDUP(x) (((x) + SHMEM_ALIGN - 1) & ~(SHMEM_ALIGN - 1))
+
+/* Don't split off free blocks smaller than this, header included */
+#define SHMEM_MIN_SPLIT (sizeof(struct shmem_block) + 16)
+
+/*
+ * Usage is tracked per client, where a client is the code which called
+ * shared_mem_acquire().  Once the table fills up, further callers are lumped
+ * together in the last entry.
+ */
+#define SHMEM_MAX_CLIENTS 8
+
+struct shmem_client {
+	void *caller;		/* Return address of the acquire call */
+	int used;		/* Bytes currently held, not counting headers */
+	int max_used;		/* High-water mark of bytes held */
+};
+
+static struct mutex shmem_lock;
+static struct shmem_block *heap;	/* First block; NULL until first used */
+static uint8_t *heap_end;
+static int used;
 static int max_used;
+static struct shmem_client clients[SHMEM_MAX_CLIENTS];
+
+struct shmem_stats {
+	int free;		/* Bytes free, in all free blocks */
+	int largest_free;	/* Largest acquire which would succeed */
+	int blocks_used;
+	int blocks_free;
+};
+
+static uint8_t *heap_start(void)
+{
+	return (uint8_t *)SHMEM_ROUNDUP((uintptr_t)__shared_mem_buf);
+}
 
 int shared_mem_size(void)
 {
 	/*
 	 * Use all the RAM we can.  The shared memory buffer is the last thing
 	 * allocated from the start of RAM, so we can use everything up to the
-	 * jump data at the end of RAM.
+	 * jump data at the end of RAM, less one block header.
 	 */
-	return system_usable_ram_end() - (uintptr_t)__shared_mem_buf;
+	uintptr_t end = system_usable_ram_end() & ~(SHMEM_ALIGN - 1);
+
+	return end - (uintptr_t)heap_start() - sizeof(struct shmem_block);
+}
+
+/**
+ * Return the block following b, or NULL if b is the last block.
+ */
+static struct shmem_block *next_block(struct shmem_block *b)
+{
+	uint8_t *next = (uint8_t *)b + b->size;
+
+	return next < heap_end ? (struct shmem_block *)next : NULL;
+}
+
+/**
+ * Set up the heap as a single free block, on first use.
+ *
+ * Must be called with shmem_lock held.
+ */
+static void heap_init(void)
+{
+	if (heap)
+		return;
+
+	heap = (struct shmem_block *)heap_start();
+	heap->size = shared_mem_size() + sizeof(struct shmem_block);
+	heap->in_use = 0;
+	heap_end = (uint8_t *)heap + heap->size;
+}
+
+/**
+ * Return the clients[] index to account the caller against.
+ */
+static int client_index(void *caller)
+{
+	int i;
+
+	for (i = 0; i < SHMEM_MAX_CLIENTS - 1; i++) {
+		if (clients[i].caller == caller)
+			return i;
+		if (!clients[i].caller) {
+			clients[i].caller = caller;
+			return i;
+		}
+	}
+
+	return SHMEM_MAX_CLIENTS - 1;
 }
 
 int shared_mem_acquire(int size, char **dest_ptr)
 {
+	void *caller = __builtin_return_address(0);
+	struct shmem_block *b;
+	struct shmem_client *c;
+	uint32_t need;
+	int rv = EC_ERROR_BUSY;
+
 	if (size > shared_mem_size() || size <= 0)
 		return EC_ERROR_INVAL;
 
-	if (buf_in_use)
-		return EC_ERROR_BUSY;
+	need = SHMEM_ROUNDUP(size) + sizeof(struct shmem_block);
 
-	/*
-	 * We could guard buf_in_use with a mutex, but since shared memory is
-	 * currently only used by debug commands, that's overkill.
-	 */
+	mutex_lock(&shmem_lock);
+	heap_init();
 
-	buf_in_use = size;
-	*dest_ptr = __shared_mem_buf;
+	for (b = heap; b; b = next_block(b)) {
+		if (b->in_use || b->size < need)
+			continue;
 
-	if (max_used < size)
-		max_used = size;
+		if (b->size - need >= SHMEM_MIN_SPLIT) {
+			struct shmem_block *rest =
+				(struct shmem_block *)((uint8_t *)b + need);
 
-	return EC_SUCCESS;
+			rest->size = b->size - need;
+			rest->in_use = 0;
+			b->size = need;
+		}
+
+		b->in_use = 1;
+		b->client = client_index(caller);
+		size = b->size - sizeof(struct shmem_block);
+
+		used += size;
+		if (max_used < used)
+			max_used = used;
+
+		c = clients + b->client;
+		c->used += size;
+		if (c->max_used < c->used)
+			c->max_used = c->used;
+
+		*dest_ptr = (char *)(b + 1);
+		rv = EC_SUCCESS;
+		break;
+	}
+
+	mutex_unlock(&shmem_lock);
+	return rv;
 }
 
 void shared_mem_release(void *ptr)
 {
-	buf_in_use = 0;
+	struct shmem_block *b, *prev = NULL, *next;
+	int size;
+
+	if (!ptr)
+		return;
+
+	mutex_lock(&shmem_lock);
+
+	for (b = heap; b; prev = b, b = next_block(b)) {
+		if ((void *)(b + 1) != ptr)
+			continue;
+
+		/* Ignore double releases */
+		if (!b->in_use)
+			break;
+
+		size = b->size - sizeof(struct shmem_block);
+		used -= size;
+		clients[b->client].used -= size;
+		b->in_use = 0;
+
+		next = next_block(b);
+		if (next && !next->in_use)
+			b->size += next->size;
+		if (prev && !prev->in_use)
+			prev->size += b->size;
+		break;
+	}
+
+	mutex_unlock(&shmem_lock);
+}
+
+/**
+ * Gather free space stats.
+ *
+ * Must be called with shmem_lock held.
+ */
+static void get_stats(struct shmem_stats *s)
+{
+	struct shmem_block *b;
+
+	memset(s, 0, sizeof(*s));
+	heap_init();
+
+	for (b = heap; b; b = next_block(b)) {
+		int payload = b->size - sizeof(struct shmem_block);
+
+		if (b->in_use) {
+			s->blocks_used++;
+			continue;
+		}
+
+		s->blocks_free++;
+		s->free += payload;
+		if (s->largest_free < payload)
+			s->largest_free = payload;
+	}
+}
+
+int shared_mem_available(void)
+{
+	struct shmem_stats s;
+
+	mutex_lock(&shmem_lock);
+	get_stats(&s);
+	mutex_unlock(&shmem_lock);
+
+	return s.largest_free;
 }
 
+/*****************************************************************************/
+/* Console commands */
+
 static int command_shmem(int argc, char **argv)
 {
+	struct shmem_block *b;
+	struct shmem_stats s;
+	int i;
+
+	mutex_lock(&shmem_lock);
+	get_stats(&s);
+
 	ccprintf("Size:%6d\n", shared_mem_size());
-	ccprintf("Used:%6d\n", buf_in_use);
+	ccprintf("Used:%6d in %d blocks\n", used, s.blocks_used);
 	ccprintf("Max: %6d\n", max_used);
+	ccprintf("Free:%6d in %d blocks, largest %d (%d%% fragmented)\n",
+		 s.free, s.blocks_free, s.largest_free,
+		 s.free ? 100 - s.largest_free * 100 / s.free : 0);
+
+	ccputs("Blocks:\n");
+	for (b = heap; b; b = next_block(b)) {
+		ccprintf("  %p %6d ", b + 1,
+			 b->size - sizeof(struct shmem_block));
+		if (b->in_use)
+			ccprintf("client %d\n", b->client);
+		else
+			ccputs("free\n");
+	}
+
+	ccputs("Clients:\n");
+	for (i = 0; i < SHMEM_MAX_CLIENTS; i++) {
+		const struct shmem_client *c = clients + i;
+
+		if (!c->max_used)
+			continue;
+		if (c->caller)
+			ccprintf("  %d %p", i, c->caller);
+		else
+			ccprintf("  %d others", i);
+		ccprintf(" used %d max %d\n", c->used, c->max_used);
+	}
+
+	mutex_unlock(&shmem_lock);
 	return EC_SUCCESS;
 }
 DECLARE_CONSOLE_COMMAND(shmem, command_shmem,
 			NULL,
 			"Print shared memory stats",
 			NULL);
+
+/*****************************************************************************/
+/* Host commands */
+
+static int host_command_shared_mem_info(struct host_cmd_handler_args *args)
+{
+	struct ec_response_shared_mem_info *r = args->response;
+	struct shmem_stats s;
+
+	mutex_lock(&shmem_lock);
+	get_stats(&s);
+
+	r->size = shared_mem_size();
+	r->used = used;
+	r->max_used = max_used;
+	r->free = s.free;
+	r->largest_free = s.largest_free;
+	r->blocks_used = s.blocks_used;
+	r->blocks_free = s.blocks_free;
+
+	mutex_unlock(&shmem_lock);
+
+	args->response_size = sizeof(*r);
+	return EC_RES_SUCCESS;
+}
+DECLARE_HOST_COMMAND(EC_CMD_SHARED_MEM_INFO,
+		     host_command_shared_mem_info,
+		     EC_VER_MASK(0));
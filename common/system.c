@@ -292,7 +292,7 @@ test_mockable enum system_image_copy_t system_get_image_copy(void)
 	return SYSTEM_IMAGE_UNKNOWN;
 }
 
-int system_get_image_used(enum system_image_copy_t copy)
+test_mockable int system_get_image_used(enum system_image_copy_t copy)
 {
 	const uint8_t *image;
 	int size = 0;
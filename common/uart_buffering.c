@@ -27,6 +27,9 @@
 #define TX_BUF_DIFF(i, j) (((i) - (j)) & (CONFIG_UART_TX_BUF_SIZE - 1))
 #define RX_BUF_DIFF(i, j) (((i) - (j)) & (CONFIG_UART_RX_BUF_SIZE - 1))
 
+/* Most bytes __tx_write() copies at a time, with interrupts disabled */
+#define TX_WRITE_CHUNK 16
+
 /* ASCII control character; for example, CTRL('C') = ^C */
 #define CTRL(c) ((c) - '@')
 
@@ -49,6 +52,39 @@ static int tx_snapshot_head;
 static int tx_snapshot_tail;
 static int uart_suspended;
 
+/**
+ * Reserve contiguous space at the head of the transmit buffer.
+ *
+ * Nothing is transmitted until the space is committed with tx_buf_commit().
+ *
+ * @param len		Returns the number of bytes which may be written; this
+ *			stops at the end of the buffer or one byte short of the
+ *			tail, whichever comes first.  May be 0 if full.
+ * @return Pointer to the reserved space.
+ */
+static char *tx_buf_reserve(int *len)
+{
+	int head = tx_buf_head;
+	int tail = tx_buf_tail;
+
+	if (tail > head)
+		*len = tail - head - 1;
+	else
+		*len = CONFIG_UART_TX_BUF_SIZE - head - (tail == 0);
+
+	return (char *)tx_buf + head;
+}
+
+/**
+ * Commit bytes written to space from tx_buf_reserve().
+ *
+ * @param len		Number of bytes to commit
+ */
+static void tx_buf_commit(int len)
+{
+	tx_buf_head = (tx_buf_head + len) & (CONFIG_UART_TX_BUF_SIZE - 1);
+}
+
 /**
  * Put a single character into the transmit buffer.
  *
@@ -75,6 +111,65 @@ static int __tx_char(void *context, int c)
 	return 0;
 }
 
+/**
+ * Put a run of characters into the transmit buffer.
+ *
+ * Text between newlines is copied a contiguous chunk at a time; only the
+ * newlines themselves go through __tx_char() for CRLF translation.  Each
+ * chunk is reserved, copied and committed with interrupts disabled, so a
+ * task or interrupt which preempts us can't write into the same space.
+ * Chunks are at most TX_WRITE_CHUNK bytes to keep that window short.  Does
+ * not enable the transmit interrupt.
+ *
+ * @param out		Characters to write
+ * @param len		Number of characters
+ * @return The number of characters which were dropped; 0 if all were sent.
+ */
+static int __tx_write(const char *out, int len)
+{
+	char *dest;
+	int room, n, irq;
+
+	while (len) {
+		irq = interrupt_disable_save();
+
+		if (*out == '\n') {
+			n = __tx_char(NULL, '\n') ? 0 : 1;
+		} else {
+			dest = tx_buf_reserve(&room);
+			room = MIN(room, TX_WRITE_CHUNK);
+
+			/* Copy up to the next newline, or as much as fits */
+			for (n = 0; n < len && n < room && out[n] != '\n'; n++)
+				;
+			memcpy(dest, out, n);
+			tx_buf_commit(n);
+		}
+
+		interrupt_restore(irq);
+
+		if (!n)
+			break;
+		out += n;
+		len -= n;
+	}
+
+	return len;
+}
+
+/**
+ * Put a run of characters from printf() into the transmit buffer.
+ *
+ * @param context	Context; ignored.
+ * @param s		Characters to write
+ * @param len		Number of characters
+ * @return 0 if the characters were transmitted, non-zero if any were dropped.
+ */
+static int __tx_str(void *context, const char *s, int len)
+{
+	return __tx_write(s, len);
+}
+
 #ifdef CONFIG_UART_TX_DMA
 
 /**
@@ -123,15 +218,44 @@ void uart_process_output(void)
 
 #else /* !CONFIG_UART_TX_DMA */
 
+/**
+ * Copy characters to the transmit FIFO until it is full.
+ *
+ * Does not block, since it only writes while uart_tx_ready().
+ *
+ * @param src		Characters to send
+ * @param len		Number of characters
+ * @return The number of characters written to the FIFO.
+ */
+static int uart_write_fifo(const char *src, int len)
+{
+	int i;
+
+	for (i = 0; i < len && uart_tx_ready(); i++)
+		uart_write_char(src[i]);
+
+	return i;
+}
+
 void uart_process_output(void)
 {
 	if (uart_suspended)
 		return;
 
-	/* Copy output from buffer until TX fifo full or output buffer empty */
-	while (uart_tx_ready() && (tx_buf_head != tx_buf_tail)) {
-		uart_write_char(tx_buf[tx_buf_tail]);
-		tx_buf_tail = TX_BUF_NEXT(tx_buf_tail);
+	/*
+	 * Copy output from buffer until TX fifo full or output buffer empty.
+	 * Hand the FIFO the largest contiguous block each time; there are at
+	 * most two blocks unless more output arrives meanwhile.
+	 */
+	while (tx_buf_head != tx_buf_tail) {
+		int head = tx_buf_head;
+		int tail = tx_buf_tail;
+		int len = (head > tail ? head : CONFIG_UART_TX_BUF_SIZE) - tail;
+		int sent = uart_write_fifo((const char *)tx_buf + tail, len);
+
+		tx_buf_tail = (tail + sent) & (CONFIG_UART_TX_BUF_SIZE - 1);
+		if (sent < len)
+			break;
 	}
 
 	/* If output buffer is empty, disable transmit interrupt */
@@ -229,24 +353,27 @@ int uart_putc(int c)
 	return rv ? EC_ERROR_OVERFLOW : EC_SUCCESS;
 }
 
-int uart_puts(const char *outstr)
+int uart_put(const char *out, int len)
 {
 	/* Put all characters in the output buffer */
-	while (*outstr) {
-		if (__tx_char(NULL, *outstr++) != 0)
-			break;
-	}
+	int rv = __tx_write(out, len);
 
 	if (!uart_suspended)
 		uart_tx_start();
 
 	/* Successful if we consumed all output */
-	return *outstr ? EC_ERROR_OVERFLOW : EC_SUCCESS;
+	return rv ? EC_ERROR_OVERFLOW : EC_SUCCESS;
+}
+
+int uart_puts(const char *outstr)
+{
+	return uart_put(outstr, strlen(outstr));
 }
 
 int uart_vprintf(const char *format, va_list args)
 {
-	int rv = vfnprintf(__tx_char, NULL, format, args);
+	/* Every run, even a single character, is reserved and committed */
+	int rv = vfnprintf_str(NULL, __tx_str, NULL, format, args);
 
 	if (!uart_suspended)
 		uart_tx_start();
@@ -7,14 +7,31 @@
 
 #include "util.h"
 
+/* Non-zero if any byte of the word is zero */
+#define HAS_ZERO_BYTE(w) (((w) - 0x01010101) & ~(w) & 0x80808080)
+
 int strlen(const char *s)
 {
-	int len = 0;
+	const char *p = s;
+	const uint32_t *w;
+
+	/* Check bytes until word-aligned */
+	for (; (uintptr_t)p & 3; p++) {
+		if (!*p)
+			return p - s;
+	}
 
-	while (*s++)
-		len++;
+	/*
+	 * Then a word at a time until one holds the terminator.  Reading the
+	 * rest of the aligned word holding the terminator is harmless.
+	 */
+	for (w = (const uint32_t *)p; !HAS_ZERO_BYTE(*w); w++)
+		;
+
+	for (p = (const char *)w; *p; p++)
+		;
 
-	return len;
+	return p - s;
 }
 
 
@@ -50,6 +67,8 @@ int strcasecmp(const char *s1, const char *s2)
 {
 	int diff;
 	do {
+		if (*s1 == *s2)
+			continue;
 		diff = tolower(*s1) - tolower(*s2);
 		if (diff)
 			return diff;
@@ -66,6 +85,8 @@ int strncasecmp(const char *s1, const char *s2, int size)
 		return 0;
 
 	do {
+		if (*s1 == *s2)
+			continue;
 		diff = tolower(*s1) - tolower(*s2);
 		if (diff)
 			return diff;
@@ -159,8 +180,25 @@ int memcmp(const void *s1, const void *s2, int len)
 {
 	const char *sa = s1;
 	const char *sb = s2;
-
 	int diff = 0;
+
+	/*
+	 * If both have the same alignment, skip over matching words.  The
+	 * byte loop then finds the first difference, if any.
+	 */
+	if (!(((uintptr_t)sa ^ (uintptr_t)sb) & 3)) {
+		for (; len > 0 && ((uintptr_t)sa & 3); len--) {
+			diff = *(sa++) - *(sb++);
+			if (diff)
+				return diff;
+		}
+
+		for (; len >= 4; len -= 4, sa += 4, sb += 4) {
+			if (*(const uint32_t *)sa != *(const uint32_t *)sb)
+				break;
+		}
+	}
+
 	while (len-- > 0) {
 		diff = *(sa++) - *(sb++);
 		if (diff)
@@ -173,41 +211,63 @@ int memcmp(const void *s1, const void *s2, int len)
 
 void *memcpy(void *dest, const void *src, int len)
 {
-	char *d = (char *)dest;
-	const char *s = (const char *)src;
+	uint8_t *d = (uint8_t *)dest;
+	const uint8_t *s = (const uint8_t *)src;
+	uint8_t * const tail = d + len;
 	uint32_t *dw;
 	const uint32_t *sw;
-	char *head;
-	char * const tail = (char *)dest + len;
-	/* Set 'body' to the last word boundary */
-	uint32_t * const body = (uint32_t *)((uintptr_t)tail & ~3);
+	uint32_t w, next;
+	int words, shift, n;
 
-	if (((uintptr_t)dest & 3) != ((uintptr_t)src & 3)) {
-		/* Misaligned. no body, no tail. */
-		head = tail;
-	} else {
-		/* Aligned */
-		if ((uintptr_t)tail < (((uintptr_t)d + 3) & ~3))
-			/* len is shorter than the first word boundary */
-			head = tail;
-		else
-			/* Set 'head' to the first word boundary */
-			head = (char *)(((uintptr_t)d + 3) & ~3);
+	/* Not worth aligning short copies */
+	if (len < 8) {
+		while (d < tail)
+			*(d++) = *(s++);
+		return dest;
 	}
 
-	/* Copy head */
-	while (d < head)
+	/* Copy head until the destination is word-aligned */
+	while ((uintptr_t)d & 3)
 		*(d++) = *(s++);
 
-	/* Copy body */
 	dw = (uint32_t *)d;
-	sw = (uint32_t *)s;
-	while (dw < body)
-		*(dw++) = *(sw++);
+	words = (tail - d) / 4;
+	shift = ((uintptr_t)s & 3) * 8;
+
+	if (!shift) {
+		/* Copy body, unrolled so the compiler can use LDM/STM */
+		sw = (const uint32_t *)s;
+		for (n = words; n >= 4; n -= 4) {
+			uint32_t w0 = sw[0], w1 = sw[1], w2 = sw[2], w3 = sw[3];
+
+			dw[0] = w0;
+			dw[1] = w1;
+			dw[2] = w2;
+			dw[3] = w3;
+			dw += 4;
+			sw += 4;
+		}
+		while (n--)
+			*(dw++) = *(sw++);
+	} else {
+		/*
+		 * Source is misaligned relative to the destination.  Load
+		 * aligned source words and merge each adjacent pair into a
+		 * destination word (little-endian).  Every word loaded holds at
+		 * least one byte being copied.
+		 */
+		sw = (const uint32_t *)(s - shift / 8);
+		w = *(sw++);
+		for (n = words; n > 0; n--) {
+			next = *(sw++);
+			*(dw++) = (w >> shift) | (next << (32 - shift));
+			w = next;
+		}
+	}
 
 	/* Copy tail */
-	d = (char *)dw;
-	s = (const char *)sw;
+	d = (uint8_t *)dw;
+	s += words * 4;
 	while (d < tail)
 		*(d++) = *(s++);
 
@@ -215,6 +275,81 @@ void *memcpy(void *dest, const void *src, int len)
 }
 
 
+/* Pairwise sum of the bytes of a word, as two 16-bit lanes */
+#define BYTE_LANES(w) (((w) & 0x00ff00ff) + (((w) >> 8) & 0x00ff00ff))
+
+int memcpy_sum(void *dest, const void *src, int len)
+{
+	uint8_t *d = (uint8_t *)dest;
+	const uint8_t *s = (const uint8_t *)src;
+	const uint8_t * const tail = s + len;
+	const uint32_t *sw;
+	uint32_t *dw;
+	uint32_t lanes, w;
+	int sum = 0;
+	int words, n;
+
+	/* Sum (and copy) head until the source is word-aligned */
+	while (s < tail && ((uintptr_t)s & 3)) {
+		if (d)
+			*(d++) = *s;
+		sum += *(s++);
+	}
+
+	/*
+	 * Sum the body a word at a time, keeping four byte sums in two 16-bit
+	 * lanes.  Each word adds at most 2 * 0xff to a lane, so fold the lanes
+	 * into the result every 128 words before they can overflow.
+	 */
+	sw = (const uint32_t *)s;
+	words = (tail - s) / 4;
+	while (words > 0) {
+		n = MIN(words, 128);
+		words -= n;
+		lanes = 0;
+
+		if (!d) {
+			while (n--) {
+				w = *(sw++);
+				lanes += BYTE_LANES(w);
+			}
+		} else if (!((uintptr_t)d & 3)) {
+			dw = (uint32_t *)d;
+			while (n--) {
+				w = *(sw++);
+				*(dw++) = w;
+				lanes += BYTE_LANES(w);
+			}
+			d = (uint8_t *)dw;
+		} else {
+			/* Destination misaligned; word loads, byte stores */
+			while (n--) {
+				s = (const uint8_t *)sw;
+				w = *(sw++);
+				d[0] = s[0];
+				d[1] = s[1];
+				d[2] = s[2];
+				d[3] = s[3];
+				d += 4;
+				lanes += BYTE_LANES(w);
+			}
+		}
+
+		sum += (lanes & 0xffff) + (lanes >> 16);
+	}
+
+	/* Sum (and copy) tail */
+	s = (const uint8_t *)sw;
+	while (s < tail) {
+		if (d)
+			*(d++) = *s;
+		sum += *(s++);
+	}
+
+	return sum;
+}
+
+
 void *memset(void *dest, int c, int len)
 {
 	char *d = (char *)dest;
@@ -239,8 +374,15 @@ void *memset(void *dest, int c, int len)
 	while (d < head)
 		*(d++) = c;
 
-	/* Copy body */
+	/* Copy body, unrolled so the compiler can use STM */
 	dw = (uint32_t *)d;
+	while (dw + 4 <= body) {
+		dw[0] = cccc;
+		dw[1] = cccc;
+		dw[2] = cccc;
+		dw[3] = cccc;
+		dw += 4;
+	}
 	while (dw < body)
 		*(dw++) = cccc;
 
@@ -7,6 +7,7 @@
 
 #include "common.h"
 #include "console.h"
+#include "flash.h"
 #include "hooks.h"
 #include "host_command.h"
 #include "sha256.h"
@@ -14,7 +15,6 @@
 #include "task.h"
 #include "timer.h"
 #include "util.h"
-#include "watchdog.h"
 
 /* Console output macros */
 #define CPUTS(outstr) cputs(CC_VBOOT, outstr)
@@ -29,7 +29,8 @@ struct vboot_hash_tag {
 #define VBOOT_HASH_SYSJUMP_TAG 0x5648 /* "VH" */
 #define VBOOT_HASH_SYSJUMP_VERSION 1
 
-#define CHUNK_SIZE 1024       /* Bytes to hash per deferred call */
+#define CHUNK_SIZE 256        /* Bytes to hash between time checks */
+#define WORK_SLICE_US 1000    /* Time to spend hashing per deferred call */
 #define WORK_INTERVAL_US 100  /* Delay between deferred calls */
 
 static uint32_t data_offset;
@@ -38,9 +39,24 @@ static uint32_t curr_pos;
 static const uint8_t *hash;   /* Hash, or NULL if not valid */
 static int want_abort;
 static int in_progress;
+static int host_waiting;      /* Host is blocked until the hash is done */
+static int cacheable;         /* Hash of the RW image, so may be cached */
+#ifdef CONFIG_VBOOT_HASH_CACHE
+static uint32_t generation;   /* Flash write generation at start of hash */
+#endif
+static timestamp_t start_time;
+static uint32_t elapsed_us;   /* Time the last hash took */
 
 static struct sha256_ctx ctx;
 
+#ifdef CONFIG_VBOOT_HASH_CACHE
+/* Hash read back from the cache at boot */
+static uint8_t cached_hash[SHA256_DIGEST_SIZE];
+#endif
+
+/* For EC_CMD_FLASH_HASH; host commands run one at a time */
+static struct sha256_ctx block_ctx;
+
 /**
  * Abort hash currently in progress, and invalidate any completed hash.
  */
@@ -52,6 +68,7 @@ static void vboot_hash_abort(void)
 		CPRINTS("hash abort");
 		want_abort = 0;
 		data_size = 0;
+		curr_pos = 0;
 		hash = NULL;
 	}
 }
@@ -61,6 +78,7 @@ static void vboot_hash_abort(void)
  */
 static void vboot_hash_next_chunk(void)
 {
+	uint64_t deadline;
 	int size;
 
 	/* Handle abort */
@@ -70,17 +88,42 @@ static void vboot_hash_next_chunk(void)
 		return;
 	}
 
-	/* Compute the next chunk of hash */
-	size = MIN(CHUNK_SIZE, data_size - curr_pos);
-	SHA256_update(&ctx, (const uint8_t *)(CONFIG_FLASH_BASE +
-					      data_offset + curr_pos), size);
+	/*
+	 * Hash until this slice's time is up, so how long the hook task is
+	 * kept busy doesn't depend on how fast the chip hashes.
+	 */
+	deadline = get_time().val + WORK_SLICE_US;
+	do {
+		size = MIN(CHUNK_SIZE, data_size - curr_pos);
+		SHA256_update(&ctx, (const uint8_t *)(CONFIG_FLASH_BASE +
+						      data_offset + curr_pos),
+			      size);
+		curr_pos += size;
+	} while (curr_pos < data_size && get_time().val < deadline);
 
-	curr_pos += size;
 	if (curr_pos >= data_size) {
 		/* Store the final hash */
 		hash = SHA256_final(&ctx);
+		elapsed_us = get_time().val - start_time.val;
 		CPRINTS("hash done %.*h", SHA256_DIGEST_SIZE, hash);
 
+#ifdef CONFIG_VBOOT_HASH_CACHE
+		/*
+		 * Remember it for next boot.  Failing just means hashing
+		 * again then, so it's not worth more than a message.  Hold
+		 * the cache lock so a flash write can't abort the hash
+		 * between checking want_abort and caching the hash.
+		 */
+		if (cacheable) {
+			flash_lock_hash_cache(1);
+			if (!want_abort &&
+			    flash_set_hash_cache(data_offset, data_size, hash,
+						 generation))
+				CPRINTS("hash not cached");
+			flash_lock_hash_cache(0);
+		}
+#endif
+
 		in_progress = 0;
 
 		/* Handle receiving abort during finalize */
@@ -90,8 +133,12 @@ static void vboot_hash_next_chunk(void)
 		return;
 	}
 
-	/* If we're still here, more work to do; come back later */
-	hook_call_deferred(vboot_hash_next_chunk, WORK_INTERVAL_US);
+	/*
+	 * If we're still here, more work to do; come back later, or as soon
+	 * as possible if the host is waiting for it.
+	 */
+	hook_call_deferred(vboot_hash_next_chunk,
+			   host_waiting ? 0 : WORK_INTERVAL_US);
 }
 DECLARE_DEFERRED(vboot_hash_next_chunk);
 
@@ -124,6 +171,16 @@ static int vboot_hash_start(uint32_t offset, uint32_t size,
 	hash = NULL;
 	want_abort = 0;
 	in_progress = 1;
+	/*
+	 * Only the RW image is worth caching, since that's what's hashed at
+	 * boot; caching other hashes would just wear out the pstate bank.
+	 */
+	cacheable = !nonce_size && offset == CONFIG_FW_RW_OFF &&
+		size == system_get_image_used(SYSTEM_IMAGE_RW);
+#ifdef CONFIG_VBOOT_HASH_CACHE
+	generation = flash_get_write_generation();
+#endif
+	start_time = get_time();
 
 	/* Restart the hash computation */
 	CPRINTS("hash start 0x%08x 0x%08x", offset, size);
@@ -142,8 +199,11 @@ int vboot_hash_invalidate(int offset, int size)
 	if (offset < 0 || size <= 0 || offset + size < 0)
 		return 0;
 
-	/* Don't invalidate if hash is already invalid */
-	if (!hash)
+	/*
+	 * Don't invalidate if hash is already invalid.  A hash still in
+	 * progress may already have read the old data, so abort that too.
+	 */
+	if (!hash && !in_progress)
 		return 0;
 
 	/* No overlap if passed region is off either end of hashed region */
@@ -159,6 +219,27 @@ int vboot_hash_invalidate(int offset, int size)
 /*****************************************************************************/
 /* Hooks */
 
+#ifdef CONFIG_VBOOT_HASH_CACHE
+/**
+ * Use the cached hash of <size> bytes of data at flash offset <offset>, if
+ * there is one.
+ *
+ * Returns non-zero if the cached hash was used.
+ */
+static int vboot_hash_from_cache(uint32_t offset, uint32_t size)
+{
+	if (flash_get_hash_cache(offset, size, cached_hash))
+		return 0;
+
+	CPRINTS("hash cached");
+	hash = cached_hash;
+	data_offset = offset;
+	data_size = size;
+	curr_pos = data_size;
+	return 1;
+}
+#endif
+
 static void vboot_hash_init(void)
 {
 #ifdef CONFIG_SAVE_VBOOT_HASH
@@ -174,13 +255,20 @@ static void vboot_hash_init(void)
 		hash = tag->hash;
 		data_offset = tag->offset;
 		data_size = tag->size;
+		curr_pos = data_size;
 	} else
 #endif
 	{
+		uint32_t rw_size = system_get_image_used(SYSTEM_IMAGE_RW);
+
+#ifdef CONFIG_VBOOT_HASH_CACHE
+		/* Nothing to do if RW hasn't changed since it was hashed */
+		if (vboot_hash_from_cache(CONFIG_FW_RW_OFF, rw_size))
+			return;
+#endif
+
 		/* Start computing the hash of RW firmware */
-		vboot_hash_start(CONFIG_FW_RW_OFF,
-				 system_get_image_used(SYSTEM_IMAGE_RW),
-				 NULL, 0);
+		vboot_hash_start(CONFIG_FW_RW_OFF, rw_size, NULL, 0);
 	}
 }
 DECLARE_HOOK(HOOK_INIT, vboot_hash_init, HOOK_PRIO_DEFAULT);
@@ -223,7 +311,7 @@ static int command_hash(int argc, char **argv)
 		if (want_abort)
 			ccprintf("(aborting)\n");
 		else if (in_progress)
-			ccprintf("(in progress)\n");
+			ccprintf("(in progress, %d bytes)\n", curr_pos);
 		else if (hash)
 			ccprintf("%.*h\n", SHA256_DIGEST_SIZE, hash);
 		else
@@ -278,12 +366,21 @@ DECLARE_CONSOLE_COMMAND(hash, command_hash,
 /****************************************************************************/
 /* Host commands */
 
-/* Fill in the response with the current hash status */
-static void fill_response(struct ec_response_vboot_hash *r)
+/*
+ * Fill in the response with the current hash status.
+ *
+ * Returns the response size for the command version.
+ */
+static int fill_response(struct ec_response_vboot_hash *r, int version)
 {
-	if (in_progress)
+	struct ec_response_vboot_hash_1 *r1 =
+		(struct ec_response_vboot_hash_1 *)r;
+
+	if (in_progress) {
 		r->status = EC_VBOOT_HASH_STATUS_BUSY;
-	else if (hash && !want_abort) {
+		r->offset = data_offset;
+		r->size = data_size;
+	} else if (hash && !want_abort) {
 		r->status = EC_VBOOT_HASH_STATUS_DONE;
 		r->hash_type = EC_VBOOT_HASH_TYPE_SHA256;
 		r->digest_size = SHA256_DIGEST_SIZE;
@@ -294,6 +391,17 @@ static void fill_response(struct ec_response_vboot_hash *r)
 		memcpy(r->hash_digest, hash, SHA256_DIGEST_SIZE);
 	} else
 		r->status = EC_VBOOT_HASH_STATUS_NONE;
+
+	if (version < 1)
+		return sizeof(*r);
+
+	r1->bytes_hashed = curr_pos;
+	if (in_progress)
+		r1->elapsed_us = get_time().val - start_time.val;
+	else
+		r1->elapsed_us = hash ? elapsed_us : 0;
+
+	return sizeof(*r1);
 }
 
 /**
@@ -340,8 +448,7 @@ static int host_command_vboot_hash(struct host_cmd_handler_args *args)
 
 	switch (p->cmd) {
 	case EC_VBOOT_HASH_GET:
-		fill_response(r);
-		args->response_size = sizeof(*r);
+		args->response_size = fill_response(r, args->version);
 		return EC_RES_SUCCESS;
 
 	case EC_VBOOT_HASH_ABORT:
@@ -354,13 +461,18 @@ static int host_command_vboot_hash(struct host_cmd_handler_args *args)
 		if (rv != EC_RES_SUCCESS)
 			return rv;
 
-		/* Wait for hash to finish if command is RECALC */
-		if (p->cmd == EC_VBOOT_HASH_RECALC)
+		/*
+		 * Wait for hash to finish if command is RECALC.  Since the
+		 * host is blocked, hash without gaps between slices.
+		 */
+		if (p->cmd == EC_VBOOT_HASH_RECALC) {
+			host_waiting = 1;
 			while (in_progress)
 				usleep(1000);
+			host_waiting = 0;
+		}
 
-		fill_response(r);
-		args->response_size = sizeof(*r);
+		args->response_size = fill_response(r, args->version);
 		return EC_RES_SUCCESS;
 
 	default:
@@ -369,4 +481,51 @@ static int host_command_vboot_hash(struct host_cmd_handler_args *args)
 }
 DECLARE_HOST_COMMAND(EC_CMD_VBOOT_HASH,
 		     host_command_vboot_hash,
+		     EC_VER_MASK(0) | EC_VER_MASK(1));
+
+static int host_command_flash_hash(struct host_cmd_handler_args *args)
+{
+	const struct ec_params_flash_hash *p = args->params;
+	uint8_t *out = args->response;
+	uint32_t offset, size, total = 0;
+	int i;
+
+	if (args->params_size < sizeof(*p) ||
+	    args->params_size < sizeof(*p) + p->count * sizeof(p->block[0]))
+		return EC_RES_INVALID_PARAM;
+	if (p->hash_type != EC_VBOOT_HASH_TYPE_SHA256)
+		return EC_RES_INVALID_PARAM;
+	if (p->count * SHA256_DIGEST_SIZE > args->response_max)
+		return EC_RES_RESPONSE_TOO_BIG;
+
+	for (i = 0; i < p->count; i++) {
+		offset = p->block[i].offset;
+		size = p->block[i].size;
+
+		/* Same check as vboot_hash_start() */
+		if (offset > CONFIG_FLASH_SIZE || size > CONFIG_FLASH_SIZE ||
+		    offset + size > CONFIG_FLASH_SIZE)
+			return EC_RES_INVALID_PARAM;
+
+		/* Keep the whole command short; this blocks the host task */
+		total += size;
+		if (total > EC_FLASH_HASH_MAX_BYTES)
+			return EC_RES_INVALID_PARAM;
+	}
+
+	for (i = 0; i < p->count; i++) {
+		SHA256_init(&block_ctx);
+		SHA256_update(&block_ctx, (const uint8_t *)
+			      (CONFIG_FLASH_BASE + p->block[i].offset),
+			      p->block[i].size);
+
+		memcpy(out + i * SHA256_DIGEST_SIZE, SHA256_final(&block_ctx),
+		       SHA256_DIGEST_SIZE);
+	}
+
+	args->response_size = p->count * SHA256_DIGEST_SIZE;
+	return EC_RES_SUCCESS;
+}
+DECLARE_HOST_COMMAND(EC_CMD_FLASH_HASH,
+		     host_command_flash_hash,
 		     EC_VER_MASK(0));
@@ -159,6 +159,23 @@ void interrupt_enable(void)
 	asm("cpsie i");
 }
 
+int interrupt_disable_save(void)
+{
+	uint32_t primask;
+
+	asm volatile("mrs %0, primask\n"
+		     "cpsid i" : "=r"(primask) : : "memory");
+
+	/* PRIMASK is set if interrupts were already disabled */
+	return !(primask & 1);
+}
+
+void interrupt_restore(int state)
+{
+	if (state)
+		interrupt_enable();
+}
+
 inline int in_interrupt_context(void)
 {
 	int ret;
@@ -115,6 +115,31 @@ void interrupt_enable(void)
 	pthread_mutex_unlock(&interrupt_lock);
 }
 
+int interrupt_disable_save(void)
+{
+	int state;
+
+	/*
+	 * Emulated interrupts don't nest; task_trigger_test_interrupt() holds
+	 * the lock while the ISR runs, so there's nothing more to disable.
+	 */
+	if (in_interrupt)
+		return 0;
+
+	pthread_mutex_lock(&interrupt_lock);
+	state = !interrupt_disabled;
+	interrupt_disabled = 1;
+	pthread_mutex_unlock(&interrupt_lock);
+
+	return state;
+}
+
+void interrupt_restore(int state)
+{
+	if (state)
+		interrupt_enable();
+}
+
 static void _task_execute_isr(int sig)
 {
 	in_interrupt = 1;
@@ -26,6 +26,18 @@
 static timestamp_t boot_time;
 static int time_set;
 
+#ifdef TEST_VIRTUAL_TIME
+/*
+ * For tests in test-list-host-virtual-time in test/build.mk, or when building
+ * with TEST_VIRTUAL_TIME=y, time doesn't follow the wall clock.  It only
+ * moves when the scheduler fast-forwards to the next wake-up, when udelay()
+ * is called, or by a microsecond each time a task reads it, so loops polling
+ * the clock still finish.  Runs then take no longer than the work they do and
+ * don't depend on machine load.
+ */
+static uint64_t virtual_time;
+#endif
+
 void usleep(unsigned us)
 {
 	if (!task_start_called()) {
@@ -41,11 +53,22 @@ void usleep(unsigned us)
 
 timestamp_t _get_time(void)
 {
-	struct timespec ts;
 	timestamp_t ret;
+#ifdef TEST_VIRTUAL_TIME
+	/*
+	 * The interrupt generator runs alongside the tasks, so its polling
+	 * mustn't move the clock.
+	 */
+	if (task_get_current() == TASK_ID_INT_GEN)
+		ret.val = __sync_add_and_fetch(&virtual_time, 0);
+	else
+		ret.val = __sync_add_and_fetch(&virtual_time, 1);
+#else
+	struct timespec ts;
 	clock_gettime(CLOCK_MONOTONIC, &ts);
 	ret.val = (1000000000 * (uint64_t)ts.tv_sec + ts.tv_nsec) *
 		  TEST_TIME_SCALE / 1000;
+#endif
 	return ret;
 }
 
@@ -65,16 +88,22 @@ void force_time(timestamp_t ts)
 
 void udelay(unsigned us)
 {
+#ifndef TEST_VIRTUAL_TIME
 	timestamp_t deadline;
+#endif
 
 	if (!in_interrupt_context() && task_get_current() == TASK_ID_INT_GEN) {
 		interrupt_generator_udelay(us);
 		return;
 	}
 
+#ifdef TEST_VIRTUAL_TIME
+	__sync_add_and_fetch(&virtual_time, us);
+#else
 	deadline.val = get_time().val + us;
 	while (get_time().val < deadline.val)
 		;
+#endif
 }
 
 int timestamp_expired(timestamp_t deadline, const timestamp_t *now)
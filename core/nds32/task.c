@@ -163,6 +163,23 @@ void interrupt_enable(void)
 	asm volatile ("setgie.e");
 }
 
+int interrupt_disable_save(void)
+{
+	uint32_t psw;
+
+	/* GIE is bit 0 of PSW */
+	asm volatile ("mfsr %0, $PSW" : "=r"(psw));
+	interrupt_disable();
+
+	return psw & 1;
+}
+
+void interrupt_restore(int state)
+{
+	if (state)
+		interrupt_enable();
+}
+
 inline int in_interrupt_context(void)
 {
 	/* check INTL (Interrupt Stack Level) bits */
@@ -27,6 +27,14 @@
 #define CONCAT3(w, x, y) CONCAT_STAGE_1(w, x, y, )
 #define CONCAT4(w, x, y, z) CONCAT_STAGE_1(w, x, y, z)
 
+/*
+ * Macros to turn a token into a string.  As with CONCAT, the extra level of
+ * nesting makes the preprocessor expand the token first, so STRINGIFY(FOO)
+ * above would give "1" rather than "FOO".
+ */
+#define STRINGIFY0(name)  #name
+#define STRINGIFY(name)  STRINGIFY0(name)
+
 /* Macros to access registers */
 #define REG32(addr) (*(volatile uint32_t *)(addr))
 #define REG16(addr) (*(volatile uint16_t *)(addr))
@@ -333,6 +333,17 @@
  */
 #define CONFIG_CONSOLE_HISTORY 8
 
+/*
+ * Support deferred console output.  cprints_deferred() queues the format
+ * pointer, timestamp and arguments as a binary record, and the hook task
+ * formats it later, keeping formatting out of interrupts and high-priority
+ * tasks.  Without this, cprints_deferred() is just cprints().
+ */
+#undef CONFIG_CONSOLE_DEFERRED
+
+/* Number of deferred output records buffered; must be a power of two */
+#define CONFIG_CONSOLE_DEFERRED_RECORDS 16
+
 /* Max length of a single line of input */
 #define CONFIG_CONSOLE_INPUT_LINE_SIZE 80
 
@@ -343,6 +354,9 @@
  */
 #undef CONFIG_CONSOLE_RESTRICTED_INPUT
 
+/* Complete console command names with the TAB key */
+#undef CONFIG_CONSOLE_TAB_COMPLETION
+
 /*****************************************************************************/
 /*
  * Debugging config
@@ -466,6 +480,13 @@
 #undef CONFIG_FLASH_WRITE_IDEAL_SIZE
 #undef CONFIG_FLASH_WRITE_SIZE
 
+/*
+ * Emulator only: keep flash purely in memory instead of mapping it from a
+ * file next to the executable.  Flash contents are then lost when the
+ * emulator reboots or jumps to another image.
+ */
+#undef CONFIG_FLASH_VOLATILE
+
 /*****************************************************************************/
 
 /* Include a flashmap in the compiled firmware image */
@@ -506,6 +527,14 @@
  */
 #undef CONFIG_HOST_COMMAND_STATUS
 
+/*
+ * Number of host commands to keep timing statistics for: call and error
+ * counts, handler run time, and time from receipt to response.  Commands past
+ * this many entries in the host command table aren't tracked.  Costs 24
+ * bytes of RAM per command.
+ */
+#undef CONFIG_HOST_COMMAND_STATS
+
 /*****************************************************************************/
 
 /* Enable debugging and profiling statistics for hook functions */
@@ -546,6 +575,14 @@
  */
 #undef CONFIG_KEYBOARD_COL2_INVERTED
 
+/*
+ * Number of scans' worth of key changes which debounce separately.  When
+ * keys change on more scans than this within a debounce window, the oldest
+ * changes are merged into the next oldest, so they debounce a little longer.
+ * Each costs (4 + KEYBOARD_COLS) bytes of RAM, rounded up to a word.
+ */
+#define CONFIG_KEYBOARD_DEBOUNCE_GROUPS 4
+
 /* Enable extra debugging output from keyboard modules */
 #undef CONFIG_KEYBOARD_DEBUG
 
@@ -564,6 +601,15 @@
  */
 #undef CONFIG_KEYBOARD_BOARD_CONFIG
 
+/*
+ * While polling, only rescan columns with keys pressed or debouncing.  Each
+ * scan first drives all columns at once to look for keys down in new rows;
+ * if there are any, or every CONFIG_KEYBOARD_FULL_SCAN_PERIOD scans, the
+ * whole matrix is scanned.  This saves output_settle_us for each idle column.
+ */
+#undef CONFIG_KEYBOARD_PARTIAL_SCAN
+#define CONFIG_KEYBOARD_FULL_SCAN_PERIOD 4
+
 /*
  * Minimum CPU clocks between scans.  This ensures that keyboard scanning
  * doesn't starve the other EC tasks of CPU when running at a decreased system
@@ -734,6 +780,15 @@
 /* Support computing SHA-1 hash */
 #undef CONFIG_SHA1
 
+/* Support computing SHA-256 hash; CONFIG_VBOOT_HASH includes this */
+#undef CONFIG_SHA256
+
+/*
+ * Fully unroll the SHA-256 compression rounds.  This is faster, but costs
+ * several KB of flash, so only define it on parts with flash to spare.
+ */
+#undef CONFIG_SHA256_UNROLLED
+
 /* Emulate the CLZ (Count Leading Zeros) in software for CPU lacking support */
 #undef CONFIG_SOFTWARE_CLZ
 
@@ -886,6 +941,12 @@
 /* Support computing hash of code for verified boot */
 #undef CONFIG_VBOOT_HASH
 
+/*
+ * Cache the RW firmware hash in the pstate bank, so an unchanged image
+ * doesn't need rehashing after a cold boot.  Requires CONFIG_VBOOT_HASH.
+ */
+#undef CONFIG_VBOOT_HASH_CACHE
+
 /*****************************************************************************/
 /* Watchdog config */
 
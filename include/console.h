@@ -100,6 +100,44 @@ int cprints(enum console_channel channel, const char *format, ...);
  */
 void cflush(void);
 
+/* Max arguments to cprints_deferred() */
+#define CONSOLE_DEFERRED_MAX_ARGS 8
+
+#ifdef CONFIG_CONSOLE_DEFERRED
+/**
+ * Queue timestamped output to the console channel, to be formatted later.
+ *
+ * Use cprints_deferred() instead of calling this directly.  The output is
+ * formatted by the hook task, like cprints(channel, format, ...) but stamped
+ * with the time of this call.  If the queue is full, the output is dropped
+ * and counted against the channel.
+ *
+ * Since formatting happens later, the format string must be constant and all
+ * arguments must be int-sized values; no strings, pointers or 64-bit values,
+ * and no %T.
+ *
+ * @param channel	Output channel
+ * @param format	Format string; see printf.h for valid formatting codes
+ * @param nargs		Number of int arguments which follow, at most
+ *			CONSOLE_DEFERRED_MAX_ARGS.
+ *
+ * @return non-zero if output was dropped.
+ */
+int cprints_deferred_args(enum console_channel channel, const char *format,
+			  int nargs, ...);
+
+/* Count (up to 8) macro arguments */
+#define __CONSOLE_NARGS(args...) \
+	__CONSOLE_NARGS_(0, ## args, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define __CONSOLE_NARGS_(_0, _1, _2, _3, _4, _5, _6, _7, _8, n, ...) n
+
+#define cprints_deferred(channel, format, args...) \
+	cprints_deferred_args(channel, format, __CONSOLE_NARGS(args), ## args)
+#else
+#define cprints_deferred(channel, format, args...) \
+	cprints(channel, format, ## args)
+#endif
+
 /* Convenience macros for printing to the command channel.
  *
  * Modules may define similar macros in their .c files for their own use; it is
@@ -121,6 +159,8 @@ void console_has_input(void);
  * @param name		Command name; must not be the beginning of another
  *			existing command name.  Note this is NOT in quotes
  *		        so it can be concatenated to form a struct name.
+ *			Must be lower case; the linker sorts the command table
+ *			by name and lookup relies on that order.
  * @param routine	Command handling routine, of the form
  *			int handler(int argc, char **argv)
  * @param argdesc	String describing arguments to command; NULL if none.
@@ -674,6 +674,102 @@ struct ec_response_get_protocol_info {
 	uint32_t flags;
 } __packed;
 
+/*
+ * Run several commands in one request, to save a host round trip per
+ * command.  Only supported for protocol version 3+ requests.
+ *
+ * Params are struct ec_params_batch followed by params.count entries.  Each
+ * entry is a struct ec_batch_request followed by its data_len bytes of
+ * params, zero-padded to a multiple of 4 bytes.
+ *
+ * Commands are run in order.  The response is struct ec_response_batch
+ * followed by one entry per command which was run: a struct
+ * ec_batch_response followed by its data_len bytes of response, zero-padded
+ * to a multiple of 4 bytes.  A command which fails does not stop the ones
+ * after it, but if the response buffer runs out of space the batch stops
+ * early; response.count says how many commands were run.  Batches may not be
+ * nested.
+ */
+#define EC_CMD_BATCH 0x0d
+
+struct ec_params_batch {
+	uint8_t count;		/* Number of commands which follow */
+	uint8_t reserved[3];
+} __packed;
+
+struct ec_batch_request {
+	uint16_t command;	/* Command code */
+	uint8_t command_version;
+	uint8_t reserved;
+	uint16_t data_len;	/* Length of params which follow */
+	uint16_t response_max;	/* Max response data to return */
+} __packed;
+
+struct ec_response_batch {
+	uint8_t count;		/* Number of commands run */
+	uint8_t reserved[3];
+} __packed;
+
+struct ec_batch_response {
+	uint16_t result;	/* EC_RES_* status code for this command */
+	uint16_t data_len;	/* Length of response data which follows */
+} __packed;
+
+/* Round a batch entry's data length up to where the next entry starts */
+#define EC_BATCH_ALIGN(len) (((len) + 3) & ~3)
+
+/*
+ * Get timing statistics for host commands.  Only supported if the EC was
+ * built with CONFIG_HOST_COMMAND_STATS.
+ *
+ * Entries are returned in host command table order, starting at
+ * params.index, as many as fit in the response.  Keep asking with a larger
+ * index until response.count is 0.
+ */
+#define EC_CMD_GET_CMD_STATS 0x0e
+
+/* Clear all stats; no entries are returned */
+#define EC_CMD_STATS_FLAG_RESET (1 << 0)
+
+struct ec_params_get_cmd_stats {
+	uint8_t index;		/* First table entry to return */
+	uint8_t flags;		/* EC_CMD_STATS_FLAG_* */
+} __packed;
+
+struct ec_cmd_stats {
+	uint16_t command;	/* Command code */
+	uint16_t reserved;
+	uint32_t calls;		/* Times the command has been run */
+	uint32_t errors;	/* Times it returned other than success */
+	uint32_t min_us;	/* Min handler run time */
+	uint32_t avg_us;	/* Running average of handler run time */
+	uint32_t max_us;	/* Max handler run time */
+	uint32_t max_latency_us; /* Max time from receipt to response */
+} __packed;
+
+struct ec_response_get_cmd_stats {
+	uint8_t total;		/* Number of entries in the table */
+	uint8_t count;		/* Number of entries which follow */
+	uint8_t reserved[2];
+	struct ec_cmd_stats stats[0];
+} __packed;
+
+/*
+ * Get shared memory usage.  Free memory outside the largest free block is
+ * fragmented; it can't be acquired in one piece.
+ */
+#define EC_CMD_SHARED_MEM_INFO 0x0f
+
+struct ec_response_shared_mem_info {
+	uint32_t size;		/* Bytes which can be acquired when idle */
+	uint32_t used;		/* Bytes currently acquired */
+	uint32_t max_used;	/* High-water mark of bytes acquired */
+	uint32_t free;		/* Bytes free, in all free blocks */
+	uint32_t largest_free;	/* Largest acquire which would succeed now */
+	uint16_t blocks_used;	/* Number of areas currently acquired */
+	uint16_t blocks_free;	/* Number of free blocks */
+} __packed;
+
 
 /*****************************************************************************/
 /* Get/Set miscellaneous values */
@@ -1148,6 +1244,25 @@ struct ec_response_vboot_hash {
 	uint8_t hash_digest[64]; /* Hash digest data */
 } __packed;
 
+/*
+ * Version 1 returns the same initial fields as version 0, with progress
+ * following.  offset and size are also valid while the hash is busy.
+ */
+struct ec_response_vboot_hash_1 {
+	/* Version 0 fields; see above for description */
+	uint8_t status;
+	uint8_t hash_type;
+	uint8_t digest_size;
+	uint8_t reserved0;
+	uint32_t offset;
+	uint32_t size;
+	uint8_t hash_digest[64];
+
+	/* Version 1 additional fields */
+	uint32_t bytes_hashed;   /* Bytes of flash hashed so far */
+	uint32_t elapsed_us;     /* Time since start; total time once done */
+} __packed;
+
 enum ec_vboot_hash_cmd {
 	EC_VBOOT_HASH_GET = 0,       /* Get current hash status */
 	EC_VBOOT_HASH_ABORT = 1,     /* Abort calculating current hash */
@@ -1173,6 +1288,33 @@ enum ec_vboot_hash_status {
 #define EC_VBOOT_HASH_OFFSET_RO 0xfffffffe
 #define EC_VBOOT_HASH_OFFSET_RW 0xfffffffd
 
+/*
+ * Hash a list of flash blocks
+ *
+ * Returns one digest per block, in the order given, so the host can check
+ * which parts of the flash differ from an image without reading them back.
+ * The hash is computed synchronously, independently of EC_CMD_VBOOT_HASH.
+ *
+ * Response is count digests of the size for hash_type, back to back.  The
+ * blocks may total at most EC_FLASH_HASH_MAX_BYTES, so that the EC answers
+ * well within the host command timeout; more returns EC_RES_INVALID_PARAM.
+ */
+#define EC_CMD_FLASH_HASH 0x2C
+
+#define EC_FLASH_HASH_MAX_BYTES 0x10000
+
+struct ec_flash_hash_block {
+	uint32_t offset;         /* Offset in flash to hash */
+	uint32_t size;           /* Number of bytes to hash */
+} __packed;
+
+struct ec_params_flash_hash {
+	uint8_t hash_type;       /* enum ec_vboot_hash_type */
+	uint8_t count;           /* Number of blocks */
+	uint16_t reserved;       /* Reserved; set 0 */
+	struct ec_flash_hash_block block[0];
+} __packed;
+
 /*****************************************************************************/
 /*
  * Motion sense commands. We'll make separate structs for sub-commands with
@@ -1643,6 +1785,36 @@ struct ec_response_mkbp_get_config {
 	struct ec_mkbp_config config;
 } __packed;
 
+/*
+ * Read all pending key state from the FIFO in one go, oldest first, as many
+ * entries as fit in the response.  Entries returned are removed from the
+ * FIFO; if .remaining is non-zero, ask again.
+ *
+ * Unlike EC_CMD_MKBP_STATE, nothing is returned when the FIFO is empty.
+ */
+#define EC_CMD_MKBP_GET_FIFO 0x67
+
+struct ec_mkbp_fifo_entry {
+	uint32_t time;		/* EC time when the state was queued, in us */
+	uint8_t state[0];	/* .cols bytes of key state; see MKBP_STATE */
+} __packed;
+
+struct ec_response_mkbp_get_fifo {
+	uint8_t count;		/* Number of entries which follow */
+	uint8_t remaining;	/* Number of entries left in the FIFO */
+	uint8_t cols;		/* Bytes of key state in each entry */
+	uint8_t reserved;
+	/*
+	 * Number of times new key state was merged into the newest entry
+	 * since the last read, because the FIFO was full.
+	 */
+	uint32_t coalesced;
+	/*
+	 * Followed by .count entries, each a struct ec_mkbp_fifo_entry plus
+	 * .cols bytes of state.
+	 */
+} __packed;
+
 /* Run the key scan emulation */
 #define EC_CMD_KEYSCAN_SEQ_CTRL 0x66
 
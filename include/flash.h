@@ -181,6 +181,56 @@ int flash_write(int offset, int size, const char *data);
  */
 int flash_erase(int offset, int size);
 
+/**
+ * Look up the cached hash of a region of flash.
+ *
+ * The cache is kept in the pstate bank, so it survives reboots.  It's only
+ * used while RO isn't protected at boot.
+ *
+ * @param offset	Flash offset of hashed region.
+ * @param size		Size of hashed region in bytes.
+ * @param digest	Destination for the SHA-256 digest.
+ * @return EC_SUCCESS if a hash of exactly this region is cached and flash
+ *         hasn't been written since it was taken, else nonzero.
+ */
+int flash_get_hash_cache(uint32_t offset, uint32_t size, uint8_t *digest);
+
+/**
+ * Lock or unlock the cached hash.
+ *
+ * flash_write() and flash_erase() hold the lock from dropping the cached
+ * hash until they're done changing flash.
+ *
+ * @param lock		Lock (!=0) or unlock (0).
+ */
+void flash_lock_hash_cache(int lock);
+
+/**
+ * Return the flash write generation.
+ *
+ * This changes on every flash_write() and flash_erase().  Read it before
+ * hashing flash, and pass it to flash_set_hash_cache().
+ */
+uint32_t flash_get_write_generation(void);
+
+/**
+ * Cache the hash of a region of flash, replacing any previously cached hash.
+ *
+ * The cached hash is dropped by any flash_write() or flash_erase() which
+ * overlaps the region, and by changes to RO-at-boot protection.  The caller
+ * must hold flash_lock_hash_cache(), and check under it that the hash
+ * wasn't invalidated meanwhile.
+ *
+ * @param offset	Flash offset of hashed region.
+ * @param size		Size of hashed region in bytes.
+ * @param digest	SHA-256 digest of the region.
+ * @param generation	flash_get_write_generation() from before hashing.
+ * @return EC_SUCCESS, or nonzero if error (including if flash was written
+ *         since <generation>).
+ */
+int flash_set_hash_cache(uint32_t offset, uint32_t size,
+			 const uint8_t *digest, uint32_t generation);
+
 /**
  * Return the flash protect state.
  *
@@ -151,11 +151,24 @@ enum hook_type {
 	HOOK_SECOND,
 };
 
+/* Per-hook run-time state, kept in RAM */
+struct hook_state {
+	/* Index of the next hook of this type in priority order */
+	uint8_t next;
+#ifdef CONFIG_HOOK_DEBUG
+	/* Run time of the hook routine, in us */
+	uint32_t max_run_time;
+	uint32_t avg_run_time;
+#endif
+};
+
 struct hook_data {
 	/* Hook processing routine. */
 	void (*routine)(void);
 	/* Priority; low numbers = higher priority. */
 	int priority;
+	/* Run-time state */
+	struct hook_state *state;
 };
 
 /**
@@ -213,6 +226,9 @@ int hook_call_deferred(void (*routine)(void), int us);
  * never happen, because hook2() won't be called by the hook task until
  * deferred1() returns.
  *
+ * The hook data is aligned explicitly so the compiler can't pad it out; the
+ * linker packs each type's hooks into an array.
+ *
  * @param hooktype	Type of hook for routine (enum hook_type)
  * @param routine	Hook routine, with prototype void routine(void)
  * @param priority      Priority for determining when routine is called vs.
@@ -222,9 +238,11 @@ int hook_call_deferred(void (*routine)(void), int us);
  *			order in which hooks are called.
  */
 #define DECLARE_HOOK(hooktype, routine, priority)			\
+	static struct hook_state __hook_state_##hooktype##_##routine;	\
 	const struct hook_data __hook_##hooktype##_##routine		\
-	__attribute__((section(".rodata." #hooktype)))			\
-	     = {routine, priority}
+	__attribute__((section(".rodata." #hooktype),			\
+		       aligned(__alignof__(struct hook_data))))		\
+	     = {routine, priority, &__hook_state_##hooktype##_##routine}
 
 
 struct deferred_data {
@@ -50,6 +50,14 @@ struct host_cmd_handler_args {
 	 * in the response or in its own operation.
 	 */
 	enum ec_status result;
+
+#ifdef CONFIG_HOST_COMMAND_STATS
+	/*
+	 * Time the command was received, in microseconds (low 32 bits of
+	 * get_time()), or 0 if not known.  Set by host_command_received().
+	 */
+	uint32_t received_time;
+#endif
 };
 
 /* Args for host packet handler */
@@ -167,6 +175,11 @@ uint32_t host_get_events(void);
  * Once command processing is complete, this is used to send a response
  * back to the host.
  *
+ * A handler may also use it to send an early EC_RES_IN_PROGRESS response
+ * and then carry on.  The interface gets its buffer back at that point, so
+ * afterwards the handler must write its data through the updated
+ * args->response and check args->response_max.
+ *
  * @param args	Contains response to send
  */
 void host_send_response(struct host_cmd_handler_args *args);
@@ -193,10 +206,17 @@ int host_request_expected_size(const struct ec_host_request *r);
  */
 void host_packet_receive(struct host_packet *pkt);
 
-/* Register a host command handler */
+/*
+ * Register a host command handler.
+ *
+ * Each command goes in its own .rodata.hcmds.<command> section so the linker
+ * can sort the table by command number; find_host_command() relies on that
+ * to binary-search it.  Sorting is by section name, so command codes must be
+ * spelled as fixed-width hex literals (as they are in ec_commands.h).
+ */
 #define DECLARE_HOST_COMMAND(command, routine, version_mask)		\
 	const struct host_command __host_cmd_##command			\
-	__attribute__((section(".rodata.hcmds")))			\
+	__attribute__((section(".rodata.hcmds." STRINGIFY(command))))	\
 	     = {routine, command, version_mask}
 
 
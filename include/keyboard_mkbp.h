@@ -13,7 +13,11 @@
 /**
  * Add keyboard state into FIFO
  *
- * @return EC_SUCCESS if entry added, EC_ERROR_OVERFLOW if FIFO is full
+ * If the FIFO is full, the state replaces the newest entry instead, so the
+ * host still ends up with the latest state.
+ *
+ * @return EC_SUCCESS if state added, EC_ERROR_OVERFLOW if the FIFO depth is
+ * configured to 0
  */
 int keyboard_fifo_add(const uint8_t *buffp);
 
@@ -67,6 +67,28 @@
 int vfnprintf(int (*addchar)(void *context, int c), void *context,
 	      const char *format, va_list args);
 
+/**
+ * Print formatted output to functions, passing runs of characters at once
+ *
+ * Like vfnprintf(), but literal text, strings, converted numbers and padding
+ * are each passed to addstr() in a single call.
+ *
+ * @param addchar	Function to be called for single characters, as for
+ *			vfnprintf(); may be NULL to use addstr() for those too.
+ * @param addstr	Function to be called with a run of characters.  Will
+ *			be passed the same context passed to vfnprintf_str(),
+ *			the characters, and their count.  Should return 0 if
+ *			all the characters were accepted or non-zero if any
+ *			were dropped due to overflow.
+ * @param context	Context pointer to pass to addchar() and addstr()
+ * @param format	Format string (see above for acceptable formats)
+ * @param args		Parameters
+ * @return EC_SUCCESS, or non-zero if output was truncated.
+ */
+int vfnprintf_str(int (*addchar)(void *context, int c),
+		  int (*addstr)(void *context, const char *s, int len),
+		  void *context, const char *format, va_list args);
+
 /**
  * Print formatted outut to a string.
  *
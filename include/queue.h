@@ -4,37 +4,98 @@
  *
  * Queue data structure.
  */
+#ifndef __CROS_EC_QUEUE_H
+#define __CROS_EC_QUEUE_H
 
 #include "common.h"
+#include "compile_time_macros.h"
 
-/* Generic queue container.
+/*
+ * Generic single-producer, single-consumer queue container.
  *
- *   head: next to dequeqe
- *   tail: next to enqueue
+ *   head: free-running count of units ever removed
+ *   tail: free-running count of units ever added
  *
+ *   Units held:
+ *     tail - head (unsigned arithmetic, so counter wrap is harmless)
  *   Empty:
  *     head == tail
  *   Full:
- *     ((tail + 1) % buf_bytes) == head
+ *     tail - head == buffer_units
+ *
+ * The buffer holds buffer_units units, which must be a power of two so the
+ * counters can be reduced to a buffer index with a mask; all of the buffer is
+ * usable.
+ *
+ * Only the producer updates tail and only the consumer updates head, and each
+ * side publishes its counter only after its data copy is complete.  One
+ * producer and one consumer may therefore run concurrently without a lock,
+ * e.g. an interrupt handler adding units while a task removes them, on a
+ * single-core EC.  Multiple producers (or multiple consumers) must still
+ * serialize among themselves.  queue_reset() touches both counters and must
+ * not race either side.
  */
 struct queue {
-	int head, tail;
-	int buf_bytes;   /* size of buffer (in byte) */
-	int unit_bytes;  /* size of unit (in byte) */
-	uint8_t *buf;
+	volatile unsigned int head, tail;
+	unsigned int buffer_units;  /* size of buffer (in units); power of 2 */
+	unsigned int unit_bytes;    /* size of unit (in bytes) */
+	uint8_t *buffer;
 };
 
+/*
+ * Static initializer for a queue backed by the array BUFFER, one unit per
+ * array element.  ARRAY_SIZE(BUFFER) must be a power of two; this is checked
+ * at compile time.
+ */
+#define QUEUE(BUFFER) {							\
+	.buffer_units = ARRAY_SIZE(BUFFER) + 0 *			\
+		sizeof(char[1 - 2 * !!(ARRAY_SIZE(BUFFER) &		\
+				       (ARRAY_SIZE(BUFFER) - 1))]),	\
+	.unit_bytes = sizeof((BUFFER)[0]),				\
+	.buffer = (uint8_t *)(BUFFER),					\
+}
+
 /* Reset the queue to empty state. */
-void queue_reset(struct queue *queue);
+void queue_reset(struct queue *q);
+
+/* Return the number of units in the queue. */
+int queue_count(const struct queue *q);
+
+/* Return the number of free units in the queue. */
+int queue_space(const struct queue *q);
 
 /* Return TRUE if the queue is empty. */
 int queue_is_empty(const struct queue *q);
 
-/* Return TRUE if the queue has at least one unit space. */
+/* Return TRUE if the queue has space for at least unit_count units. */
 int queue_has_space(const struct queue *q, int unit_count);
 
-/* Add multiple units into queue. */
-void queue_add_units(struct queue *q, const void *src, int unit_count);
+/*
+ * Add multiple units to the tail of the queue.  Producer side.
+ *
+ * Returns the number of units added; this is either unit_count, or 0 if
+ * there was not space for all of them.
+ */
+int queue_add_units(struct queue *q, const void *src, int unit_count);
 
-/* Remove one unit from the begin of the queue. */
+/*
+ * Copy up to unit_count units, starting offset units from the head of the
+ * queue, without removing them.  Consumer side.
+ *
+ * Returns the number of units copied.
+ */
+int queue_peek_units(const struct queue *q, void *dest, int offset,
+		     int unit_count);
+
+/*
+ * Remove up to unit_count units from the head of the queue.  Consumer side.
+ * dest may be NULL to discard the units.
+ *
+ * Returns the number of units removed.
+ */
+int queue_remove_units(struct queue *q, void *dest, int unit_count);
+
+/* Remove one unit from the head of the queue.  Returns 1 if successful. */
 int queue_remove_unit(struct queue *q, void *dest);
+
+#endif /* __CROS_EC_QUEUE_H */
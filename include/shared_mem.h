@@ -11,7 +11,8 @@
  * need a buffer to hold signature data during a verification operation.  It is
  * NOT intended for allocating long-term buffers; those should in general be
  * static variables allocated at compile-time.  It is NOT a full-featured
- * replacement for malloc() / free().
+ * replacement for malloc() / free(); areas are handed out first-fit from a
+ * single buffer, and must not be acquired or released from interrupt context.
  */
 
 #ifndef __CROS_EC_SHARED_MEM_H
@@ -30,15 +31,24 @@ int shared_mem_init(void);
  */
 int shared_mem_size(void);
 
+/**
+ * Returns the largest amount of shared memory which could be acquired right
+ * now, in bytes.  This is less than shared_mem_size() while other areas are
+ * acquired.
+ */
+int shared_mem_available(void);
+
 /**
  * Acquires a shared memory area of the requested size in bytes.
  *
+ * Several areas may be acquired at once, by the same or different tasks.
+ *
  * @param size		Number of bytes requested
  * @param dest_ptr	If successful, set on return to the start of the
  *			granted memory buffer.
  *
- * @return EC_SUCCESS if successful, EC_ERROR_BUSY if buffer in use, or
- * other non-zero error code.
+ * @return EC_SUCCESS if successful, EC_ERROR_BUSY if there isn't a free area
+ * big enough because of other areas in use, or other non-zero error code.
  */
 int shared_mem_acquire(int size, char **dest_ptr);
 
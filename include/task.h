@@ -44,6 +44,24 @@ void interrupt_disable(void);
  */
 void interrupt_enable(void);
 
+/**
+ * Disable CPU interrupt bit, remembering whether it was set.
+ *
+ * Unlike interrupt_disable() / interrupt_enable(), this nests, so it's safe to
+ * use in interrupt context and in code which may be called with interrupts
+ * already disabled.
+ *
+ * @return Previous state, to pass to interrupt_restore().
+ */
+int interrupt_disable_save(void);
+
+/**
+ * Restore CPU interrupt bit to the state saved by interrupt_disable_save().
+ *
+ * @param state		Return value from interrupt_disable_save()
+ */
+void interrupt_restore(int state);
+
 /**
  * Return true if we are in interrupt context.
  */
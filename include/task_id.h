@@ -20,8 +20,6 @@
 #define TASK_ALWAYS TASK
 
 /* define the name of the header containing the list of tasks */
-#define STRINGIFY0(name)  #name
-#define STRINGIFY(name)  STRINGIFY0(name)
 #define TEST_TASK_LIST STRINGIFY(TEST_TASKFILE)
 #define BOARD_TASK_LIST STRINGIFY(BOARD_TASKFILE)
 
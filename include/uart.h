@@ -39,6 +39,18 @@ int uart_init_done(void);
  */
 int uart_putc(int c);
 
+/**
+ * Put a block of characters to the UART, like fwrite().
+ *
+ * Newlines are translated to CRLF like the other output functions; the rest is
+ * copied into the transmit buffer a contiguous chunk at a time.
+ *
+ * @param out		Characters to put
+ * @param len		Number of characters
+ * @return EC_SUCCESS, or non-zero if output was truncated.
+ */
+int uart_put(const char *out, int len);
+
 /**
  * Put a null-terminated string to the UART, like fputs().
  *
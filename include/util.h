@@ -66,6 +66,19 @@ int strcasecmp(const char *s1, const char *s2);
 int strncasecmp(const char *s1, const char *s2, int size);
 int strlen(const char *s);
 
+/**
+ * Copy a buffer and sum its bytes in a single pass.
+ *
+ * Used for host packet checksums.  The source is read a word at a time once
+ * it is word-aligned, whatever the alignment of the destination.
+ *
+ * @param dest		Destination buffer, or NULL to only sum the source
+ * @param src		Source buffer
+ * @param len		Number of bytes
+ * @return The sum of the bytes in src.
+ */
+int memcpy_sum(void *dest, const void *src, int len);
+
 /* Like strtol(), but for integers. */
 int strtoi(const char *nptr, char **endptr, int base);
 
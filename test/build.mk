@@ -24,6 +24,13 @@ test-list-host+=thermal flash queue kb_8042 extpwr_gpio console_edit system
 test-list-host+=sbs_charging adapter host_command thermal_falco led_spring
 test-list-host+=bklight_lid bklight_passthru interrupt timer_dos button
 test-list-host+=motion_sense math_util sbs_charging_v2 battery_get_params_smart
+test-list-host+=uart_tx printf vboot_hash sha256
+
+# Emulator tests which run on virtual time; see core/host/timer.c.  Tests that
+# measure real elapsed time or use the interrupt generator are left out.
+test-list-host-virtual-time=$(filter-out utils queue uart_tx printf \
+				    host_command kb_8042 interrupt sha256, \
+			    $(test-list-host))
 
 adapter-y=adapter.o
 button-y=button.o
@@ -46,14 +53,18 @@ mutex-y=mutex.o
 pingpong-y=pingpong.o
 power_button-y=power_button.o
 powerdemo-y=powerdemo.o
+printf-y=printf.o
 queue-y=queue.o
 sbs_charging-y=sbs_charging.o
 sbs_charging_v2-y=sbs_charging_v2.o
+sha256-y=sha256.o
 stress-y=stress.o
 system-y=system.o
 thermal-y=thermal.o
 thermal_falco-y=thermal_falco.o
 timer_calib-y=timer_calib.o
 timer_dos-y=timer_dos.o
+uart_tx-y=uart_tx.o
 utils-y=utils.o
+vboot_hash-y=vboot_hash.o
 battery_get_params_smart-y=battery_get_params_smart.o
@@ -7,12 +7,14 @@
 
 #include "common.h"
 #include "console.h"
+#include "link_defs.h"
 #include "test_util.h"
 #include "timer.h"
 #include "util.h"
 
 static int cmd_1_call_cnt;
 static int cmd_2_call_cnt;
+static int cmd_unique_call_cnt;
 
 static int command_test_1(int argc, char **argv)
 {
@@ -28,6 +30,13 @@ static int command_test_2(int argc, char **argv)
 }
 DECLARE_CONSOLE_COMMAND(test2, command_test_2, NULL, NULL, NULL);
 
+static int command_test_unique(int argc, char **argv)
+{
+	cmd_unique_call_cnt++;
+	return EC_SUCCESS;
+}
+DECLARE_CONSOLE_COMMAND(test_unique, command_test_unique, NULL, NULL, NULL);
+
 /*****************************************************************************/
 /* Test utilities */
 
@@ -273,6 +282,147 @@ static int test_output_channel(void)
 	return EC_SUCCESS;
 }
 
+static int test_command_lookup(void)
+{
+	const struct console_command *cmd;
+
+	/* Lookup relies on the table being in case-folded name order */
+	for (cmd = __cmds + 1; cmd < __cmds_end; cmd++)
+		TEST_ASSERT(strcasecmp(cmd[-1].name, cmd->name) < 0);
+
+	cmd_1_call_cnt = 0;
+	cmd_2_call_cnt = 0;
+	UART_INJECT("TEST1\n");
+	msleep(30);
+	TEST_ASSERT(cmd_1_call_cnt == 1);
+
+	/* Ambiguous prefix runs nothing */
+	UART_INJECT("test\n");
+	msleep(30);
+	TEST_ASSERT(cmd_1_call_cnt == 1 && cmd_2_call_cnt == 0);
+
+	/* Unique prefix runs the command */
+	cmd_unique_call_cnt = 0;
+	UART_INJECT("test_\n");
+	msleep(30);
+	TEST_ASSERT(cmd_unique_call_cnt == 1);
+	UART_INJECT("Test_U\n");
+	msleep(30);
+	TEST_ASSERT(cmd_unique_call_cnt == 2);
+
+	return EC_SUCCESS;
+}
+
+#ifdef CONFIG_CONSOLE_TAB_COMPLETION
+static int test_tab_completion(void)
+{
+	/* Shared prefix, then unique */
+	cmd_1_call_cnt = 0;
+	cmd_2_call_cnt = 0;
+	UART_INJECT("tes\t1\n");
+	msleep(30);
+	TEST_ASSERT(cmd_1_call_cnt == 1);
+	UART_INJECT("TEST2\t\n");
+	msleep(30);
+	TEST_ASSERT(cmd_2_call_cnt == 1);
+	cmd_unique_call_cnt = 0;
+	UART_INJECT("test_\t\n");
+	msleep(30);
+	TEST_ASSERT(cmd_unique_call_cnt == 1);
+
+	/* Nothing to add lists the matches */
+	test_capture_console(1);
+	UART_INJECT("test\t");
+	msleep(30);
+	test_capture_console(0);
+	TEST_ASSERT(compare_multiline_string(test_get_captured_console(),
+					     "test\n"
+					     "test1          test2          "
+					     "test_unique    \n"
+					     "> test") == 0);
+	UART_INJECT("\b\b\b\b");
+
+	/* Arguments are not completed */
+	UART_INJECT("test1 x\t\n");
+	msleep(30);
+	TEST_ASSERT(cmd_1_call_cnt == 2);
+
+	return EC_SUCCESS;
+}
+#endif
+
+#ifdef CONFIG_CONSOLE_DEFERRED
+/* Skip a "[seconds.micros " timestamp; return NULL if there isn't one */
+static const char *skip_timestamp(const char *s)
+{
+	if (*s++ != '[' || !isdigit(*s))
+		return NULL;
+	while (isdigit(*s))
+		s++;
+	if (*s++ != '.')
+		return NULL;
+	while (isdigit(*s))
+		s++;
+	return *s == ' ' ? s + 1 : NULL;
+}
+
+static int test_deferred_output(void)
+{
+	const char *s;
+	int i;
+
+	/* Nothing is printed until the record is drained */
+	test_capture_console(1);
+	TEST_ASSERT(cprints_deferred(CC_CHARGER, "deferred") == EC_SUCCESS);
+	TEST_ASSERT(cprints_deferred(CC_CHARGER, "args %d %x %c", -12, 0xab,
+				     'z') == EC_SUCCESS);
+	test_capture_console(0);
+	TEST_ASSERT(*test_get_captured_console() == '\0');
+
+	test_capture_console(1);
+	cflush();
+	test_capture_console(0);
+	s = skip_timestamp(test_get_captured_console());
+	TEST_ASSERT(s && !memcmp(s, "deferred]\r\n", 11));
+	s = skip_timestamp(s + 11);
+	TEST_ASSERT(s && !memcmp(s, "args -12 ab z]\r\n", 16));
+	TEST_ASSERT(s[16] == '\0');
+
+	/* Overflow is counted against the channel */
+	test_capture_console(1);
+	for (i = 0; i < CONFIG_CONSOLE_DEFERRED_RECORDS; i++)
+		TEST_ASSERT(cprints_deferred(CC_CHARGER, "%d", i) ==
+			    EC_SUCCESS);
+	TEST_ASSERT(cprints_deferred(CC_CHARGER, "lost") != EC_SUCCESS);
+	TEST_ASSERT(cprints_deferred(CC_CHARGER, "lost") != EC_SUCCESS);
+	cflush();
+	test_capture_console(0);
+
+	s = test_get_captured_console();
+	for (i = 0; i < CONFIG_CONSOLE_DEFERRED_RECORDS; i++) {
+		s = skip_timestamp(s);
+		TEST_ASSERT(s && atoi(s) == i);
+		while (*s && *s++ != '\n')
+			;
+	}
+	s = skip_timestamp(s);
+	TEST_ASSERT(s && !memcmp(s, "charger: 2 deferred msgs dropped]", 33));
+
+	/* Inactive channels are not queued */
+	UART_INJECT("chan 0\n");
+	msleep(30);
+	test_capture_console(1);
+	cprints_deferred(CC_CHARGER, "shouldn't see this");
+	cflush();
+	test_capture_console(0);
+	TEST_ASSERT(*test_get_captured_console() == '\0');
+	UART_INJECT("chan restore\n");
+	msleep(30);
+
+	return EC_SUCCESS;
+}
+#endif
+
 void run_test(void)
 {
 	test_reset();
@@ -290,6 +440,13 @@ void run_test(void)
 	RUN_TEST(test_history_stash);
 	RUN_TEST(test_history_list);
 	RUN_TEST(test_output_channel);
+	RUN_TEST(test_command_lookup);
+#ifdef CONFIG_CONSOLE_TAB_COMPLETION
+	RUN_TEST(test_tab_completion);
+#endif
+#ifdef CONFIG_CONSOLE_DEFERRED
+	RUN_TEST(test_deferred_output);
+#endif
 
 	test_print_result();
 }
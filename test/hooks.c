@@ -51,12 +51,80 @@ static void second_hook(void)
 }
 DECLARE_HOOK(HOOK_SECOND, second_hook, HOOK_PRIO_DEFAULT);
 
+/* Hooks declared out of priority order, to check the order they're called */
+static char order_seen[5];
+static int order_count;
+
+static void record_order(char c)
+{
+	if (order_count < sizeof(order_seen) - 1)
+		order_seen[order_count++] = c;
+}
+
+static void order_hook_last(void)
+{
+	record_order('d');
+}
+DECLARE_HOOK(HOOK_CHARGE_STATE_CHANGE, order_hook_last, HOOK_PRIO_LAST);
+
+static void order_hook_default(void)
+{
+	record_order('b');
+}
+DECLARE_HOOK(HOOK_CHARGE_STATE_CHANGE, order_hook_default, HOOK_PRIO_DEFAULT);
+
+static void order_hook_first(void)
+{
+	record_order('a');
+}
+DECLARE_HOOK(HOOK_CHARGE_STATE_CHANGE, order_hook_first, HOOK_PRIO_FIRST);
+
+/*
+ * Same priority as order_hook_default().  Which of the two runs first
+ * depends on the order the compiler emits them, so they record the same
+ * letter.
+ */
+static void order_hook_default2(void)
+{
+	record_order('b');
+}
+DECLARE_HOOK(HOOK_CHARGE_STATE_CHANGE, order_hook_default2,
+	     HOOK_PRIO_DEFAULT);
+
 static void deferred_func(void)
 {
 	deferred_call_count++;
 }
 DECLARE_DEFERRED(deferred_func);
 
+/* Deferred functions which record the order they're called in */
+static char deferred_order[4];
+static int deferred_order_count;
+
+static void record_deferred(char c)
+{
+	if (deferred_order_count < sizeof(deferred_order) - 1)
+		deferred_order[deferred_order_count++] = c;
+}
+
+static void deferred_func_a(void)
+{
+	record_deferred('a');
+}
+DECLARE_DEFERRED(deferred_func_a);
+
+static void deferred_func_b(void)
+{
+	record_deferred('b');
+}
+DECLARE_DEFERRED(deferred_func_b);
+
+static void deferred_func_c(void)
+{
+	record_deferred('c');
+}
+DECLARE_DEFERRED(deferred_func_c);
+
 static void non_deferred_func(void)
 {
 	deferred_call_count++;
@@ -101,6 +169,20 @@ static int test_priority(void)
 	return EC_SUCCESS;
 }
 
+static int test_priority_order(void)
+{
+	order_count = 0;
+	hook_notify(HOOK_CHARGE_STATE_CHANGE);
+	TEST_ASSERT_ARRAY_EQ(order_seen, "abbd", 5);
+
+	/* Order doesn't change from one call to the next */
+	order_count = 0;
+	hook_notify(HOOK_CHARGE_STATE_CHANGE);
+	TEST_ASSERT_ARRAY_EQ(order_seen, "abbd", 5);
+
+	return EC_SUCCESS;
+}
+
 static int test_deferred(void)
 {
 	deferred_call_count = 0;
@@ -130,6 +212,30 @@ static int test_deferred(void)
 	return EC_SUCCESS;
 }
 
+static int test_deferred_order(void)
+{
+	/* Scheduled out of order; called in order of their deadlines */
+	deferred_order_count = 0;
+	hook_call_deferred(deferred_func_c, 30 * MSEC);
+	hook_call_deferred(deferred_func_a, 10 * MSEC);
+	hook_call_deferred(deferred_func_b, 20 * MSEC);
+	usleep(50 * MSEC);
+	TEST_ASSERT_ARRAY_EQ(deferred_order, "abc", 4);
+
+	/* Rescheduling and cancelling reorder the pending calls */
+	deferred_order_count = 0;
+	hook_call_deferred(deferred_func_a, 10 * MSEC);
+	hook_call_deferred(deferred_func_b, 20 * MSEC);
+	hook_call_deferred(deferred_func_c, 30 * MSEC);
+	hook_call_deferred(deferred_func_a, 40 * MSEC);
+	hook_call_deferred(deferred_func_b, -1);
+	usleep(60 * MSEC);
+	TEST_ASSERT(deferred_order_count == 2);
+	TEST_ASSERT_ARRAY_EQ(deferred_order, "ca", 2);
+
+	return EC_SUCCESS;
+}
+
 void run_test(void)
 {
 	test_reset();
@@ -137,7 +243,9 @@ void run_test(void)
 	RUN_TEST(test_init_hook);
 	RUN_TEST(test_ticks);
 	RUN_TEST(test_priority);
+	RUN_TEST(test_priority_order);
 	RUN_TEST(test_deferred);
+	RUN_TEST(test_deferred_order);
 
 	test_print_result();
 }
@@ -8,11 +8,14 @@
 #include "common.h"
 #include "console.h"
 #include "host_command.h"
+#include "link_defs.h"
 #include "task.h"
 #include "test_util.h"
 #include "timer.h"
 #include "util.h"
 
+const struct host_command *find_host_command(int command);
+
 struct host_packet pkt;
 static char resp_buf[128];
 static char req_buf[128];
@@ -167,6 +170,422 @@ static int test_hostcmd_invalid_checksum(void)
 	return EC_SUCCESS;
 }
 
+static int test_hostcmd_batch(void)
+{
+	uint8_t params[64];
+	uint8_t response[64];
+	struct ec_params_batch *bp = (struct ec_params_batch *)params;
+	struct ec_batch_request *breq;
+	struct ec_params_hello *hp;
+	struct ec_params_get_cmd_versions *vp;
+	struct ec_response_batch *br = (struct ec_response_batch *)response;
+	struct ec_batch_response *brsp;
+	struct ec_response_hello *hr;
+	uint8_t *in = params + sizeof(*bp);
+	uint8_t *out = response + sizeof(*br);
+
+	memset(params, 0, sizeof(params));
+	bp->count = 3;
+
+	/* Hello */
+	breq = (struct ec_batch_request *)in;
+	breq->command = EC_CMD_HELLO;
+	breq->data_len = sizeof(*hp);
+	breq->response_max = sizeof(*hr);
+	hp = (struct ec_params_hello *)(breq + 1);
+	hp->in_data = 0x11223344;
+	in += sizeof(*breq) + EC_BATCH_ALIGN(sizeof(*hp));
+
+	/* Unknown command; shouldn't stop the batch */
+	breq = (struct ec_batch_request *)in;
+	breq->command = 0xff;
+	in += sizeof(*breq);
+
+	/* Versions of a command which isn't registered */
+	breq = (struct ec_batch_request *)in;
+	breq->command = EC_CMD_GET_CMD_VERSIONS;
+	breq->data_len = sizeof(*vp);
+	breq->response_max = sizeof(struct ec_response_get_cmd_versions);
+	vp = (struct ec_params_get_cmd_versions *)(breq + 1);
+	vp->cmd = 0xff;
+	in += sizeof(*breq) + EC_BATCH_ALIGN(sizeof(*vp));
+
+	TEST_ASSERT(test_send_host_command(EC_CMD_BATCH, 0, params,
+					   in - params, response,
+					   sizeof(response)) ==
+		    EC_RES_SUCCESS);
+	TEST_ASSERT(br->count == 3);
+
+	brsp = (struct ec_batch_response *)out;
+	TEST_ASSERT(brsp->result == EC_RES_SUCCESS);
+	TEST_ASSERT(brsp->data_len == sizeof(*hr));
+	hr = (struct ec_response_hello *)(brsp + 1);
+	TEST_ASSERT(hr->out_data == 0x12243648);
+	out += sizeof(*brsp) + EC_BATCH_ALIGN(brsp->data_len);
+
+	brsp = (struct ec_batch_response *)out;
+	TEST_ASSERT(brsp->result == EC_RES_INVALID_COMMAND);
+	TEST_ASSERT(brsp->data_len == 0);
+	out += sizeof(*brsp);
+
+	brsp = (struct ec_batch_response *)out;
+	TEST_ASSERT(brsp->result == EC_RES_INVALID_PARAM);
+	TEST_ASSERT(brsp->data_len == 0);
+
+	/* A response which doesn't fit isn't written past the buffer */
+	bp->count = 1;
+	memset(response, 0xee, sizeof(response));
+	TEST_ASSERT(test_send_host_command(EC_CMD_BATCH, 0, params,
+					   in - params, response,
+					   sizeof(*br) + sizeof(*brsp) + 2) ==
+		    EC_RES_SUCCESS);
+	TEST_ASSERT(br->count == 1);
+	brsp = (struct ec_batch_response *)(response + sizeof(*br));
+	TEST_ASSERT(brsp->result == EC_RES_RESPONSE_TOO_BIG);
+	TEST_ASSERT(brsp->data_len == 0);
+	TEST_ASSERT(response[sizeof(*br) + sizeof(*brsp)] == 0xee);
+
+	/* Truncated list of commands runs nothing */
+	bp->count = 4;
+	TEST_ASSERT(test_send_host_command(EC_CMD_BATCH, 0, params,
+					   in - params, response,
+					   sizeof(response)) ==
+		    EC_RES_REQUEST_TRUNCATED);
+
+	/* Batches don't nest */
+	bp->count = 1;
+	breq = (struct ec_batch_request *)(params + sizeof(*bp));
+	breq->command = EC_CMD_BATCH;
+	TEST_ASSERT(test_send_host_command(EC_CMD_BATCH, 0, params,
+					   in - params, response,
+					   sizeof(response)) ==
+		    EC_RES_INVALID_PARAM);
+
+	/* Params and response can't share a buffer */
+	TEST_ASSERT(test_send_host_command(EC_CMD_BATCH, 0, params,
+					   in - params, params,
+					   sizeof(params)) ==
+		    EC_RES_INVALID_COMMAND);
+
+	return EC_SUCCESS;
+}
+
+#ifdef CONFIG_HOST_COMMAND_STATS
+static int test_hostcmd_stats(void)
+{
+	struct ec_params_get_cmd_stats sp;
+	struct ec_params_test_protocol tp;
+	struct ec_response_test_protocol tr;
+	uint8_t buf[256];
+	struct ec_response_get_cmd_stats *sr =
+		(struct ec_response_get_cmd_stats *)buf;
+	struct ec_cmd_stats hello, test;
+	int found = 0;
+	int i;
+
+	memset(&sp, 0, sizeof(sp));
+	sp.flags = EC_CMD_STATS_FLAG_RESET;
+	TEST_ASSERT(test_send_host_command(EC_CMD_GET_CMD_STATS, 0, &sp,
+					   sizeof(sp), buf, sizeof(buf)) ==
+		    EC_RES_SUCCESS);
+	TEST_ASSERT(sr->count == 0);
+
+	/* Three hellos through the packet interface */
+	for (i = 0; i < 3; i++) {
+		hostcmd_fill_in_default();
+		hostcmd_send();
+		TEST_ASSERT(resp->result == EC_RES_SUCCESS);
+	}
+
+	/* One failing command */
+	memset(&tp, 0, sizeof(tp));
+	tp.ec_result = EC_RES_ERROR;
+	test_send_host_command(EC_CMD_TEST_PROTOCOL, 0, &tp, sizeof(tp),
+			       &tr, sizeof(tr));
+
+	sp.flags = 0;
+	do {
+		TEST_ASSERT(test_send_host_command(EC_CMD_GET_CMD_STATS, 0,
+						   &sp, sizeof(sp), buf,
+						   sizeof(buf)) ==
+			    EC_RES_SUCCESS);
+		for (i = 0; i < sr->count; i++) {
+			if (sr->stats[i].command == EC_CMD_HELLO) {
+				hello = sr->stats[i];
+				found++;
+			} else if (sr->stats[i].command ==
+				   EC_CMD_TEST_PROTOCOL) {
+				test = sr->stats[i];
+				found++;
+			}
+		}
+		sp.index += sr->count;
+	} while (sr->count);
+
+	TEST_ASSERT(found == 2);
+	TEST_ASSERT(hello.calls == 3);
+	TEST_ASSERT(hello.errors == 0);
+	TEST_ASSERT(hello.min_us <= hello.max_us);
+	TEST_ASSERT(test.calls == 1);
+	TEST_ASSERT(test.errors == 1);
+
+	return EC_SUCCESS;
+}
+#endif
+
+#ifdef CONFIG_HOST_COMMAND_STATUS
+/* Command which reports it is in progress before returning its data */
+#define TEST_CMD_SLOW 0xe0
+
+static int hostcmd_slow(struct host_cmd_handler_args *args)
+{
+	struct ec_response_hello *out;
+
+	args->result = EC_RES_IN_PROGRESS;
+	host_send_response(args);
+
+	/* The early response may have moved the response buffer */
+	out = args->response;
+	if (args->response_max < sizeof(*out))
+		return EC_RES_RESPONSE_TOO_BIG;
+	out->out_data = 0xaabbccdd;
+	args->response_size = sizeof(*out);
+
+	return EC_RES_SUCCESS;
+}
+DECLARE_HOST_COMMAND(TEST_CMD_SLOW, hostcmd_slow, EC_VER_MASK(0));
+
+/* Slow command which keeps running for a while after its early response */
+#define TEST_CMD_SLOW_SLEEP 0xe1
+
+static int slow_sleep_command;
+
+static int hostcmd_slow_sleep(struct host_cmd_handler_args *args)
+{
+	args->result = EC_RES_IN_PROGRESS;
+	host_send_response(args);
+
+	msleep(20);
+	slow_sleep_command = args->command;
+
+	return EC_RES_SUCCESS;
+}
+DECLARE_HOST_COMMAND(TEST_CMD_SLOW_SLEEP, hostcmd_slow_sleep,
+		     EC_VER_MASK(0));
+
+/* Interfaces hand over packets from their interrupt handlers */
+static volatile int isr_packet_pending;
+
+static void hostcmd_receive_isr(void)
+{
+	host_packet_receive(&pkt);
+}
+
+void interrupt_generator(void)
+{
+	while (1) {
+		if (isr_packet_pending) {
+			task_trigger_test_interrupt(hostcmd_receive_isr);
+			isr_packet_pending = 0;
+		}
+		interrupt_generator_udelay(100);
+	}
+}
+
+/* Response from interrupt context; the caller waits for the ISR anyway */
+static void hostcmd_respond_isr(struct host_packet *pkt)
+{
+}
+
+static void hostcmd_send_empty(int command)
+{
+	hostcmd_fill_in_default();
+	req->command = command;
+	req->data_len = 0;
+	pkt.request_size = sizeof(*req);
+	hostcmd_send();
+}
+
+static int test_hostcmd_resend_response(void)
+{
+	struct ec_response_get_comms_status *cs =
+		(struct ec_response_get_comms_status *)r;
+
+	memset(resp_buf, 0, sizeof(resp_buf));
+	hostcmd_send_empty(TEST_CMD_SLOW);
+	TEST_ASSERT(resp->result == EC_RES_IN_PROGRESS);
+
+	/* The interface buffer is left alone after the early response */
+	msleep(10);
+	TEST_ASSERT(r->out_data == 0);
+
+	hostcmd_send_empty(EC_CMD_GET_COMMS_STATUS);
+	TEST_ASSERT(resp->result == EC_RES_SUCCESS);
+	TEST_ASSERT(!(cs->flags & EC_COMMS_STATUS_PROCESSING));
+
+	/* Stashed data comes back with the resent response */
+	hostcmd_send_empty(EC_CMD_RESEND_RESPONSE);
+	TEST_ASSERT(resp->result == EC_RES_SUCCESS);
+	TEST_ASSERT(resp->data_len == sizeof(*r));
+	TEST_ASSERT(r->out_data == 0xaabbccdd);
+
+	/* ...but only once */
+	hostcmd_send_empty(EC_CMD_RESEND_RESPONSE);
+	TEST_ASSERT(resp->result == EC_RES_UNAVAILABLE);
+
+	/* Another command in between drops the stashed data */
+	hostcmd_send_empty(TEST_CMD_SLOW);
+	TEST_ASSERT(resp->result == EC_RES_IN_PROGRESS);
+	hostcmd_fill_in_default();
+	hostcmd_send();
+	TEST_ASSERT(resp->result == EC_RES_SUCCESS);
+	hostcmd_send_empty(EC_CMD_RESEND_RESPONSE);
+	TEST_ASSERT(resp->result == EC_RES_UNAVAILABLE);
+
+	return EC_SUCCESS;
+}
+
+static int test_hostcmd_batch_slow(void)
+{
+	struct {
+		struct ec_params_batch p;
+		struct ec_batch_request req;
+	} bparams;
+	struct {
+		struct ec_response_batch r;
+		struct ec_batch_response rsp;
+		struct ec_response_hello hr;
+	} bresp;
+	struct ec_response_get_comms_status cs;
+
+	memset(&bparams, 0, sizeof(bparams));
+	bparams.p.count = 1;
+	bparams.req.command = TEST_CMD_SLOW;
+	bparams.req.response_max = sizeof(bresp.hr);
+
+	/* The early response is dropped; the data comes back in the batch */
+	TEST_ASSERT(test_send_host_command(EC_CMD_BATCH, 0, &bparams,
+					   sizeof(bparams), &bresp,
+					   sizeof(bresp)) == EC_RES_SUCCESS);
+	TEST_ASSERT(bresp.r.count == 1);
+	TEST_ASSERT(bresp.rsp.result == EC_RES_SUCCESS);
+	TEST_ASSERT(bresp.rsp.data_len == sizeof(bresp.hr));
+	TEST_ASSERT(bresp.hr.out_data == 0xaabbccdd);
+
+	/* ...and nothing is left pending */
+	TEST_ASSERT(test_send_host_command(EC_CMD_GET_COMMS_STATUS, 0, NULL, 0,
+					   &cs, sizeof(cs)) == EC_RES_SUCCESS);
+	TEST_ASSERT(!(cs.flags & EC_COMMS_STATUS_PROCESSING));
+
+	return EC_SUCCESS;
+}
+
+static int test_hostcmd_in_progress_slot(void)
+{
+	struct ec_response_get_comms_status *cs =
+		(struct ec_response_get_comms_status *)r;
+
+	slow_sleep_command = 0;
+	hostcmd_send_empty(TEST_CMD_SLOW_SLEEP);
+	TEST_ASSERT(resp->result == EC_RES_IN_PROGRESS);
+
+	/* Host polls for status while the command is still running */
+	hostcmd_fill_in_default();
+	req->command = EC_CMD_GET_COMMS_STATUS;
+	req->data_len = 0;
+	pkt.request_size = sizeof(*req);
+	pkt.send_response = hostcmd_respond_isr;
+	req->checksum = calculate_checksum(req_buf, pkt.request_size);
+	isr_packet_pending = 1;
+	while (isr_packet_pending)
+		msleep(1);
+	TEST_ASSERT(resp->result == EC_RES_SUCCESS);
+	TEST_ASSERT(cs->flags & EC_COMMS_STATUS_PROCESSING);
+
+	/* Another command can't run until that one is done */
+	hostcmd_fill_in_default();
+	hostcmd_send();
+	TEST_ASSERT(resp->result == EC_RES_UNAVAILABLE);
+
+	/* Neither of those may take over the running command's args */
+	msleep(40);
+	TEST_ASSERT(slow_sleep_command == TEST_CMD_SLOW_SLEEP);
+
+	hostcmd_send_empty(EC_CMD_RESEND_RESPONSE);
+	TEST_ASSERT(resp->result == EC_RES_SUCCESS);
+
+	return EC_SUCCESS;
+}
+#endif
+
+static int test_hostcmd_table_sorted(void)
+{
+	const struct host_command *cmd;
+	struct ec_params_get_cmd_versions pv;
+	struct ec_response_get_cmd_versions rv;
+
+	for (cmd = __hcmds; cmd < __hcmds_end; cmd++) {
+		if (cmd > __hcmds)
+			TEST_ASSERT(cmd[-1].command < cmd->command);
+
+		/* Every registered command must be found by lookup */
+		pv.cmd = cmd->command;
+		TEST_ASSERT(test_send_host_command(
+				EC_CMD_GET_CMD_VERSIONS, 0, &pv, sizeof(pv),
+				&rv, sizeof(rv)) == EC_RES_SUCCESS);
+		TEST_ASSERT(rv.version_mask == cmd->version_mask);
+	}
+
+	/* An unregistered command isn't found */
+	pv.cmd = 0xff;
+	TEST_ASSERT(test_send_host_command(EC_CMD_GET_CMD_VERSIONS, 0,
+					   &pv, sizeof(pv), &rv, sizeof(rv)) ==
+		    EC_RES_INVALID_PARAM);
+
+	return EC_SUCCESS;
+}
+
+/* Linear search of the command table, as used before it was sorted */
+static const struct host_command *dumb_find_host_command(int command)
+{
+	const struct host_command *cmd;
+
+	for (cmd = __hcmds; cmd < __hcmds_end; cmd++) {
+		if (command == cmd->command)
+			return cmd;
+	}
+
+	return NULL;
+}
+
+static int test_hostcmd_lookup_speed(void)
+{
+	const struct host_command *cmd;
+	const int iteration = 10000;
+	timestamp_t t0, t1, t2, t3;
+	int i;
+
+	t0 = get_time();
+	for (i = 0; i < iteration; i++) {
+		for (cmd = __hcmds; cmd < __hcmds_end; cmd++)
+			TEST_ASSERT(dumb_find_host_command(cmd->command) ==
+				    cmd);
+	}
+	t1 = get_time();
+	ccprintf(" (%d commands: linear %d us,", __hcmds_end - __hcmds,
+		 (int)(t1.val - t0.val));
+
+	t2 = get_time();
+	for (i = 0; i < iteration; i++) {
+		for (cmd = __hcmds; cmd < __hcmds_end; cmd++)
+			TEST_ASSERT(find_host_command(cmd->command) == cmd);
+	}
+	t3 = get_time();
+	ccprintf(" binary search %d us) ", (int)(t3.val - t2.val));
+
+	return EC_SUCCESS;
+}
+
 void run_test(void)
 {
 	wait_for_task_started();
@@ -180,6 +599,17 @@ void run_test(void)
 	RUN_TEST(test_hostcmd_wrong_command_version);
 	RUN_TEST(test_hostcmd_wrong_struct_version);
 	RUN_TEST(test_hostcmd_invalid_checksum);
+	RUN_TEST(test_hostcmd_batch);
+#ifdef CONFIG_HOST_COMMAND_STATS
+	RUN_TEST(test_hostcmd_stats);
+#endif
+#ifdef CONFIG_HOST_COMMAND_STATUS
+	RUN_TEST(test_hostcmd_resend_response);
+	RUN_TEST(test_hostcmd_batch_slow);
+	RUN_TEST(test_hostcmd_in_progress_slot);
+#endif
+	RUN_TEST(test_hostcmd_table_sorted);
+	RUN_TEST(test_hostcmd_lookup_speed);
 
 	test_print_result();
 }
@@ -163,11 +163,18 @@ int test_fifo_size(void)
 	clear_state();
 	TEST_ASSERT(set_fifo_size(1));
 	TEST_ASSERT(press_key(0, 0, 1) == EC_SUCCESS);
-	TEST_ASSERT(press_key(0, 0, 0) == EC_ERROR_OVERFLOW);
+	/* Full, so the release is merged into the press */
+	TEST_ASSERT(press_key(0, 0, 0) == EC_SUCCESS);
 
 	clear_state();
-	TEST_ASSERT(verify_key(0, 0, 1));
+	TEST_ASSERT(verify_key(0, 0, 0));
+	TEST_ASSERT(FIFO_EMPTY());
+
+	/* Depth 0 means no keyscan output at all */
+	TEST_ASSERT(set_fifo_size(0));
+	TEST_ASSERT(press_key(0, 0, 1) == EC_ERROR_OVERFLOW);
 	TEST_ASSERT(FIFO_EMPTY());
+	press_key(0, 0, 0);
 
 	/* Restore FIFO size */
 	TEST_ASSERT(set_fifo_size(100));
@@ -175,6 +182,85 @@ int test_fifo_size(void)
 	return EC_SUCCESS;
 }
 
+/* Read the FIFO with EC_CMD_MKBP_GET_FIFO, into buf */
+int get_fifo(uint8_t *buf, int size)
+{
+	struct host_cmd_handler_args args;
+
+	args.version = 0;
+	args.command = EC_CMD_MKBP_GET_FIFO;
+	args.params = NULL;
+	args.params_size = 0;
+	args.response = buf;
+	args.response_max = size;
+	args.response_size = 0;
+
+	return host_command_process(&args) == EC_RES_SUCCESS;
+}
+
+int test_fifo_batch(void)
+{
+	uint8_t buf[64];
+	struct ec_response_mkbp_get_fifo *r =
+		(struct ec_response_mkbp_get_fifo *)buf;
+	const int entry_size = sizeof(struct ec_mkbp_fifo_entry) +
+		KEYBOARD_COLS;
+	struct ec_mkbp_fifo_entry *e;
+	int i;
+
+	keyboard_clear_buffer();
+	clear_state();
+	for (i = 0; i < 4; i++)
+		TEST_ASSERT(press_key(i, 1, 1) == EC_SUCCESS);
+
+	/* Only two entries fit; they come out oldest first */
+	TEST_ASSERT(get_fifo(buf, sizeof(*r) + 2 * entry_size + 1));
+	TEST_ASSERT(r->count == 2);
+	TEST_ASSERT(r->remaining == 2);
+	TEST_ASSERT(r->cols == KEYBOARD_COLS);
+	TEST_ASSERT(r->coalesced == 0);
+	TEST_ASSERT(FIFO_NOT_EMPTY());
+
+	clear_state();
+	for (i = 0; i < 2; i++) {
+		e = (struct ec_mkbp_fifo_entry *)(buf + sizeof(*r) +
+						  i * entry_size);
+		set_state(i, 1, 1);
+		TEST_ASSERT_ARRAY_EQ(e->state, state, KEYBOARD_COLS);
+	}
+
+	/* The rest, with timestamps in order */
+	TEST_ASSERT(get_fifo(buf, sizeof(buf)));
+	TEST_ASSERT(r->count == 2);
+	TEST_ASSERT(r->remaining == 0);
+	TEST_ASSERT(FIFO_EMPTY());
+	e = (struct ec_mkbp_fifo_entry *)(buf + sizeof(*r));
+	TEST_ASSERT(e->state[2] == (uint8_t)~(1 << 1));
+	TEST_ASSERT(e->time <=
+		    ((struct ec_mkbp_fifo_entry *)
+		     (buf + sizeof(*r) + entry_size))->time);
+
+	/* Nothing left */
+	TEST_ASSERT(get_fifo(buf, sizeof(buf)));
+	TEST_ASSERT(r->count == 0);
+
+	/* Overflow is merged into the newest entry, and counted */
+	TEST_ASSERT(set_fifo_size(2));
+	for (i = 0; i < 4; i++)
+		TEST_ASSERT(press_key(i, 1, 0) == EC_SUCCESS);
+	TEST_ASSERT(get_fifo(buf, sizeof(buf)));
+	TEST_ASSERT(r->count == 2);
+	TEST_ASSERT(r->coalesced == 2);
+	e = (struct ec_mkbp_fifo_entry *)(buf + sizeof(*r) + entry_size);
+	clear_state();
+	TEST_ASSERT_ARRAY_EQ(e->state, state, KEYBOARD_COLS);
+	TEST_ASSERT(FIFO_EMPTY());
+
+	TEST_ASSERT(set_fifo_size(100));
+
+	return EC_SUCCESS;
+}
+
 int test_enable(void)
 {
 	keyboard_clear_buffer();
@@ -213,6 +299,7 @@ void run_test(void)
 
 	RUN_TEST(single_key_press);
 	RUN_TEST(test_fifo_size);
+	RUN_TEST(test_fifo_batch);
 	RUN_TEST(test_enable);
 	RUN_TEST(fifo_underrun);
 
@@ -31,8 +31,15 @@
 		old = fifo_add_count; \
 	} while (0)
 
+/* Scans to time, and keys to hold or bounce meanwhile, for scan_cost_test */
+#define SCAN_COST_COUNT 1000
+#define SCAN_COST_HELD_KEYS 4
+
+int check_keys_changed(uint8_t *state);
+
 static uint8_t mock_state[KEYBOARD_COLS];
 static int column_driven;
+static int column_drives;	/* Times a single column was driven */
 static int fifo_add_count;
 static int lid_open;
 #ifdef EMU_BUILD
@@ -50,6 +57,8 @@ int lid_is_open(void)
 void keyboard_raw_drive_column(int out)
 {
 	column_driven = out;
+	if (out >= 0)
+		column_drives++;
 }
 
 int keyboard_raw_read_rows(void)
@@ -266,6 +275,141 @@ static int simulate_key_test(void)
 	return EC_SUCCESS;
 }
 
+static int scan_cost_test(void)
+{
+	struct keyboard_scan_config *config = keyboard_scan_get_config();
+	uint16_t settle_us = config->output_settle_us;
+	/* check_keys_changed() works on whole words of the matrix */
+	uint8_t state[(KEYBOARD_COLS + 3) & ~3] __aligned(4);
+	timestamp_t t0, t1;
+	int old_count;
+	int i;
+
+	/* Let the scan task go idle, so it won't scan at the same time */
+	msleep(config->poll_timeout_us / MSEC + NO_KEYDOWN_DELAY_MS);
+	memset(state, 0, sizeof(state));
+	old_count = fifo_add_count;
+
+	/*
+	 * Time only the scan loop's own work, with some keys held and one
+	 * bouncing on every scan, in a row which is already down.
+	 */
+	config->output_settle_us = 0;
+	for (i = 0; i < SCAN_COST_HELD_KEYS; i++)
+		mock_key(i, i + 1, 1);
+
+	column_drives = 0;
+	t0 = get_time();
+	for (i = 0; i < SCAN_COST_COUNT; i++) {
+		mock_state[KEYBOARD_COLS - 1] ^= 1 << 1;
+		check_keys_changed(state);
+	}
+	t1 = get_time();
+	ccprintf(" (scan cost: %d us, %d columns for %d scans) ",
+		 (int)(t1.val - t0.val), column_drives, SCAN_COST_COUNT);
+
+#ifdef CONFIG_KEYBOARD_PARTIAL_SCAN
+	/* Only the active columns, plus a full scan now and then */
+	TEST_ASSERT(column_drives < SCAN_COST_COUNT * KEYBOARD_COLS * 2 / 3);
+#endif
+
+	config->output_settle_us = settle_us;
+
+	/* The bouncing key never settled long enough to be reported */
+	mock_state[KEYBOARD_COLS - 1] = 0;
+	for (i = 0; i < 2 * config->debounce_down_us / MSEC; i++) {
+		check_keys_changed(state);
+		msleep(1);
+	}
+	TEST_ASSERT(state[KEYBOARD_COLS - 1] == 0);
+	for (i = 0; i < SCAN_COST_HELD_KEYS; i++)
+		TEST_ASSERT(state[i + 1] == 1 << i);
+	TEST_ASSERT(fifo_add_count > old_count);
+
+	/* Once everything is released and settled, nothing is left down */
+	memset(mock_state, 0, sizeof(mock_state));
+	for (i = 0; i < 2 * config->debounce_up_us / MSEC; i++) {
+		check_keys_changed(state);
+		msleep(1);
+	}
+	for (i = 0; i < KEYBOARD_COLS; i++)
+		TEST_ASSERT(state[i] == 0);
+
+	return EC_SUCCESS;
+}
+
+#ifdef CONFIG_KEYBOARD_PARTIAL_SCAN
+static int partial_scan_test(void)
+{
+	int old_count = fifo_add_count;
+
+	/* Hold a key, so the scan task stays polling */
+	mock_key(1, 1, 1);
+	TEST_ASSERT(expect_keychange() == EC_SUCCESS);
+
+	/* A key in a new row shows up when all columns are driven */
+	mock_key(3, 4, 1);
+	TEST_ASSERT(expect_keychange() == EC_SUCCESS);
+
+	/* One in a row already down is caught by the periodic full scan */
+	mock_key(1, 9, 1);
+	TEST_ASSERT(expect_keychange() == EC_SUCCESS);
+
+	/* Ghosting between a scanned column and a newly active one */
+	mock_key(3, 1, 1);
+	mock_key(1, 4, 1);
+	TEST_ASSERT(expect_no_keychange() == EC_SUCCESS);
+	mock_key(3, 1, 0);
+	mock_key(1, 4, 0);
+	TEST_ASSERT(expect_no_keychange() == EC_SUCCESS);
+
+	mock_key(1, 9, 0);
+	mock_key(3, 4, 0);
+	mock_key(1, 1, 0);
+	TEST_ASSERT(expect_keychange() == EC_SUCCESS);
+	msleep(NO_KEYDOWN_DELAY_MS);
+	TEST_ASSERT(fifo_add_count - old_count == 4);
+
+	return EC_SUCCESS;
+}
+#endif
+
+static int debounce_chatter_test(void)
+{
+	struct keyboard_scan_config *config = keyboard_scan_get_config();
+	uint8_t state[(KEYBOARD_COLS + 3) & ~3] __aligned(4);
+	timestamp_t t0;
+	int i;
+
+	/* Let the scan task go idle, so it won't scan at the same time */
+	msleep(config->poll_timeout_us / MSEC + NO_KEYDOWN_DELAY_MS);
+	memset(state, 0, sizeof(state));
+
+	/*
+	 * A key chattering on every scan mustn't hold up a key pressed
+	 * cleanly meanwhile, however many scans it takes to debounce.
+	 */
+	mock_key(1, 1, 1);
+	t0 = get_time();
+	while (get_time().val - t0.val < config->debounce_down_us + 2 * MSEC) {
+		mock_state[KEYBOARD_COLS - 1] ^= 1 << 7;
+		check_keys_changed(state);
+		usleep(250);
+	}
+	TEST_ASSERT(state[1] == 1 << 1);
+	TEST_ASSERT(state[KEYBOARD_COLS - 1] == 0);
+
+	memset(mock_state, 0, sizeof(mock_state));
+	for (i = 0; i < 2 * config->debounce_up_us / MSEC; i++) {
+		check_keys_changed(state);
+		msleep(1);
+	}
+	for (i = 0; i < KEYBOARD_COLS; i++)
+		TEST_ASSERT(state[i] == 0);
+
+	return EC_SUCCESS;
+}
+
 #ifdef EMU_BUILD
 static int wait_variable_set(int *var)
 {
@@ -384,6 +528,11 @@ static void run_test_step1(void)
 	RUN_TEST(deghost_test);
 	RUN_TEST(debounce_test);
 	RUN_TEST(simulate_key_test);
+	RUN_TEST(scan_cost_test);
+	RUN_TEST(debounce_chatter_test);
+#ifdef CONFIG_KEYBOARD_PARTIAL_SCAN
+	RUN_TEST(partial_scan_test);
+#endif
 #ifdef EMU_BUILD
 	RUN_TEST(runtime_key_test);
 #endif
@@ -0,0 +1,331 @@
+/* Copyright (c) 2014 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Test printf formatting.
+ */
+
+#include <stdarg.h>
+
+#include "common.h"
+#include "console.h"
+#include "printf.h"
+#include "test_util.h"
+#include "timer.h"
+#include "util.h"
+
+#define BUF_SIZE 64
+
+/* Context for a character-at-a-time sink */
+struct char_sink {
+	char *str;
+	int size;
+};
+
+static int char_sink_addchar(void *context, int c)
+{
+	struct char_sink *sink = context;
+
+	if (!sink->size)
+		return 1;
+	*sink->str++ = c;
+	sink->size--;
+	return 0;
+}
+
+/* Format through vfnprintf(), a character at a time */
+static int charprintf(char *str, int size, const char *format, ...)
+{
+	struct char_sink sink = {str, size - 1};
+	va_list args;
+	int rv;
+
+	va_start(args, format);
+	rv = vfnprintf(char_sink_addchar, &sink, format, args);
+	va_end(args);
+	*sink.str = '\0';
+	return rv;
+}
+
+static int str_eq(const char *s1, const char *s2)
+{
+	int len = strlen(s2);
+
+	return strlen(s1) == len && !memcmp(s1, s2, len);
+}
+
+/*
+ * Check both the batched (snprintf) and character-at-a-time (vfnprintf)
+ * output paths produce the expected string.
+ */
+#define EXPECT(expected, format, args...)				\
+	do {								\
+		char buf[BUF_SIZE];					\
+		TEST_ASSERT(snprintf(buf, sizeof(buf), format, ## args)	\
+			    == EC_SUCCESS);				\
+		TEST_ASSERT(str_eq(buf, expected));			\
+		TEST_ASSERT(charprintf(buf, sizeof(buf), format, ## args) \
+			    == EC_SUCCESS);				\
+		TEST_ASSERT(str_eq(buf, expected));			\
+	} while (0)
+
+static int test_integers(void)
+{
+	EXPECT("0", "%d", 0);
+	EXPECT("7", "%d", 7);
+	EXPECT("-1", "%d", -1);
+	EXPECT("1234567890", "%d", 1234567890);
+	EXPECT("-2147483648", "%d", (int)0x80000000);
+	EXPECT("4294967295", "%u", 0xffffffff);
+	EXPECT("18446744073709551615", "%lu", 0xffffffffffffffffULL);
+	EXPECT("-9223372036854775808", "%ld", 0x8000000000000000ULL);
+	EXPECT("-1234567890123", "%ld", -1234567890123LL);
+	EXPECT("4294967296", "%lu", 0x100000000ULL);
+	EXPECT("deadbeef", "%x", 0xdeadbeef);
+	EXPECT("DEADBEEF", "%X", 0xdeadbeef);
+	EXPECT("123456789abcdef0", "%lx", 0x123456789abcdef0ULL);
+	EXPECT("101", "%b", 5);
+	EXPECT("00001234", "%08x", 0x1234);
+	EXPECT("   42|", "%5d|", 42);
+	EXPECT("42   |", "%-5d|", 42);
+	EXPECT("00042", "%05d", 42);
+	EXPECT("  -42", "%*d", 5, -42);
+
+	return EC_SUCCESS;
+}
+
+static int test_fixed_point(void)
+{
+	EXPECT("0.000123", "%.6d", 123);
+	EXPECT("1.234567", "%.6d", 1234567);
+	EXPECT("-1.5", "%.1d", -15);
+	EXPECT("12.3  |", "%-6.1d|", 123);
+	EXPECT("1234567.890123", "%.6ld", 1234567890123ULL);
+	EXPECT("0.00", "%.*d", 2, 0);
+
+	return EC_SUCCESS;
+}
+
+static int test_strings(void)
+{
+	EXPECT("hello world", "hello %s", "world");
+	EXPECT("(NULL)", "%s", NULL);
+	EXPECT("[   ab]", "[%5s]", "ab");
+	EXPECT("[ab   ]", "[%-5s]", "ab");
+	EXPECT("[abc]", "[%.3s]", "abcdef");
+	EXPECT("[ab]", "[%-5.2s]", "abcd");
+	EXPECT("x=y", "%c=%c", 'x', 'y');
+	EXPECT("100%", "100%%");
+	EXPECT("tail%", "tail%");
+	EXPECT("12ab", "%.2h", "\x12\xab");
+	EXPECT("a ERROR", "a %q b");
+	EXPECT("                    x",
+	       "%*s", 21, "x");
+
+	return EC_SUCCESS;
+}
+
+static int test_truncation(void)
+{
+	char buf[8];
+
+	TEST_ASSERT(snprintf(buf, sizeof(buf), "%s", "0123456789") ==
+		    EC_ERROR_OVERFLOW);
+	TEST_ASSERT(str_eq(buf, "0123456"));
+	TEST_ASSERT(snprintf(buf, sizeof(buf), "abc%10d", 5) ==
+		    EC_ERROR_OVERFLOW);
+	TEST_ASSERT(str_eq(buf, "abc    "));
+	TEST_ASSERT(snprintf(buf, sizeof(buf), "%d", 1234567) == EC_SUCCESS);
+	TEST_ASSERT(str_eq(buf, "1234567"));
+
+	return EC_SUCCESS;
+}
+
+/* Decimal conversion the way vfnprintf() used to do it */
+static void dumb_ulltoa(char *buf, uint64_t v)
+{
+	char tmp[21];
+	char *s = tmp + sizeof(tmp);
+
+	*--s = '\0';
+	if (!v)
+		*--s = '0';
+	while (v)
+		*--s = '0' + uint64divmod(&v, 10);
+	memcpy(buf, s, tmp + sizeof(tmp) - s);
+}
+
+static int test_decimal_speed(void)
+{
+	timestamp_t t0, t1, t2, t3;
+	const int iteration = 2000;
+	char buf[BUF_SIZE], buf2[BUF_SIZE];
+	uint64_t v = 1412345678901ULL;  /* A typical timestamp */
+	int i;
+
+	t0 = get_time();
+	for (i = 0; i < iteration; i++)
+		dumb_ulltoa(buf, v + i);
+	t1 = get_time();
+	t2 = get_time();
+	for (i = 0; i < iteration; i++)
+		snprintf(buf2, sizeof(buf2), "%lu", v + i);
+	t3 = get_time();
+	TEST_ASSERT(str_eq(buf, buf2));
+	ccprintf(" (speed gain: %d -> %d us, %d ops/s) ",
+		 t1.val - t0.val, t3.val - t2.val,
+		 (int)(iteration * 1000000ULL / MAX(t3.val - t2.val, 1)));
+
+	return EC_SUCCESS;
+}
+
+/*
+ * Formatting the way vfnprintf() used to do it: a character per call, and a
+ * 64-bit division per digit.  Only handles what test_output_speed() uses.
+ */
+static int dumb_vfnprintf(int (*addchar)(void *context, int c),
+			  void *context, const char *format, va_list args)
+{
+	char intbuf[34];
+	int left, padzero, negative, is64;
+	int pad_width, precision;
+	char *vstr;
+	int vlen;
+
+	while (*format) {
+		int c = *format++;
+
+		if (c != '%') {
+			if (addchar(context, c))
+				return EC_ERROR_OVERFLOW;
+			continue;
+		}
+
+		left = padzero = negative = is64 = 0;
+		c = *format++;
+		if (c == '-') {
+			left = 1;
+			c = *format++;
+		}
+		if (c == '0') {
+			padzero = 1;
+			c = *format++;
+		}
+		for (pad_width = 0; c >= '0' && c <= '9'; c = *format++)
+			pad_width = 10 * pad_width + c - '0';
+		precision = 0;
+		if (c == '.') {
+			for (c = *format++; c >= '0' && c <= '9';
+			     c = *format++)
+				precision = 10 * precision + c - '0';
+		}
+
+		if (c == 's') {
+			vstr = va_arg(args, char *);
+		} else {
+			uint64_t v;
+
+			if (c == 'l') {
+				is64 = 1;
+				c = *format++;
+			}
+			v = is64 ? va_arg(args, uint64_t) :
+				va_arg(args, uint32_t);
+			if (c == 'd' && (is64 ? (int64_t)v < 0 : (int)v < 0)) {
+				negative = 1;
+				v = is64 ? -v : -(int)v;
+			}
+
+			vstr = intbuf + sizeof(intbuf) - 1;
+			*vstr = '\0';
+			for (vlen = 0; vlen < precision; vlen++)
+				*(--vstr) = '0' + uint64divmod(&v, 10);
+			if (precision)
+				*(--vstr) = '.';
+			if (!v)
+				*(--vstr) = '0';
+			while (v)
+				*(--vstr) = '0' + uint64divmod(&v, 10);
+			if (negative)
+				*(--vstr) = '-';
+			precision = 0;
+		}
+
+		vlen = strlen(vstr);
+		if (precision > 0 && pad_width > precision)
+			pad_width = precision;
+		if (!precision)
+			precision = MAX(vlen, pad_width);
+
+		while (vlen < pad_width && !left) {
+			if (addchar(context, padzero ? '0' : ' '))
+				return EC_ERROR_OVERFLOW;
+			vlen++;
+		}
+		while (*vstr && --precision >= 0)
+			if (addchar(context, *vstr++))
+				return EC_ERROR_OVERFLOW;
+		while (vlen < pad_width && left) {
+			if (addchar(context, ' '))
+				return EC_ERROR_OVERFLOW;
+			vlen++;
+		}
+	}
+
+	return EC_SUCCESS;
+}
+
+/* snprintf() the way it used to be */
+static int dumb_snprintf(char *str, int size, const char *format, ...)
+{
+	struct char_sink sink = {str, size - 1};
+	va_list args;
+	int rv;
+
+	va_start(args, format);
+	rv = dumb_vfnprintf(char_sink_addchar, &sink, format, args);
+	va_end(args);
+	*sink.str = '\0';
+	return rv;
+}
+
+static int test_output_speed(void)
+{
+	static const char format[] = "[%.6ld ACC base=%-5d, %-5d, %-5d %s]\n";
+	timestamp_t t0, t1, t2, t3;
+	const int iteration = 2000;
+	char buf[BUF_SIZE], buf2[BUF_SIZE];
+	int i;
+
+	/* The old implementation, then the current one */
+	t0 = get_time();
+	for (i = 0; i < iteration; i++)
+		dumb_snprintf(buf, sizeof(buf), format, 1412345678901ULL, i,
+			      -i, 1000, "lid");
+	t1 = get_time();
+	t2 = get_time();
+	for (i = 0; i < iteration; i++)
+		snprintf(buf2, sizeof(buf2), format, 1412345678901ULL, i,
+			 -i, 1000, "lid");
+	t3 = get_time();
+	TEST_ASSERT(str_eq(buf, buf2));
+	ccprintf(" (speed gain: %d -> %d us, %d ops/s) ",
+		 t1.val - t0.val, t3.val - t2.val,
+		 (int)(iteration * 1000000ULL / MAX(t3.val - t2.val, 1)));
+
+	return EC_SUCCESS;
+}
+
+void run_test(void)
+{
+	test_reset();
+
+	RUN_TEST(test_integers);
+	RUN_TEST(test_fixed_point);
+	RUN_TEST(test_strings);
+	RUN_TEST(test_truncation);
+	RUN_TEST(test_decimal_speed);
+	RUN_TEST(test_output_speed);
+
+	test_print_result();
+}
@@ -12,19 +12,11 @@
 #include "timer.h"
 #include "util.h"
 
-static char buffer6[6];  /* Max 5 items in queue */
-static struct queue test_queue6 = {
-	.buf_bytes  = sizeof(buffer6),
-	.unit_bytes = sizeof(char),
-	.buf        = buffer6,
-};
+static char buffer8[8];  /* Max 8 items in queue */
+static struct queue test_queue8 = QUEUE(buffer8);
 
-static char buffer5[5];  /* Max 2 items (2 byte for each) in queue */
-static struct queue test_queue5 = {
-	.buf_bytes  = sizeof(buffer5),
-	.unit_bytes = 2,
-	.buf        = buffer5,
-};
+static uint16_t buffer2[2];  /* Max 2 items (2 byte for each) in queue */
+static struct queue test_queue2 = QUEUE(buffer2);
 
 #define LOOP_DEQUE(q, d, n) \
 	do { \
@@ -33,121 +25,277 @@ static struct queue test_queue5 = {
 			TEST_ASSERT(queue_remove_unit(&q, d + i)); \
 	} while (0)
 
-static int test_queue6_empty(void)
+static int test_queue8_empty(void)
 {
 	char dummy = 1;
 
-	queue_reset(&test_queue6);
-	TEST_ASSERT(queue_is_empty(&test_queue6));
-	TEST_ASSERT(!queue_remove_unit(&test_queue6, &dummy));
-	queue_add_units(&test_queue6, &dummy, 1);
-	TEST_ASSERT(!queue_is_empty(&test_queue6));
+	queue_reset(&test_queue8);
+	TEST_ASSERT(queue_is_empty(&test_queue8));
+	TEST_ASSERT(!queue_remove_unit(&test_queue8, &dummy));
+	queue_add_units(&test_queue8, &dummy, 1);
+	TEST_ASSERT(!queue_is_empty(&test_queue8));
 
 	return EC_SUCCESS;
 }
 
-static int test_queue6_reset(void)
+static int test_queue8_reset(void)
 {
 	char dummy = 1;
 
-	queue_reset(&test_queue6);
-	queue_add_units(&test_queue6, &dummy, 1);
-	queue_reset(&test_queue6);
-	TEST_ASSERT(queue_is_empty(&test_queue6));
+	queue_reset(&test_queue8);
+	queue_add_units(&test_queue8, &dummy, 1);
+	queue_reset(&test_queue8);
+	TEST_ASSERT(queue_is_empty(&test_queue8));
 
 	return EC_SUCCESS;
 }
 
-static int test_queue6_fifo(void)
+static int test_queue8_fifo(void)
 {
 	char buf1[3] = {1, 2, 3};
 	char buf2[3];
 
-	queue_reset(&test_queue6);
+	queue_reset(&test_queue8);
 
-	queue_add_units(&test_queue6, buf1 + 0, 1);
-	queue_add_units(&test_queue6, buf1 + 1, 1);
-	queue_add_units(&test_queue6, buf1 + 2, 1);
+	queue_add_units(&test_queue8, buf1 + 0, 1);
+	queue_add_units(&test_queue8, buf1 + 1, 1);
+	queue_add_units(&test_queue8, buf1 + 2, 1);
 
-	LOOP_DEQUE(test_queue6, buf2, 3);
+	LOOP_DEQUE(test_queue8, buf2, 3);
 	TEST_ASSERT_ARRAY_EQ(buf1, buf2, 3);
 
 	return EC_SUCCESS;
 }
 
-static int test_queue6_multiple_units_add(void)
+static int test_queue8_multiple_units_add(void)
 {
 	char buf1[5] = {1, 2, 3, 4, 5};
 	char buf2[5];
 
-	queue_reset(&test_queue6);
-	TEST_ASSERT(queue_has_space(&test_queue6, 5));
-	queue_add_units(&test_queue6, buf1, 5);
-	LOOP_DEQUE(test_queue6, buf2, 5);
+	queue_reset(&test_queue8);
+	TEST_ASSERT(queue_has_space(&test_queue8, 5));
+	queue_add_units(&test_queue8, buf1, 5);
+	LOOP_DEQUE(test_queue8, buf2, 5);
 	TEST_ASSERT_ARRAY_EQ(buf1, buf2, 5);
 
 	return EC_SUCCESS;
 }
 
-static int test_queue6_removal(void)
+static int test_queue8_removal(void)
 {
-	char buf1[5] = {1, 2, 3, 4, 5};
-	char buf2[5];
+	char buf1[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+	char buf2[8];
+
+	queue_reset(&test_queue8);
+	queue_add_units(&test_queue8, buf1, 8);
+	/* 1, 2, 3, 4, 5, 6, 7, 8 */
+	TEST_ASSERT(!queue_has_space(&test_queue8, 1));
+	LOOP_DEQUE(test_queue8, buf2, 6);
+	TEST_ASSERT_ARRAY_EQ(buf1, buf2, 6);
+	/* 7, 8 */
+	queue_add_units(&test_queue8, buf1, 5);
+	/* 7, 8, 1, 2, 3, 4, 5 */
+	TEST_ASSERT(queue_has_space(&test_queue8, 1));
+	TEST_ASSERT(!queue_has_space(&test_queue8, 2));
+	LOOP_DEQUE(test_queue8, buf2, 1);
+	TEST_ASSERT(buf2[0] == 7);
+	/* 8, 1, 2, 3, 4, 5 */
+	queue_add_units(&test_queue8, buf1 + 5, 2);
+	/* 8, 1, 2, 3, 4, 5, 6, 7 */
+	TEST_ASSERT(!queue_has_space(&test_queue8, 1));
+	LOOP_DEQUE(test_queue8, buf2, 1);
+	TEST_ASSERT(buf2[0] == 8);
+	LOOP_DEQUE(test_queue8, buf2, 7);
+	TEST_ASSERT_ARRAY_EQ(buf1, buf2, 7);
+	TEST_ASSERT(queue_is_empty(&test_queue8));
+	/* Empty */
+	queue_add_units(&test_queue8, buf1, 8);
+	LOOP_DEQUE(test_queue8, buf2, 8);
+	TEST_ASSERT_ARRAY_EQ(buf1, buf2, 8);
+
+	return EC_SUCCESS;
+}
+
+static int test_queue8_full(void)
+{
+	char buf1[9] = {1, 2, 3, 4, 5, 6, 7, 8, 9};
+	char buf2[8];
+
+	queue_reset(&test_queue8);
+	/* Adding more than fits adds nothing */
+	TEST_ASSERT(queue_add_units(&test_queue8, buf1, 9) == 0);
+	TEST_ASSERT(queue_is_empty(&test_queue8));
+	TEST_ASSERT(queue_add_units(&test_queue8, buf1, 3) == 3);
+	TEST_ASSERT(queue_add_units(&test_queue8, buf1 + 3, 6) == 0);
+	TEST_ASSERT(queue_add_units(&test_queue8, buf1 + 3, 5) == 5);
+	TEST_ASSERT(queue_count(&test_queue8) == 8);
+	TEST_ASSERT(queue_space(&test_queue8) == 0);
+	TEST_ASSERT(queue_remove_units(&test_queue8, buf2, 8) == 8);
+	TEST_ASSERT_ARRAY_EQ(buf1, buf2, 8);
 
-	queue_reset(&test_queue6);
-	queue_add_units(&test_queue6, buf1, 5);
-	/* 1, 2, 3, 4, 5 */
-	LOOP_DEQUE(test_queue6, buf2, 3);
+	return EC_SUCCESS;
+}
+
+static int test_queue8_bulk_wrap(void)
+{
+	char buf1[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+	char buf2[8];
+	int i;
+
+	/* Walk the head through every position so copies wrap every way */
+	queue_reset(&test_queue8);
+	for (i = 0; i < 8; i++) {
+		TEST_ASSERT(queue_add_units(&test_queue8, buf1, 8) == 8);
+		TEST_ASSERT(queue_remove_units(&test_queue8, buf2, 8) == 8);
+		TEST_ASSERT_ARRAY_EQ(buf1, buf2, 8);
+		TEST_ASSERT(queue_add_units(&test_queue8, buf1, 1) == 1);
+		TEST_ASSERT(queue_remove_units(&test_queue8, buf2, 8) == 1);
+		TEST_ASSERT(buf2[0] == 1);
+	}
+
+	/* Short remove returns what is there */
+	TEST_ASSERT(queue_add_units(&test_queue8, buf1, 3) == 3);
+	TEST_ASSERT(queue_remove_units(&test_queue8, buf2, 5) == 3);
 	TEST_ASSERT_ARRAY_EQ(buf1, buf2, 3);
-	/* 4, 5 */
-	queue_add_units(&test_queue6, buf1, 2);
-	/* 4, 5, 1, 2 */
-	TEST_ASSERT(queue_has_space(&test_queue6, 1));
-	TEST_ASSERT(!queue_has_space(&test_queue6, 2));
-	LOOP_DEQUE(test_queue6, buf2, 1);
-	TEST_ASSERT(buf2[0] == 4);
-	/* 5, 1, 2 */
-	queue_add_units(&test_queue6, buf1 + 2, 2);
-	/* 5, 1, 2, 3, 4 */
-	TEST_ASSERT(!queue_has_space(&test_queue6, 1));
-	LOOP_DEQUE(test_queue6, buf2, 1);
+	TEST_ASSERT(queue_remove_units(&test_queue8, buf2, 5) == 0);
+
+	/* NULL destination discards */
+	TEST_ASSERT(queue_add_units(&test_queue8, buf1, 6) == 6);
+	TEST_ASSERT(queue_remove_units(&test_queue8, NULL, 4) == 4);
+	TEST_ASSERT(queue_remove_unit(&test_queue8, buf2));
 	TEST_ASSERT(buf2[0] == 5);
-	LOOP_DEQUE(test_queue6, buf2, 4);
-	TEST_ASSERT_ARRAY_EQ(buf1, buf2, 4);
-	TEST_ASSERT(queue_is_empty(&test_queue6));
-	/* Empty */
-	queue_add_units(&test_queue6, buf1, 5);
-	LOOP_DEQUE(test_queue6, buf2, 5);
-	TEST_ASSERT_ARRAY_EQ(buf1, buf2, 5);
+	TEST_ASSERT(queue_count(&test_queue8) == 1);
+
+	return EC_SUCCESS;
+}
+
+static int test_queue8_peek(void)
+{
+	char buf1[6] = {1, 2, 3, 4, 5, 6};
+	char buf2[6];
+
+	queue_reset(&test_queue8);
+	/* Put the data across the end of the buffer */
+	queue_add_units(&test_queue8, buf1, 5);
+	queue_remove_units(&test_queue8, NULL, 5);
+	queue_add_units(&test_queue8, buf1, 6);
+
+	TEST_ASSERT(queue_peek_units(&test_queue8, buf2, 0, 6) == 6);
+	TEST_ASSERT_ARRAY_EQ(buf1, buf2, 6);
+	TEST_ASSERT(queue_peek_units(&test_queue8, buf2, 2, 8) == 4);
+	TEST_ASSERT_ARRAY_EQ(buf1 + 2, buf2, 4);
+	TEST_ASSERT(queue_peek_units(&test_queue8, buf2, 6, 1) == 0);
+	TEST_ASSERT(queue_peek_units(&test_queue8, buf2, 7, 1) == 0);
+
+	/* Peeking leaves the queue alone */
+	TEST_ASSERT(queue_count(&test_queue8) == 6);
+	TEST_ASSERT(queue_remove_units(&test_queue8, buf2, 6) == 6);
+	TEST_ASSERT_ARRAY_EQ(buf1, buf2, 6);
 
 	return EC_SUCCESS;
 }
 
-static int test_queue5_odd_even(void)
+static int test_queue2_odd_even(void)
 {
 	uint16_t buf1[3] = {1, 2, 3};
 	uint16_t buf2[3];
 
-	queue_reset(&test_queue5);
-	queue_add_units(&test_queue5, buf1, 1);
+	queue_reset(&test_queue2);
+	queue_add_units(&test_queue2, buf1, 1);
 	/* 1 */
-	TEST_ASSERT(!queue_has_space(&test_queue5, 2));
-	TEST_ASSERT(queue_has_space(&test_queue5, 1));
-	queue_add_units(&test_queue5, buf1 + 1, 1);
+	TEST_ASSERT(!queue_has_space(&test_queue2, 2));
+	TEST_ASSERT(queue_has_space(&test_queue2, 1));
+	queue_add_units(&test_queue2, buf1 + 1, 1);
 	/* 1, 2 */
-	TEST_ASSERT(!queue_has_space(&test_queue5, 1));
-	LOOP_DEQUE(test_queue5, buf2, 2);
+	TEST_ASSERT(!queue_has_space(&test_queue2, 1));
+	LOOP_DEQUE(test_queue2, buf2, 2);
 	TEST_ASSERT_ARRAY_EQ(buf1, buf2, 2);
-	TEST_ASSERT(queue_is_empty(&test_queue5));
+	TEST_ASSERT(queue_is_empty(&test_queue2));
 	/* Empty */
-	TEST_ASSERT(!queue_has_space(&test_queue5, 3));
-	TEST_ASSERT(queue_has_space(&test_queue5, 2));
-	TEST_ASSERT(queue_has_space(&test_queue5, 1));
-	queue_add_units(&test_queue5, buf1 + 2, 1);
+	TEST_ASSERT(!queue_has_space(&test_queue2, 3));
+	TEST_ASSERT(queue_has_space(&test_queue2, 2));
+	TEST_ASSERT(queue_has_space(&test_queue2, 1));
+	queue_add_units(&test_queue2, buf1 + 2, 1);
 	/* 3 */
-	LOOP_DEQUE(test_queue5, buf2, 1);
+	LOOP_DEQUE(test_queue2, buf2, 1);
 	TEST_ASSERT(buf2[0] == 3);
-	TEST_ASSERT(queue_is_empty(&test_queue5));
+	TEST_ASSERT(queue_is_empty(&test_queue2));
+
+	return EC_SUCCESS;
+}
+
+/*
+ * Reference byte-at-a-time queue, as this used to be implemented, for the
+ * throughput comparison below.  One byte of the buffer is always unused.
+ */
+struct dumb_queue {
+	int head, tail;
+	int buf_bytes;
+	uint8_t *buf;
+};
+
+static void dumb_queue_add(struct dumb_queue *q, const uint8_t *s, int len)
+{
+	for (; len; len--) {
+		q->buf[q->tail++] = *(s++);
+		q->tail %= q->buf_bytes;
+	}
+}
+
+static int dumb_queue_remove(struct dumb_queue *q, uint8_t *d)
+{
+	if (q->head == q->tail)
+		return 0;
+	*d = q->buf[q->head++];
+	q->head %= q->buf_bytes;
+	return 1;
+}
+
+static uint8_t dumb_buffer[256 + 1];
+static uint8_t bench_buffer[256];
+static struct queue bench_queue = QUEUE(bench_buffer);
+
+static int test_queue_throughput(void)
+{
+	struct dumb_queue dq = {
+		.buf_bytes = sizeof(dumb_buffer),
+		.buf = dumb_buffer,
+	};
+	/* Odd chunk size so the copies wrap at every offset */
+	uint8_t src[47], dest[47];
+	timestamp_t t0, t1, t2, t3;
+	const int iteration = 5000;
+	int i, j;
+
+	for (i = 0; i < sizeof(src); i++)
+		src[i] = i;
+
+	t0 = get_time();
+	for (i = 0; i < iteration; i++) {
+		dumb_queue_add(&dq, src, sizeof(src));
+		for (j = 0; j < sizeof(dest); j++)
+			dumb_queue_remove(&dq, dest + j);
+	}
+	t1 = get_time();
+	TEST_ASSERT_ARRAY_EQ(src, dest, sizeof(src));
+	ccprintf(" (speed gain: %d ->", t1.val - t0.val);
+
+	memset(dest, 0, sizeof(dest));
+	queue_reset(&bench_queue);
+	t2 = get_time();
+	for (i = 0; i < iteration; i++) {
+		queue_add_units(&bench_queue, src, sizeof(src));
+		queue_remove_units(&bench_queue, dest, sizeof(dest));
+	}
+	t3 = get_time();
+	ccprintf(" %d us) ", t3.val - t2.val);
+	TEST_ASSERT_ARRAY_EQ(src, dest, sizeof(src));
+	TEST_ASSERT(queue_is_empty(&bench_queue));
+
+#ifndef EMU_BUILD
+	/* Bulk copies should beat a modulo per byte by a wide margin */
+	TEST_ASSERT((t1.val - t0.val) > (t3.val - t2.val) * 4);
+#endif
 
 	return EC_SUCCESS;
 }
@@ -156,12 +304,16 @@ void run_test(void)
 {
 	test_reset();
 
-	RUN_TEST(test_queue6_empty);
-	RUN_TEST(test_queue6_reset);
-	RUN_TEST(test_queue6_fifo);
-	RUN_TEST(test_queue6_multiple_units_add);
-	RUN_TEST(test_queue6_removal);
-	RUN_TEST(test_queue5_odd_even);
+	RUN_TEST(test_queue8_empty);
+	RUN_TEST(test_queue8_reset);
+	RUN_TEST(test_queue8_fifo);
+	RUN_TEST(test_queue8_multiple_units_add);
+	RUN_TEST(test_queue8_removal);
+	RUN_TEST(test_queue8_full);
+	RUN_TEST(test_queue8_bulk_wrap);
+	RUN_TEST(test_queue8_peek);
+	RUN_TEST(test_queue2_odd_even);
+	RUN_TEST(test_queue_throughput);
 
 	test_print_result();
 }
@@ -0,0 +1,177 @@
+/* Copyright (c) 2014 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Tests for SHA-256 library.
+ */
+
+#include "common.h"
+#include "console.h"
+#include "sha256.h"
+#include "test_util.h"
+#include "timer.h"
+#include "util.h"
+
+/* Test vectors from FIPS 180-2 */
+static const uint8_t abc_digest[SHA256_DIGEST_SIZE] = {
+	0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea,
+	0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
+	0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c,
+	0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad,
+};
+
+static const char two_block[] =
+	"abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+
+static const uint8_t two_block_digest[SHA256_DIGEST_SIZE] = {
+	0x24, 0x8d, 0x6a, 0x61, 0xd2, 0x06, 0x38, 0xb8,
+	0xe5, 0xc0, 0x26, 0x93, 0x0c, 0x3e, 0x60, 0x39,
+	0xa3, 0x3c, 0xe4, 0x59, 0x64, 0xff, 0x21, 0x67,
+	0xf6, 0xec, 0xed, 0xd4, 0x19, 0xdb, 0x06, 0xc1,
+};
+
+/* One million 'a' */
+static const uint8_t million_a_digest[SHA256_DIGEST_SIZE] = {
+	0xcd, 0xc7, 0x6e, 0x5c, 0x99, 0x14, 0xfb, 0x92,
+	0x81, 0xa1, 0xc7, 0xe2, 0x84, 0xd7, 0x3e, 0x67,
+	0xf1, 0x80, 0x9a, 0x48, 0xa4, 0x97, 0x20, 0x0e,
+	0x04, 0x6d, 0x39, 0xcc, 0xc7, 0x11, 0x2c, 0xd0,
+};
+
+static struct sha256_ctx ctx;
+static uint8_t buf[1024 + 4];
+
+static int check_digest(const uint8_t *expect)
+{
+	const uint8_t *digest = SHA256_final(&ctx);
+
+	TEST_ASSERT_ARRAY_EQ(digest, expect, SHA256_DIGEST_SIZE);
+	return EC_SUCCESS;
+}
+
+static int test_vectors(void)
+{
+	SHA256_init(&ctx);
+	SHA256_update(&ctx, (const uint8_t *)"abc", 3);
+	TEST_ASSERT(check_digest(abc_digest) == EC_SUCCESS);
+
+	SHA256_init(&ctx);
+	SHA256_update(&ctx, (const uint8_t *)two_block, strlen(two_block));
+	TEST_ASSERT(check_digest(two_block_digest) == EC_SUCCESS);
+
+	return EC_SUCCESS;
+}
+
+/* Feed a million 'a' in pieces of the given size, from the given alignment */
+static int hash_million_a(int piece, int align)
+{
+	int left = 1000000;
+	int n;
+
+	memset(buf, 'a', sizeof(buf));
+
+	SHA256_init(&ctx);
+	while (left) {
+		n = MIN(left, piece);
+		SHA256_update(&ctx, buf + align, n);
+		left -= n;
+	}
+
+	return check_digest(million_a_digest);
+}
+
+static int test_pieces(void)
+{
+	static const int pieces[] = {1, 3, 63, 64, 65, 128, 1000, 1024};
+	int i, align;
+
+	for (i = 0; i < ARRAY_SIZE(pieces); i++)
+		for (align = 0; align < 4; align++)
+			TEST_ASSERT(hash_million_a(pieces[i], align) ==
+				    EC_SUCCESS);
+
+	return EC_SUCCESS;
+}
+
+static int test_unaligned(void)
+{
+	uint8_t expect[SHA256_DIGEST_SIZE];
+	int i, align;
+
+	for (i = 0; i < 1024; i++)
+		buf[i] = i * 13 + (i >> 8);
+
+	SHA256_init(&ctx);
+	SHA256_update(&ctx, buf, 1024);
+	memcpy(expect, SHA256_final(&ctx), SHA256_DIGEST_SIZE);
+
+	/* Same data at every alignment gives the same digest */
+	for (align = 1; align < 4; align++) {
+		memmove(buf + align, buf + align - 1, 1024);
+		SHA256_init(&ctx);
+		SHA256_update(&ctx, buf + align, 1024);
+		TEST_ASSERT(check_digest(expect) == EC_SUCCESS);
+	}
+
+	return EC_SUCCESS;
+}
+
+#ifdef EMU_BUILD
+/* Host cycle counter, where there is one */
+static uint64_t cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __builtin_ia32_rdtsc();
+#else
+	return 0;
+#endif
+}
+#endif
+
+static int test_speed(void)
+{
+	const int kbytes = 256;
+	timestamp_t t0, t1;
+	int i;
+#ifdef EMU_BUILD
+	uint64_t c0, c1;
+#endif
+
+	for (i = 0; i < 1024; i++)
+		buf[i] = i;
+
+	SHA256_init(&ctx);
+	t0 = get_time();
+#ifdef EMU_BUILD
+	c0 = cycles();
+#endif
+	for (i = 0; i < kbytes; i++)
+		SHA256_update(&ctx, buf, 1024);
+	SHA256_final(&ctx);
+#ifdef EMU_BUILD
+	c1 = cycles();
+#endif
+	t1 = get_time();
+
+	ccprintf(" (%d KB in %d us", kbytes, (int)(t1.val - t0.val));
+#ifdef EMU_BUILD
+	if (c1 != c0)
+		ccprintf(", %d cycles/byte",
+			 (int)((c1 - c0) / (kbytes * 1024)));
+#endif
+	ccprintf(") ");
+
+	return EC_SUCCESS;
+}
+
+void run_test(void)
+{
+	test_reset();
+
+	RUN_TEST(test_vectors);
+	RUN_TEST(test_pieces);
+	RUN_TEST(test_unaligned);
+	RUN_TEST(test_speed);
+
+	test_print_result();
+}
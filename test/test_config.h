@@ -28,6 +28,12 @@
 #define CONFIG_BACKLIGHT_REQ_GPIO GPIO_PCH_BKLTEN
 #endif
 
+#ifdef TEST_HOST_COMMAND
+#define CONFIG_HOST_COMMAND_STATS 64
+#define CONFIG_HOST_COMMAND_STATUS
+#define CONFIG_FLASH_VOLATILE
+#endif
+
 #ifdef TEST_KB_8042
 #define CONFIG_KEYBOARD_PROTOCOL_8042
 #endif
@@ -38,6 +44,7 @@
 
 #ifdef TEST_KB_SCAN
 #define CONFIG_KEYBOARD_PROTOCOL_MKBP
+#define CONFIG_KEYBOARD_PARTIAL_SCAN
 #endif
 
 #ifdef TEST_LED_SPRING
@@ -112,5 +119,20 @@ int board_discharge_on_ac(int enabled);
 #define I2C_PORT_CHARGER 1
 #endif
 
+#ifdef TEST_CONSOLE_EDIT
+#define CONFIG_CONSOLE_DEFERRED
+#define CONFIG_CONSOLE_TAB_COMPLETION
+#endif
+
+#ifdef TEST_SHA256
+#define CONFIG_SHA256
+#define CONFIG_SHA256_UNROLLED
+#endif
+
+#ifdef TEST_VBOOT_HASH
+#define CONFIG_VBOOT_HASH
+#define CONFIG_VBOOT_HASH_CACHE
+#endif
+
 #endif  /* TEST_BUILD */
 #endif  /* __CROS_EC_TEST_CONFIG_H */
@@ -0,0 +1,116 @@
+/* Copyright (c) 2014 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Test UART transmit buffering.
+ */
+
+#include "common.h"
+#include "console.h"
+#include "test_util.h"
+#include "timer.h"
+#include "uart.h"
+#include "util.h"
+
+static const char line[] =
+	"0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ\n";
+
+/* Exact match, so CRLF translation is checked too */
+static int captured_is(const char *expected)
+{
+	const char *captured = test_get_captured_console();
+	int len = strlen(expected);
+
+	return strlen(captured) == len && !memcmp(captured, expected, len);
+}
+
+static int test_crlf(void)
+{
+	test_capture_console(1);
+	TEST_ASSERT(uart_puts("a\nbc\n\nd") == EC_SUCCESS);
+	TEST_ASSERT(uart_put("\nxyz", 2) == EC_SUCCESS);
+	uart_flush_output();
+	test_capture_console(0);
+	TEST_ASSERT(captured_is("a\r\nbc\r\n\r\nd\r\nx"));
+
+	return EC_SUCCESS;
+}
+
+static int test_printf_batch(void)
+{
+	/* Longer than one printf batch, with newlines across the boundary */
+	test_capture_console(1);
+	uart_printf("%s%d\n%s", line, 12345, "end\n");
+	uart_flush_output();
+	test_capture_console(0);
+	TEST_ASSERT(captured_is("0123456789abcdefghijklmnopqrstuvwxyz"
+				"ABCDEFGHIJKLMNOPQRSTUVWXYZ\r\n"
+				"12345\r\nend\r\n"));
+
+	return EC_SUCCESS;
+}
+
+static int test_buffer_wrap(void)
+{
+	const char *captured;
+	int i, j;
+
+	/* Enough output to wrap the transmit buffer several times */
+	for (i = 0; i < 4; i++) {
+		test_capture_console(1);
+		for (j = 0; j < 5; j++)
+			uart_puts(line);
+		uart_flush_output();
+		test_capture_console(0);
+
+		captured = test_get_captured_console();
+		TEST_ASSERT(strlen(captured) == 5 * sizeof(line));
+		for (j = 0; j < 5; j++) {
+			TEST_ASSERT_ARRAY_EQ(captured, line, sizeof(line) - 2);
+			captured += sizeof(line) - 2;
+			TEST_ASSERT(captured[0] == '\r' && captured[1] == '\n');
+			captured += 2;
+		}
+	}
+
+	return EC_SUCCESS;
+}
+
+static int test_full_rate(void)
+{
+	timestamp_t t0, t1, t2, t3;
+	const int iteration = 100;
+	int i;
+	const char *c;
+
+	/* Print as fast as possible, a character at a time... */
+	t0 = get_time();
+	for (i = 0; i < iteration; i++)
+		for (c = line; *c; c++)
+			uart_putc(*c);
+	uart_flush_output();
+	t1 = get_time();
+
+	/* ...and a line at a time */
+	t2 = get_time();
+	for (i = 0; i < iteration; i++)
+		uart_puts(line);
+	uart_flush_output();
+	t3 = get_time();
+	ccprintf(" (speed gain: %d -> %d us) ", t1.val - t0.val,
+		 t3.val - t2.val);
+
+	return EC_SUCCESS;
+}
+
+void run_test(void)
+{
+	test_reset();
+
+	RUN_TEST(test_crlf);
+	RUN_TEST(test_printf_batch);
+	RUN_TEST(test_buffer_wrap);
+	RUN_TEST(test_full_rate);
+
+	test_print_result();
+}
@@ -7,6 +7,7 @@
 
 #include "common.h"
 #include "console.h"
+#include "host_command.h"
 #include "shared_mem.h"
 #include "system.h"
 #include "test_util.h"
@@ -116,9 +117,21 @@ static int test_memmove(void)
 	return EC_SUCCESS;
 }
 
+/* Plain memcpy, used as a reference to measure speed gain */
+static void *dumb_memcpy(void *dest, const void *src, int len)
+{
+	char *d = (char *)dest;
+	const char *s = (const char *)src;
+	while (len > 0) {
+		*(d++) = *(s++);
+		len--;
+	}
+	return dest;
+}
+
 static int test_memcpy(void)
 {
-	int i;
+	int i, dest_align, src_align, n;
 	timestamp_t t0, t1, t2, t3;
 	char *buf;
 	const int buf_size = 1000;
@@ -135,27 +148,51 @@ static int test_memcpy(void)
 
 	t0 = get_time();
 	for (i = 0; i < iteration; ++i)
-		memcpy(buf + dest_offset + 1, buf, len);  /* unaligned */
+		dumb_memcpy(buf + dest_offset + 1, buf, len);  /* unaligned */
 	t1 = get_time();
 	TEST_ASSERT_ARRAY_EQ(buf + dest_offset + 1, buf, len);
 	ccprintf(" (speed gain: %d ->", t1.val-t0.val);
 
 	t2 = get_time();
 	for (i = 0; i < iteration; ++i)
-		memcpy(buf + dest_offset, buf, len);	  /* aligned */
+		memcpy(buf + dest_offset + 1, buf, len);  /* unaligned */
 	t3 = get_time();
 	ccprintf(" %d us) ", t3.val-t2.val);
-	TEST_ASSERT_ARRAY_EQ(buf + dest_offset, buf, len);
+	TEST_ASSERT_ARRAY_EQ(buf + dest_offset + 1, buf, len);
 
-	/* Expected about 4x speed gain. Use 3x because it fluctuates */
+	/*
+	 * Even unaligned copies move whole words.  Expected about 3x speed
+	 * gain.  Use 2x because it fluctuates.
+	 */
 #ifndef EMU_BUILD
 	/*
 	 * The speed gain is too unpredictable on host, especially on
 	 * buildbots. Skip it if we are running in the emulator.
 	 */
-	TEST_ASSERT((t1.val-t0.val) > (unsigned)(t3.val-t2.val) * 3);
+	TEST_ASSERT((t1.val-t0.val) > (unsigned)(t3.val-t2.val) * 2);
 #endif
 
+	/* All alignment combinations, including short heads and tails */
+	for (src_align = 0; src_align < 4; src_align++) {
+		for (dest_align = 0; dest_align < 4; dest_align++) {
+			for (n = 0; n < 40; n++) {
+				memset(buf + dest_offset, 0xee, 48);
+				memcpy(buf + dest_offset + dest_align,
+				       buf + src_align, n);
+				TEST_ASSERT_ARRAY_EQ(buf + dest_offset +
+						     dest_align,
+						     buf + src_align, n);
+				/* Nothing written outside the copy */
+				TEST_ASSERT_MEMSET(buf + dest_offset,
+						   (char)0xee, dest_align);
+				TEST_ASSERT_MEMSET(buf + dest_offset +
+						   dest_align + n,
+						   (char)0xee,
+						   48 - dest_align - n);
+			}
+		}
+	}
+
 	memcpy(buf + dest_offset + 1, buf + 1, len - 1);
 	TEST_ASSERT_ARRAY_EQ(buf + dest_offset + 1, buf + 1, len - 1);
 
@@ -231,6 +268,93 @@ static int test_memset(void)
 	return EC_SUCCESS;
 }
 
+/* Byte-at-a-time copy and sum, used as a reference for memcpy_sum() */
+static int dumb_memcpy_sum(void *dest, const void *src, int len)
+{
+	uint8_t *d = (uint8_t *)dest;
+	const uint8_t *s = (const uint8_t *)src;
+	int sum = 0;
+
+	while (len > 0) {
+		if (d)
+			*(d++) = *s;
+		sum += *(s++);
+		len--;
+	}
+	return sum;
+}
+
+static int test_memcpy_sum(void)
+{
+	int i, sum, dest_align, src_align, len;
+	timestamp_t t0, t1, t2, t3;
+	char *buf;
+	const int buf_size = 1000;
+	const int max_len = 400;
+	const int dest_offset = 500;
+	const int iteration = 1000;
+
+	TEST_ASSERT(shared_mem_acquire(buf_size, &buf) == EC_SUCCESS);
+
+	/* Mostly high bytes, to exercise carries between the sum lanes */
+	for (i = 0; i < max_len + 4; ++i)
+		buf[i] = 0xff - (i & 0x1f);
+
+	/* All alignment combinations, including short heads and tails */
+	for (src_align = 0; src_align < 4; src_align++) {
+		for (dest_align = 0; dest_align < 4; dest_align++) {
+			for (len = 0; len < 12; len++) {
+				sum = dumb_memcpy_sum(NULL, buf + src_align,
+						      len);
+				TEST_ASSERT(memcpy_sum(buf + dest_offset +
+						       dest_align,
+						       buf + src_align,
+						       len) == sum);
+				TEST_ASSERT_ARRAY_EQ(buf + dest_offset +
+						     dest_align,
+						     buf + src_align, len);
+				TEST_ASSERT(memcpy_sum(NULL, buf + src_align,
+						       len) == sum);
+			}
+			len = max_len - src_align;
+			sum = dumb_memcpy_sum(NULL, buf + src_align, len);
+			TEST_ASSERT(memcpy_sum(buf + dest_offset + dest_align,
+					       buf + src_align, len) == sum);
+			TEST_ASSERT_ARRAY_EQ(buf + dest_offset + dest_align,
+					     buf + src_align, len);
+		}
+	}
+
+	/* Long enough to need the lanes folded more than once */
+	memset(buf, 0xff, buf_size);
+	TEST_ASSERT(memcpy_sum(NULL, buf, buf_size) == 0xff * buf_size);
+
+	/* Speed, for a typical host packet's worth of data */
+	for (i = 0; i < max_len; ++i)
+		buf[i] = i;
+
+	t0 = get_time();
+	for (i = 0; i < iteration; ++i)
+		dumb_memcpy_sum(buf + dest_offset, buf, max_len);
+	t1 = get_time();
+	ccprintf(" (speed gain: %d ->", t1.val-t0.val);
+
+	t2 = get_time();
+	for (i = 0; i < iteration; ++i)
+		memcpy_sum(buf + dest_offset, buf, max_len);
+	t3 = get_time();
+	ccprintf(" %d us) ", t3.val-t2.val);
+	TEST_ASSERT_ARRAY_EQ(buf + dest_offset, buf, max_len);
+
+	/* Expected about 3x speed gain. Use 2x because it fluctuates */
+#ifndef EMU_BUILD
+	TEST_ASSERT((t1.val-t0.val) > (unsigned)(t3.val-t2.val) * 2);
+#endif
+
+	shared_mem_release(buf);
+	return EC_SUCCESS;
+}
+
 static int test_strzcpy(void)
 {
 	char dest[10];
@@ -247,7 +371,63 @@ static int test_strzcpy(void)
 
 static int test_strlen(void)
 {
-	TEST_CHECK(strlen("this is a string") == 16);
+	char buf[48];
+	int align, len;
+
+	TEST_ASSERT(strlen("this is a string") == 16);
+
+	/* Every alignment, with the terminator in every byte lane */
+	memset(buf, 'x', sizeof(buf));
+	for (align = 0; align < 4; align++) {
+		for (len = 0; len < 40; len++) {
+			buf[align + len] = '\0';
+			TEST_ASSERT(strlen(buf + align) == len);
+			buf[align + len] = 'x';
+		}
+	}
+
+	/* High bytes must not look like terminators */
+	memset(buf, 0x80, sizeof(buf));
+	buf[sizeof(buf) - 1] = '\0';
+	TEST_ASSERT(strlen(buf) == sizeof(buf) - 1);
+	memset(buf, 0x01, sizeof(buf));
+	buf[sizeof(buf) - 1] = '\0';
+	TEST_ASSERT(strlen(buf) == sizeof(buf) - 1);
+
+	return EC_SUCCESS;
+}
+
+static int test_memcmp(void)
+{
+	char a[48], b[48];
+	int align_a, align_b, len, i;
+
+	for (i = 0; i < sizeof(a); i++)
+		a[i] = b[i] = 0x40 + i;
+
+	for (align_a = 0; align_a < 4; align_a++) {
+		for (align_b = 0; align_b < 4; align_b++) {
+			for (len = 0; len < 40; len++) {
+				char *pa = a + align_a;
+				char *pb = b + align_b;
+
+				memcpy(pb, pa, len);
+				TEST_ASSERT(memcmp(pa, pb, len) == 0);
+
+				/* A difference in any byte is found */
+				for (i = 0; i < len; i++) {
+					pb[i]++;
+					TEST_ASSERT(memcmp(pa, pb, len) < 0);
+					TEST_ASSERT(memcmp(pb, pa, len) > 0);
+					/* ...but not past len */
+					TEST_ASSERT(memcmp(pa, pb, i) == 0);
+					pb[i]--;
+				}
+			}
+		}
+	}
+
+	return EC_SUCCESS;
 }
 
 static int test_strcasecmp(void)
@@ -337,6 +517,62 @@ static int test_shared_mem(void)
 	return EC_SUCCESS;
 }
 
+static int test_shared_mem_multi(void)
+{
+	int sz = shared_mem_size();
+	char *a, *b, *c, *d, *mem;
+	struct ec_response_shared_mem_info r;
+
+	TEST_ASSERT(shared_mem_available() == sz);
+
+	/* Several areas can be held at once, without overlapping */
+	TEST_ASSERT(shared_mem_acquire(100, &a) == EC_SUCCESS);
+	TEST_ASSERT(shared_mem_acquire(200, &b) == EC_SUCCESS);
+	TEST_ASSERT(shared_mem_acquire(300, &c) == EC_SUCCESS);
+	TEST_ASSERT(a + 100 <= b && b + 200 <= c);
+	memset(a, 0xaa, 100);
+	memset(b, 0xbb, 200);
+	memset(c, 0xcc, 300);
+	TEST_ASSERT_MEMSET(a, (char)0xaa, 100);
+	TEST_ASSERT_MEMSET(b, (char)0xbb, 200);
+
+	/* Not enough left for the whole buffer */
+	TEST_ASSERT(shared_mem_available() < sz - 600);
+	TEST_ASSERT(shared_mem_acquire(sz, &mem) == EC_ERROR_BUSY);
+	TEST_ASSERT(shared_mem_acquire(sz + 1, &mem) == EC_ERROR_INVAL);
+
+	/* A freed hole is reused first-fit */
+	shared_mem_release(b);
+	TEST_ASSERT(shared_mem_acquire(150, &d) == EC_SUCCESS);
+	TEST_ASSERT(d == b);
+
+	TEST_ASSERT(test_send_host_command(EC_CMD_SHARED_MEM_INFO, 0, NULL, 0,
+					   &r, sizeof(r)) == EC_RES_SUCCESS);
+	TEST_ASSERT(r.size == sz);
+	TEST_ASSERT(r.used >= 550 && r.used < 600);
+	TEST_ASSERT(r.max_used >= r.used);
+	TEST_ASSERT(r.blocks_used == 3);
+	TEST_ASSERT(r.blocks_free == 2);
+	TEST_ASSERT(r.largest_free == shared_mem_available());
+	TEST_ASSERT(r.free > r.largest_free);
+
+	/* Releasing in any order merges everything back into one block */
+	shared_mem_release(a);
+	shared_mem_release(c);
+	shared_mem_release(c);
+	shared_mem_release(d);
+	TEST_ASSERT(shared_mem_available() == sz);
+
+	TEST_ASSERT(test_send_host_command(EC_CMD_SHARED_MEM_INFO, 0, NULL, 0,
+					   &r, sizeof(r)) == EC_RES_SUCCESS);
+	TEST_ASSERT(r.used == 0);
+	TEST_ASSERT(r.blocks_used == 0);
+	TEST_ASSERT(r.blocks_free == 1);
+	TEST_ASSERT(r.free == sz);
+
+	return EC_SUCCESS;
+}
+
 static int test_scratchpad(void)
 {
 	system_set_scratchpad(0xfeed);
@@ -453,8 +689,10 @@ void run_test(void)
 	RUN_TEST(test_memmove);
 	RUN_TEST(test_memcpy);
 	RUN_TEST(test_memset);
+	RUN_TEST(test_memcpy_sum);
 	RUN_TEST(test_strzcpy);
 	RUN_TEST(test_strlen);
+	RUN_TEST(test_memcmp);
 	RUN_TEST(test_strcasecmp);
 	RUN_TEST(test_strncasecmp);
 	RUN_TEST(test_atoi);
@@ -463,6 +701,7 @@ void run_test(void)
 	RUN_TEST(test_uint64divmod_2);
 	RUN_TEST(test_get_next_bit);
 	RUN_TEST(test_shared_mem);
+	RUN_TEST(test_shared_mem_multi);
 	RUN_TEST(test_scratchpad);
 	RUN_TEST(test_cond_t);
 
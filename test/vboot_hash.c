@@ -0,0 +1,422 @@
+/* Copyright (c) 2014 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Tests for vboot hash and flash hash host commands.
+ */
+
+#include "common.h"
+#include "ec_commands.h"
+#include "flash.h"
+#include "host_command.h"
+#include "sha256.h"
+#include "system.h"
+#include "task.h"
+#include "test_util.h"
+#include "timer.h"
+#include "util.h"
+
+/* Offset of the flash used by these tests; away from the RO and RW images */
+#define TEST_OFFSET (CONFIG_FLASH_SIZE - 0x1000)
+
+/* Size of the RW image, as hashed at boot */
+#define RW_SIZE 0x1000
+
+/* SHA-256 of "abc" and of nothing, from FIPS 180-2 */
+static const uint8_t abc_digest[SHA256_DIGEST_SIZE] = {
+	0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea,
+	0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
+	0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c,
+	0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad,
+};
+
+static const uint8_t empty_digest[SHA256_DIGEST_SIZE] = {
+	0xe3, 0xb0, 0xc4, 0x42, 0x98, 0xfc, 0x1c, 0x14,
+	0x9a, 0xfb, 0xf4, 0xc8, 0x99, 0x6f, 0xb9, 0x24,
+	0x27, 0xae, 0x41, 0xe4, 0x64, 0x9b, 0x93, 0x4c,
+	0xa4, 0x95, 0x99, 0x1b, 0x78, 0x52, 0xb8, 0x55,
+};
+
+/*****************************************************************************/
+/* Mock functions */
+
+void host_send_response(struct host_cmd_handler_args *args)
+{
+	/* Do nothing */
+}
+
+/* The emulator doesn't run from flash, so there is no image to find */
+int system_get_image_used(enum system_image_copy_t copy)
+{
+	return RW_SIZE;
+}
+
+/*****************************************************************************/
+/* Test utilities */
+
+static struct {
+	struct ec_params_flash_hash p;
+	struct ec_flash_hash_block block[4];
+} params;
+
+static uint8_t digests[4 * SHA256_DIGEST_SIZE];
+
+static void set_block(int i, uint32_t offset, uint32_t size)
+{
+	params.block[i].offset = offset;
+	params.block[i].size = size;
+}
+
+static int flash_hash(int count, int resp_size)
+{
+	params.p.hash_type = EC_VBOOT_HASH_TYPE_SHA256;
+	params.p.count = count;
+	params.p.reserved = 0;
+
+	return test_send_host_command(EC_CMD_FLASH_HASH, 0, &params,
+				      sizeof(params.p) +
+				      count * sizeof(params.block[0]),
+				      digests, resp_size);
+}
+
+/* Send EC_CMD_VBOOT_HASH, and return the response size */
+static int vboot_hash(int version, int cmd, uint32_t offset, uint32_t size,
+		      struct ec_response_vboot_hash_1 *r)
+{
+	struct ec_params_vboot_hash p;
+	struct host_cmd_handler_args args;
+
+	memset(&p, 0, sizeof(p));
+	p.cmd = cmd;
+	p.hash_type = EC_VBOOT_HASH_TYPE_SHA256;
+	p.offset = offset;
+	p.size = size;
+
+	memset(r, 0xee, sizeof(*r));
+
+	args.version = version;
+	args.command = EC_CMD_VBOOT_HASH;
+	args.params = &p;
+	args.params_size = sizeof(p);
+	args.response = r;
+	args.response_max = sizeof(*r);
+	args.response_size = 0;
+
+	if (host_command_process(&args) != EC_RES_SUCCESS)
+		return -1;
+
+	return args.response_size;
+}
+
+static int check_hash(const struct ec_response_vboot_hash_1 *r,
+		      uint32_t offset, uint32_t size)
+{
+	struct sha256_ctx ctx;
+	const uint8_t *digest;
+
+	SHA256_init(&ctx);
+	SHA256_update(&ctx, (const uint8_t *)__host_flash + offset, size);
+	digest = SHA256_final(&ctx);
+
+	TEST_ASSERT(r->status == EC_VBOOT_HASH_STATUS_DONE);
+	TEST_ASSERT(r->offset == offset);
+	TEST_ASSERT(r->size == size);
+	TEST_ASSERT(r->digest_size == SHA256_DIGEST_SIZE);
+	TEST_ASSERT_ARRAY_EQ(r->hash_digest, digest, SHA256_DIGEST_SIZE);
+
+	return EC_SUCCESS;
+}
+
+/*****************************************************************************/
+/* Tests */
+
+static int test_hash_progress(void)
+{
+	struct ec_response_vboot_hash_1 r;
+
+	/* Wait for the hash started at boot */
+	msleep(100);
+
+	/* Version 0 doesn't have the progress fields */
+	TEST_ASSERT(vboot_hash(0, EC_VBOOT_HASH_GET, 0, 0, &r) ==
+		    sizeof(struct ec_response_vboot_hash));
+	TEST_ASSERT(r.bytes_hashed == 0xeeeeeeee);
+
+	/* Start hashing all of flash; nothing has been hashed yet */
+	TEST_ASSERT(vboot_hash(1, EC_VBOOT_HASH_START, 0, CONFIG_FLASH_SIZE,
+			       &r) == sizeof(r));
+	TEST_ASSERT(r.status == EC_VBOOT_HASH_STATUS_BUSY);
+	TEST_ASSERT(r.offset == 0);
+	TEST_ASSERT(r.size == CONFIG_FLASH_SIZE);
+	TEST_ASSERT(r.bytes_hashed == 0);
+
+	/* Once done, all bytes are accounted for, with the time it took */
+	msleep(100);
+	TEST_ASSERT(vboot_hash(1, EC_VBOOT_HASH_GET, 0, 0, &r) == sizeof(r));
+	TEST_ASSERT(check_hash(&r, 0, CONFIG_FLASH_SIZE) == EC_SUCCESS);
+	TEST_ASSERT(r.bytes_hashed == CONFIG_FLASH_SIZE);
+	TEST_ASSERT(r.elapsed_us > 0 && r.elapsed_us < 100 * MSEC);
+
+	/* Aborting clears it all */
+	TEST_ASSERT(vboot_hash(1, EC_VBOOT_HASH_ABORT, 0, 0, &r) == 0);
+	TEST_ASSERT(vboot_hash(1, EC_VBOOT_HASH_GET, 0, 0, &r) == sizeof(r));
+	TEST_ASSERT(r.status == EC_VBOOT_HASH_STATUS_NONE);
+	TEST_ASSERT(r.bytes_hashed == 0);
+	TEST_ASSERT(r.elapsed_us == 0);
+
+	return EC_SUCCESS;
+}
+
+static int test_hash_recalc(void)
+{
+	struct ec_response_vboot_hash_1 r;
+
+	/* Recalc waits, so the hash is ready right away */
+	TEST_ASSERT(vboot_hash(1, EC_VBOOT_HASH_RECALC, TEST_OFFSET, 0x1000,
+			       &r) == sizeof(r));
+	TEST_ASSERT(check_hash(&r, TEST_OFFSET, 0x1000) == EC_SUCCESS);
+	TEST_ASSERT(r.bytes_hashed == 0x1000);
+
+	TEST_ASSERT(vboot_hash(0, EC_VBOOT_HASH_RECALC, 0, CONFIG_FLASH_SIZE,
+			       &r) == sizeof(struct ec_response_vboot_hash));
+	TEST_ASSERT(check_hash(&r, 0, CONFIG_FLASH_SIZE) == EC_SUCCESS);
+
+	return EC_SUCCESS;
+}
+
+static int test_hash_cache(void)
+{
+	struct ec_response_vboot_hash_1 r;
+	uint8_t digest[SHA256_DIGEST_SIZE];
+	const uint32_t data = 0x12345678;
+
+	/* A finished hash is cached, for exactly the region hashed */
+	TEST_ASSERT(vboot_hash(1, EC_VBOOT_HASH_RECALC, CONFIG_FW_RW_OFF,
+			       RW_SIZE, &r) == sizeof(r));
+	TEST_ASSERT(flash_get_hash_cache(CONFIG_FW_RW_OFF, RW_SIZE,
+					 digest) == EC_SUCCESS);
+	TEST_ASSERT_ARRAY_EQ(digest, r.hash_digest, SHA256_DIGEST_SIZE);
+	TEST_ASSERT(flash_get_hash_cache(CONFIG_FW_RW_OFF, RW_SIZE - 4,
+					 digest) != EC_SUCCESS);
+
+	/* Once anything is written, it isn't trusted until rehashed */
+	TEST_ASSERT(flash_write(TEST_OFFSET, sizeof(data),
+				(const char *)&data) == EC_SUCCESS);
+	TEST_ASSERT(flash_get_hash_cache(CONFIG_FW_RW_OFF, RW_SIZE,
+					 digest) != EC_SUCCESS);
+	TEST_ASSERT(flash_set_hash_cache(CONFIG_FW_RW_OFF, RW_SIZE, digest,
+					 flash_get_write_generation() - 1) !=
+		    EC_SUCCESS);
+
+	/* Writing any of the region drops it */
+	TEST_ASSERT(vboot_hash(1, EC_VBOOT_HASH_RECALC, CONFIG_FW_RW_OFF,
+			       RW_SIZE, &r) == sizeof(r));
+	TEST_ASSERT(flash_get_hash_cache(CONFIG_FW_RW_OFF, RW_SIZE,
+					 digest) == EC_SUCCESS);
+	TEST_ASSERT(flash_write(CONFIG_FW_RW_OFF + RW_SIZE - sizeof(data),
+				sizeof(data), (const char *)&data) ==
+		    EC_SUCCESS);
+	TEST_ASSERT(flash_get_hash_cache(CONFIG_FW_RW_OFF, RW_SIZE,
+					 digest) != EC_SUCCESS);
+
+	/* So does erasing */
+	TEST_ASSERT(vboot_hash(1, EC_VBOOT_HASH_RECALC, CONFIG_FW_RW_OFF,
+			       RW_SIZE, &r) == sizeof(r));
+	TEST_ASSERT(flash_get_hash_cache(CONFIG_FW_RW_OFF, RW_SIZE,
+					 digest) == EC_SUCCESS);
+	TEST_ASSERT(flash_erase(CONFIG_FW_RW_OFF, CONFIG_FLASH_ERASE_SIZE) ==
+		    EC_SUCCESS);
+	TEST_ASSERT(flash_get_hash_cache(CONFIG_FW_RW_OFF, RW_SIZE,
+					 digest) != EC_SUCCESS);
+
+	/* Other hashes aren't cached, and don't drop the RW hash */
+	TEST_ASSERT(vboot_hash(1, EC_VBOOT_HASH_RECALC, CONFIG_FW_RW_OFF,
+			       RW_SIZE, &r) == sizeof(r));
+	TEST_ASSERT(vboot_hash(1, EC_VBOOT_HASH_RECALC, TEST_OFFSET, 0x1000,
+			       &r) == sizeof(r));
+	TEST_ASSERT(flash_get_hash_cache(TEST_OFFSET, 0x1000,
+					 digest) != EC_SUCCESS);
+	TEST_ASSERT(flash_get_hash_cache(CONFIG_FW_RW_OFF, RW_SIZE,
+					 digest) == EC_SUCCESS);
+
+	/* Writing RW while it's being hashed aborts the hash */
+	TEST_ASSERT(flash_erase(CONFIG_FW_RW_OFF, CONFIG_FLASH_ERASE_SIZE) ==
+		    EC_SUCCESS);
+	TEST_ASSERT(vboot_hash(1, EC_VBOOT_HASH_START, CONFIG_FW_RW_OFF,
+			       RW_SIZE, &r) == sizeof(r));
+	TEST_ASSERT(r.status == EC_VBOOT_HASH_STATUS_BUSY);
+	TEST_ASSERT(flash_write(CONFIG_FW_RW_OFF + RW_SIZE - sizeof(data),
+				sizeof(data), (const char *)&data) ==
+		    EC_SUCCESS);
+	msleep(100);
+	TEST_ASSERT(vboot_hash(1, EC_VBOOT_HASH_GET, 0, 0, &r) == sizeof(r));
+	TEST_ASSERT(r.status == EC_VBOOT_HASH_STATUS_NONE);
+	TEST_ASSERT(flash_get_hash_cache(CONFIG_FW_RW_OFF, RW_SIZE,
+					 digest) != EC_SUCCESS);
+
+	/* Changing RO protection drops it, and it isn't used while set */
+	TEST_ASSERT(vboot_hash(1, EC_VBOOT_HASH_RECALC, CONFIG_FW_RW_OFF,
+			       RW_SIZE, &r) == sizeof(r));
+	TEST_ASSERT(flash_protect_ro_at_boot(1) == EC_SUCCESS);
+	TEST_ASSERT(flash_get_hash_cache(CONFIG_FW_RW_OFF, RW_SIZE,
+					 digest) != EC_SUCCESS);
+	TEST_ASSERT(vboot_hash(1, EC_VBOOT_HASH_RECALC, CONFIG_FW_RW_OFF,
+			       RW_SIZE, &r) == sizeof(r));
+	TEST_ASSERT(flash_get_hash_cache(CONFIG_FW_RW_OFF, RW_SIZE,
+					 digest) != EC_SUCCESS);
+	TEST_ASSERT(flash_protect_ro_at_boot(0) == EC_SUCCESS);
+
+	/* Leave RW hashed for the next boot */
+	TEST_ASSERT(vboot_hash(1, EC_VBOOT_HASH_RECALC, CONFIG_FW_RW_OFF,
+			       RW_SIZE, &r) == sizeof(r));
+	TEST_ASSERT(flash_get_hash_cache(CONFIG_FW_RW_OFF, RW_SIZE,
+					 digest) == EC_SUCCESS);
+
+	return EC_SUCCESS;
+}
+
+static int test_hash_cache_boot(void)
+{
+	struct ec_response_vboot_hash_1 r;
+	uint8_t digest[SHA256_DIGEST_SIZE];
+
+	/*
+	 * RW wasn't written since last boot, so its hash came from the cache
+	 * without hashing anything.  The emulator patches the RW reset vector
+	 * at boot, so the flash itself can't be used to check the digest.
+	 */
+	TEST_ASSERT(vboot_hash(1, EC_VBOOT_HASH_GET, 0, 0, &r) == sizeof(r));
+	TEST_ASSERT(r.status == EC_VBOOT_HASH_STATUS_DONE);
+	TEST_ASSERT(r.offset == CONFIG_FW_RW_OFF);
+	TEST_ASSERT(r.size == RW_SIZE);
+	TEST_ASSERT(r.bytes_hashed == RW_SIZE);
+	TEST_ASSERT(r.elapsed_us == 0);
+	TEST_ASSERT(flash_get_hash_cache(CONFIG_FW_RW_OFF, RW_SIZE,
+					 digest) == EC_SUCCESS);
+	TEST_ASSERT_ARRAY_EQ(r.hash_digest, digest, SHA256_DIGEST_SIZE);
+
+	return EC_SUCCESS;
+}
+
+static int test_flash_hash(void)
+{
+	struct sha256_ctx ctx;
+	uint8_t *big = (uint8_t *)__host_flash + TEST_OFFSET;
+	const uint8_t *digest;
+	int i;
+
+	memcpy(big, "abc", 3);
+	for (i = 3; i < 0x1000; i++)
+		big[i] = i * 7;
+
+	/* Known vectors, plus a block which takes several chunks */
+	set_block(0, TEST_OFFSET, 3);
+	set_block(1, TEST_OFFSET, 0);
+	set_block(2, TEST_OFFSET, 0x1000);
+	TEST_ASSERT(flash_hash(3, sizeof(digests)) == EC_RES_SUCCESS);
+	TEST_ASSERT_ARRAY_EQ(digests, abc_digest, SHA256_DIGEST_SIZE);
+	TEST_ASSERT_ARRAY_EQ(digests + SHA256_DIGEST_SIZE, empty_digest,
+			     SHA256_DIGEST_SIZE);
+
+	SHA256_init(&ctx);
+	SHA256_update(&ctx, big, 0x1000);
+	digest = SHA256_final(&ctx);
+	TEST_ASSERT_ARRAY_EQ(digests + 2 * SHA256_DIGEST_SIZE, digest,
+			     SHA256_DIGEST_SIZE);
+
+	/* Nothing to hash is fine too */
+	TEST_ASSERT(flash_hash(0, sizeof(digests)) == EC_RES_SUCCESS);
+
+	return EC_SUCCESS;
+}
+
+static int test_flash_hash_errors(void)
+{
+	set_block(0, TEST_OFFSET, 3);
+	set_block(1, TEST_OFFSET, 3);
+
+	/* Response doesn't fit */
+	TEST_ASSERT(flash_hash(2, SHA256_DIGEST_SIZE) ==
+		    EC_RES_RESPONSE_TOO_BIG);
+
+	/* Params too short for the block count */
+	params.p.count = 2;
+	TEST_ASSERT(test_send_host_command(EC_CMD_FLASH_HASH, 0, &params,
+					   sizeof(params.p) +
+					   sizeof(params.block[0]),
+					   digests, sizeof(digests)) ==
+		    EC_RES_INVALID_PARAM);
+
+	/* Unknown hash type */
+	params.p.hash_type = 0xff;
+	TEST_ASSERT(test_send_host_command(EC_CMD_FLASH_HASH, 0, &params,
+					   sizeof(params), digests,
+					   sizeof(digests)) ==
+		    EC_RES_INVALID_PARAM);
+
+	/* Outside flash */
+	set_block(1, TEST_OFFSET, 0x1001);
+	TEST_ASSERT(flash_hash(2, sizeof(digests)) == EC_RES_INVALID_PARAM);
+	set_block(1, 0xfffffff0, 0x20);
+	TEST_ASSERT(flash_hash(2, sizeof(digests)) == EC_RES_INVALID_PARAM);
+
+	/* Too much to hash in one command */
+	set_block(0, 0, EC_FLASH_HASH_MAX_BYTES / 2);
+	set_block(1, 0, EC_FLASH_HASH_MAX_BYTES / 2 + 1);
+	TEST_ASSERT(flash_hash(2, sizeof(digests)) == EC_RES_INVALID_PARAM);
+	set_block(1, 0, EC_FLASH_HASH_MAX_BYTES / 2);
+	TEST_ASSERT(flash_hash(2, sizeof(digests)) == EC_RES_SUCCESS);
+
+	return EC_SUCCESS;
+}
+
+void test_clean_up(void)
+{
+	flash_protect_ro_at_boot(0);
+}
+
+static void run_test_step1(void)
+{
+	test_reset();
+
+	RUN_TEST(test_flash_hash);
+	RUN_TEST(test_flash_hash_errors);
+	RUN_TEST(test_hash_progress);
+	RUN_TEST(test_hash_recalc);
+	RUN_TEST(test_hash_cache);
+
+	if (test_get_error_count())
+		test_reboot_to_next_step(TEST_STATE_FAILED);
+	else
+		test_reboot_to_next_step(TEST_STATE_STEP_2);
+}
+
+static void run_test_step2(void)
+{
+	RUN_TEST(test_hash_cache_boot);
+
+	if (test_get_error_count())
+		test_reboot_to_next_step(TEST_STATE_FAILED);
+	else
+		test_reboot_to_next_step(TEST_STATE_PASSED);
+}
+
+void test_run_step(uint32_t state)
+{
+	if (state & TEST_STATE_MASK(TEST_STATE_STEP_1))
+		run_test_step1();
+	else if (state & TEST_STATE_MASK(TEST_STATE_STEP_2))
+		run_test_step2();
+}
+
+int task_test(void *data)
+{
+	test_run_multistep();
+	return EC_SUCCESS;
+}
+
+void run_test(void)
+{
+	msleep(30); /* Wait for TASK_ID_TEST to initialize */
+	task_wake(TASK_ID_TEST);
+}
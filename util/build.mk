@@ -17,7 +17,8 @@ else
 comm-objs+=comm-i2c.o
 endif
 ectool-objs=ectool.o ectool_keyscan.o misc_util.o ec_flash.o $(comm-objs)
+ectool-objs+=../common/sha256.o
 lbplay-objs=lbplay.o $(comm-objs)
-burn_my_ec-objs=ec_flash.o $(comm-objs) misc_util.o
+burn_my_ec-objs=ec_flash.o $(comm-objs) misc_util.o ../common/sha256.o
 
 build-util-bin=ec_uartd stm32mon iteflash
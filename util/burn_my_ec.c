@@ -90,19 +90,11 @@ int flash_partition(enum ec_current_image part, const uint8_t *payload,
 		}
 	}
 
-	printf("Erasing partition %s : 0x%x bytes at 0x%08x\n",
+	printf("Updating partition %s : 0x%x bytes at 0x%08x\n",
 	       part_name[part], size, offset);
-	res = ec_flash_erase(offset, size);
+	res = ec_flash_update(payload, offset, size);
 	if (res < 0) {
-		fprintf(stderr, "Erase failed : %d\n", res);
-		return -1;
-	}
-
-	printf("Writing partition %s : 0x%x bytes at 0x%08x\n",
-	       part_name[part], size, offset);
-	res = ec_flash_write(payload, offset, size);
-	if (res < 0) {
-		fprintf(stderr, "Write failed : %d\n", res);
+		fprintf(stderr, "Update failed : %d\n", res);
 		return -1;
 	}
 
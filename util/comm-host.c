@@ -6,7 +6,9 @@
 #include <errno.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/param.h>
 
 #include "comm-host.h"
 #include "ec_commands.h"
@@ -21,6 +23,14 @@ int ec_max_outsize, ec_max_insize;
 void *ec_outbuf;
 void *ec_inbuf;
 
+/* Batch request being built, and the response to the last one sent */
+static uint8_t *batch_out;
+static uint8_t *batch_in;
+static int batch_out_len;
+static int batch_in_len;
+static int batch_in_needed;
+static int batch_count;
+
 int comm_init_dev(void) __attribute__((weak));
 int comm_init_lpc(void) __attribute__((weak));
 int comm_init_i2c(void) __attribute__((weak));
@@ -91,3 +101,103 @@ int comm_init(void)
 	return 0;
 
 }
+
+int ec_batch_begin(void)
+{
+	struct ec_params_batch *p;
+
+	if (!batch_out) {
+		batch_out = malloc(ec_max_outsize);
+		batch_in = malloc(ec_max_insize);
+		if (!batch_out || !batch_in) {
+			fprintf(stderr, "Unable to allocate batch buffers\n");
+			return -1;
+		}
+	}
+
+	p = (struct ec_params_batch *)batch_out;
+	memset(p, 0, sizeof(*p));
+	batch_out_len = sizeof(*p);
+	batch_in_len = 0;
+	batch_in_needed = sizeof(struct ec_response_batch);
+	batch_count = 0;
+	return 0;
+}
+
+int ec_batch_add(int command, int version, const void *outdata, int outsize,
+		 int insize)
+{
+	struct ec_params_batch *p = (struct ec_params_batch *)batch_out;
+	struct ec_batch_request *req;
+	int out_len = sizeof(*req) + EC_BATCH_ALIGN(outsize);
+	int in_len = sizeof(struct ec_batch_response) + EC_BATCH_ALIGN(insize);
+
+	if (!batch_out || batch_count >= 255 ||
+	    batch_out_len + out_len > ec_max_outsize ||
+	    batch_in_needed + in_len > ec_max_insize)
+		return -1;
+
+	req = (struct ec_batch_request *)(batch_out + batch_out_len);
+	req->command = command;
+	req->command_version = version;
+	req->reserved = 0;
+	req->data_len = outsize;
+	req->response_max = insize;
+	memset(req + 1, 0, EC_BATCH_ALIGN(outsize));
+	if (outsize)
+		memcpy(req + 1, outdata, outsize);
+
+	batch_out_len += out_len;
+	batch_in_needed += in_len;
+	p->count = ++batch_count;
+	return batch_count - 1;
+}
+
+int ec_batch_send(void)
+{
+	struct ec_response_batch *r = (struct ec_response_batch *)batch_in;
+	int rv;
+
+	if (!batch_out)
+		return -1;
+
+	batch_in_len = 0;
+	rv = ec_command(EC_CMD_BATCH, 0, batch_out, batch_out_len,
+			batch_in, ec_max_insize);
+	if (rv < 0)
+		return rv;
+	if (rv < sizeof(*r))
+		return -EC_RES_INVALID_RESPONSE;
+
+	batch_in_len = rv;
+	return r->count;
+}
+
+int ec_batch_response(int index, void *indata, int insize)
+{
+	struct ec_response_batch *r = (struct ec_response_batch *)batch_in;
+	const uint8_t *in = batch_in + sizeof(*r);
+	const uint8_t *in_end = batch_in + batch_in_len;
+	const struct ec_batch_response *rsp;
+	int i;
+
+	if (!batch_in_len || index < 0 || index >= r->count)
+		return -1;
+
+	/* Skip to the requested entry */
+	for (i = 0; ; i++) {
+		rsp = (const struct ec_batch_response *)in;
+		if (in + sizeof(*rsp) > in_end ||
+		    in + sizeof(*rsp) + rsp->data_len > in_end)
+			return -EC_RES_INVALID_RESPONSE;
+		if (i == index)
+			break;
+		in += sizeof(*rsp) + EC_BATCH_ALIGN(rsp->data_len);
+	}
+
+	if (rsp->result)
+		return -EECRESULT - rsp->result;
+
+	memcpy(indata, rsp + 1, MIN(rsp->data_len, insize));
+	return rsp->data_len;
+}
@@ -47,4 +47,42 @@ extern int (*ec_command)(int command, int version,
  */
 extern int (*ec_readmem)(int offset, int bytes, void *dest);
 
+/*
+ * Batch several commands into a single EC_CMD_BATCH request, to save a round
+ * trip per command.  Call ec_batch_begin(), then ec_batch_add() for each
+ * command, then ec_batch_send().  Each command's response can then be read
+ * with ec_batch_response().
+ */
+
+/**
+ * Start a new batch, discarding any previous one.
+ *
+ * Returns 0 if success, or negative on error.
+ */
+int ec_batch_begin(void);
+
+/**
+ * Add a command to the current batch.  insize is the maximum response size
+ * the caller wants back for this command.
+ *
+ * Returns the index of the command within the batch, or negative if the
+ * batch has no room for it.
+ */
+int ec_batch_add(int command, int version, const void *outdata, int outsize,
+		 int insize);
+
+/**
+ * Send the current batch to the EC.
+ *
+ * Returns the number of commands the EC ran, or negative on error.
+ */
+int ec_batch_send(void);
+
+/**
+ * Get the response for one command in the last batch sent.  Like
+ * ec_command(), returns the length of response data (copied to indata, up to
+ * insize bytes), or negative if the command failed or was not run.
+ */
+int ec_batch_response(int index, void *indata, int insize);
+
 #endif /* COMM_HOST_H */
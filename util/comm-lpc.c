@@ -125,6 +125,39 @@ static int ec_command_lpc(int command, int version,
 	return args.data_size;
 }
 
+/*
+ * Write a buffer to consecutive LPC I/O ports, returning the sum of its bytes.
+ * This sticks to byte accesses; not every EC's host packet window decodes
+ * wider I/O cycles.
+ */
+static int lpc_write_sum(int port, const uint8_t *src, int len)
+{
+	int csum = 0;
+
+	for (; len > 0; len--, port++, src++) {
+		outb(*src, port);
+		csum += *src;
+	}
+
+	return csum;
+}
+
+/*
+ * Read consecutive LPC I/O ports into a buffer, returning the sum of the
+ * bytes read.  See lpc_write_sum().
+ */
+static int lpc_read_sum(int port, uint8_t *dest, int len)
+{
+	int csum = 0;
+
+	for (; len > 0; len--, port++, dest++) {
+		*dest = inb(port);
+		csum += *dest;
+	}
+
+	return csum;
+}
+
 static int ec_command_lpc_3(int command, int version,
 			  const void *outdata, int outsize,
 			  void *indata, int insize)
@@ -132,8 +165,7 @@ static int ec_command_lpc_3(int command, int version,
 	struct ec_host_request rq;
 	struct ec_host_response rs;
 	const uint8_t *d;
-	uint8_t *dout;
-	int csum = 0;
+	int csum;
 	int i;
 
 	/* Fail if output size is too big */
@@ -150,10 +182,8 @@ static int ec_command_lpc_3(int command, int version,
 	rq.data_len = outsize;
 
 	/* Copy data and start checksum */
-	for (i = 0, d = (const uint8_t *)outdata; i < outsize; i++, d++) {
-		outb(*d, EC_LPC_ADDR_HOST_PACKET + sizeof(rq) + i);
-		csum += *d;
-	}
+	csum = lpc_write_sum(EC_LPC_ADDR_HOST_PACKET + sizeof(rq),
+			     (const uint8_t *)outdata, outsize);
 
 	/* Finish checksum */
 	for (i = 0, d = (const uint8_t *)&rq; i < sizeof(rq); i++, d++)
@@ -163,8 +193,8 @@ static int ec_command_lpc_3(int command, int version,
 	rq.checksum = (uint8_t)(-csum);
 
 	/* Copy header */
-	for (i = 0, d = (const uint8_t *)&rq; i < sizeof(rq); i++, d++)
-		outb(*d, EC_LPC_ADDR_HOST_PACKET + i);
+	lpc_write_sum(EC_LPC_ADDR_HOST_PACKET, (const uint8_t *)&rq,
+		      sizeof(rq));
 
 	/* Start the command */
 	outb(EC_COMMAND_PROTOCOL_3, EC_LPC_ADDR_HOST_CMD);
@@ -182,11 +212,8 @@ static int ec_command_lpc_3(int command, int version,
 	}
 
 	/* Read back response header and start checksum */
-	csum = 0;
-	for (i = 0, dout = (uint8_t *)&rs; i < sizeof(rs); i++, dout++) {
-		*dout = inb(EC_LPC_ADDR_HOST_PACKET + i);
-		csum += *dout;
-	}
+	csum = lpc_read_sum(EC_LPC_ADDR_HOST_PACKET, (uint8_t *)&rs,
+			    sizeof(rs));
 
 	if (rs.struct_version != EC_HOST_RESPONSE_VERSION) {
 		fprintf(stderr, "EC response version mismatch\n");
@@ -204,10 +231,8 @@ static int ec_command_lpc_3(int command, int version,
 	}
 
 	/* Read back data and update checksum */
-	for (i = 0, dout = (uint8_t *)indata; i < rs.data_len; i++, dout++) {
-		*dout = inb(EC_LPC_ADDR_HOST_PACKET + sizeof(rs) + i);
-		csum += *dout;
-	}
+	csum += lpc_read_sum(EC_LPC_ADDR_HOST_PACKET + sizeof(rs),
+			     (uint8_t *)indata, rs.data_len);
 
 	/* Verify checksum */
 	if ((uint8_t)csum) {
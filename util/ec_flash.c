@@ -10,7 +10,9 @@
 #include <string.h>
 
 #include "comm-host.h"
+#include "ec_flash.h"
 #include "misc_util.h"
+#include "sha256.h"
 
 int ec_flash_read(uint8_t *buf, int offset, int size)
 {
@@ -34,7 +36,140 @@ int ec_flash_read(uint8_t *buf, int offset, int size)
 	return 0;
 }
 
-int ec_flash_verify(const uint8_t *buf, int offset, int size)
+/**
+ * Get flash info, using version 1 of the command if the EC supports it.
+ *
+ * Fields only in version 1 are left 0 if it doesn't.
+ */
+static int get_flash_info(struct ec_response_flash_info_1 *info)
+{
+	int rv;
+
+	memset(info, 0, sizeof(*info));
+
+	if (ec_cmd_version_supported(EC_CMD_FLASH_INFO, 1))
+		rv = ec_command(EC_CMD_FLASH_INFO, 1, NULL, 0,
+				info, sizeof(*info));
+	else
+		rv = ec_command(EC_CMD_FLASH_INFO, 0, NULL, 0,
+				info, sizeof(struct ec_response_flash_info));
+
+	return rv < 0 ? rv : 0;
+}
+
+/**
+ * Get the SHA-256 digest of each block of a flash region from the EC.
+ *
+ * @param digests	Destination; one digest per block
+ * @param offset	Offset in EC flash of the region
+ * @param size		Size of the region; the last block may be short
+ * @param block		Block size
+ *
+ * @return 0 if success, negative if error.
+ */
+static int ec_flash_hash(uint8_t *digests, int offset, int size, int block)
+{
+	struct ec_params_flash_hash *p =
+		(struct ec_params_flash_hash *)ec_outbuf;
+	int count = (size + block - 1) / block;
+	int per_cmd;
+	int rv;
+	int i, j, n;
+
+	per_cmd = (ec_max_outsize - sizeof(*p)) / sizeof(p->block[0]);
+	per_cmd = MIN(per_cmd, ec_max_insize / SHA256_DIGEST_SIZE);
+	per_cmd = MIN(per_cmd, EC_FLASH_HASH_MAX_BYTES / block);
+	per_cmd = MIN(per_cmd, 0xff);
+	if (per_cmd < 1)
+		per_cmd = 1;
+
+	for (i = 0; i < count; i += n) {
+		n = MIN(count - i, per_cmd);
+
+		p->hash_type = EC_VBOOT_HASH_TYPE_SHA256;
+		p->count = n;
+		p->reserved = 0;
+		for (j = 0; j < n; j++) {
+			int pos = (i + j) * block;
+
+			p->block[j].offset = offset + pos;
+			p->block[j].size = MIN(size - pos, block);
+		}
+
+		rv = ec_command(EC_CMD_FLASH_HASH, 0,
+				p, sizeof(*p) + n * sizeof(p->block[0]),
+				ec_inbuf, n * SHA256_DIGEST_SIZE);
+		if (rv < 0) {
+			fprintf(stderr, "Hash error at offset %d\n",
+				i * block);
+			return rv;
+		}
+		memcpy(digests + i * SHA256_DIGEST_SIZE, ec_inbuf,
+		       n * SHA256_DIGEST_SIZE);
+	}
+
+	return 0;
+}
+
+/**
+ * Return the SHA-256 digest of size bytes of buf, in ctx.
+ */
+static const uint8_t *hash_buf(struct sha256_ctx *ctx, const uint8_t *buf,
+			       int size)
+{
+	SHA256_init(ctx);
+	SHA256_update(ctx, buf, size);
+	return SHA256_final(ctx);
+}
+
+/**
+ * Verify by comparing digests of each erase block, computed on the EC.
+ */
+static int verify_by_hash(const uint8_t *buf, int offset, int size)
+{
+	struct ec_response_flash_info_1 info;
+	struct sha256_ctx ctx;
+	uint8_t *digests;
+	int block;
+	int rv;
+	int i;
+
+	rv = get_flash_info(&info);
+	if (rv < 0)
+		return rv;
+
+	block = info.erase_block_size;
+	if (!block) {
+		fprintf(stderr, "Bad erase block size.\n");
+		return -1;
+	}
+
+	digests = malloc((size + block - 1) / block * SHA256_DIGEST_SIZE);
+	if (!digests) {
+		fprintf(stderr, "Unable to allocate buffer.\n");
+		return -1;
+	}
+
+	rv = ec_flash_hash(digests, offset, size, block);
+
+	for (i = 0; i < size && rv == 0; i += block) {
+		if (memcmp(digests + i / block * SHA256_DIGEST_SIZE,
+			   hash_buf(&ctx, buf + i, MIN(size - i, block)),
+			   SHA256_DIGEST_SIZE)) {
+			fprintf(stderr, "Mismatch in block at offset 0x%x\n",
+				i);
+			rv = -1;
+		}
+	}
+
+	free(digests);
+	return rv;
+}
+
+/**
+ * Verify by reading back the whole region.
+ */
+static int verify_by_readback(const uint8_t *buf, int offset, int size)
 {
 	uint8_t *rbuf = malloc(size);
 	int rv;
@@ -65,15 +200,28 @@ int ec_flash_verify(const uint8_t *buf, int offset, int size)
 	return 0;
 }
 
-int ec_flash_write(const uint8_t *buf, int offset, int size)
+int ec_flash_verify(const uint8_t *buf, int offset, int size)
 {
-	struct ec_params_flash_write *p =
-		(struct ec_params_flash_write *)ec_outbuf;
-	struct ec_response_flash_info info;
-	int pdata_max_size = (int)(ec_max_outsize - sizeof(*p));
+	/* Only transfer digests, if the EC can compute them */
+	if (ec_cmd_version_supported(EC_CMD_FLASH_HASH, 0))
+		return verify_by_hash(buf, offset, size);
+
+	return verify_by_readback(buf, offset, size);
+}
+
+/**
+ * Determine the write step size.
+ *
+ * This must be a multiple of the write block size, and must also fit into the
+ * host parameter buffer.
+ *
+ * @return step size, or negative if error.
+ */
+static int get_write_step(const struct ec_response_flash_info_1 *info)
+{
+	int pdata_max_size = (int)(ec_max_outsize -
+				   sizeof(struct ec_params_flash_write));
 	int step;
-	int rv;
-	int i;
 
 	/*
 	 * Determine whether we can use version 1 of the command with more
@@ -82,28 +230,54 @@ int ec_flash_write(const uint8_t *buf, int offset, int size)
 	if (!ec_cmd_version_supported(EC_CMD_FLASH_WRITE, EC_VER_FLASH_WRITE))
 		pdata_max_size = EC_FLASH_WRITE_VER0_SIZE;
 
-	/*
-	 * Determine step size.  This must be a multiple of the write block
-	 * size, and must also fit into the host parameter buffer.
-	 */
-	rv = ec_command(EC_CMD_FLASH_INFO, 0, NULL, 0, &info, sizeof(info));
-	if (rv < 0)
-		return rv;
-
-	step = (pdata_max_size / info.write_block_size) * info.write_block_size;
+	step = (pdata_max_size / info->write_block_size) *
+		info->write_block_size;
 
 	if (!step) {
 		fprintf(stderr, "Write block size %d > max param size %d\n",
-			info.write_block_size, pdata_max_size);
+			info->write_block_size, pdata_max_size);
 		return -1;
 	}
 
-	/* Write data in chunks */
-	printf("Write size %d...\n", step);
+	return step;
+}
+
+/**
+ * Return non-zero if all size bytes of buf are the erased value.
+ */
+static int is_erased(const uint8_t *buf, int size, uint8_t erased)
+{
+	int i;
+
+	for (i = 0; i < size; i++) {
+		if (buf[i] != erased)
+			return 0;
+	}
+
+	return 1;
+}
+
+/**
+ * Write data in chunks of step bytes.
+ *
+ * If skip_erased is non-zero, chunks which are entirely the erased value are
+ * not sent; the caller must know the flash there is already erased.
+ */
+static int write_chunks(const uint8_t *buf, int offset, int size, int step,
+			int skip_erased, uint8_t erased)
+{
+	struct ec_params_flash_write *p =
+		(struct ec_params_flash_write *)ec_outbuf;
+	int rv;
+	int i;
 
 	for (i = 0; i < size; i += step) {
 		p->offset = offset + i;
 		p->size = MIN(size - i, step);
+
+		if (skip_erased && is_erased(buf + i, p->size, erased))
+			continue;
+
 		memcpy(p + 1, buf + i, p->size);
 		rv = ec_command(EC_CMD_FLASH_WRITE, 0, p, sizeof(*p) + p->size,
 				NULL, 0);
@@ -116,6 +290,137 @@ int ec_flash_write(const uint8_t *buf, int offset, int size)
 	return 0;
 }
 
+int ec_flash_write(const uint8_t *buf, int offset, int size)
+{
+	struct ec_response_flash_info_1 info;
+	int step;
+	int rv;
+
+	rv = get_flash_info(&info);
+	if (rv < 0)
+		return rv;
+
+	step = get_write_step(&info);
+	if (step < 0)
+		return step;
+
+	/* Write data in chunks */
+	printf("Write size %d...\n", step);
+
+	return write_chunks(buf, offset, size, step, 0, 0);
+}
+
+int ec_flash_update(const uint8_t *buf, int offset, int size)
+{
+	struct ec_response_flash_info_1 info;
+	struct sha256_ctx ctx;
+	uint8_t erased_digest[SHA256_DIGEST_SIZE];
+	uint8_t *digests = NULL;
+	uint8_t *rbuf;
+	uint8_t erased;
+	int block, step;
+	int same, blank;
+	int unchanged = 0, erases = 0, writes = 0;
+	int rv;
+	int i;
+
+	rv = get_flash_info(&info);
+	if (rv < 0)
+		return rv;
+
+	step = get_write_step(&info);
+	if (step < 0)
+		return step;
+
+	block = info.erase_block_size;
+	if (!block || offset % block || size % block) {
+		fprintf(stderr, "Offset and size must be multiples of "
+			"the erase block size %d\n", block);
+		return -1;
+	}
+
+	erased = (info.flags & EC_FLASH_INFO_ERASE_TO_0) ? 0x00 : 0xff;
+
+	rbuf = malloc(block);
+	if (!rbuf) {
+		fprintf(stderr, "Unable to allocate buffer.\n");
+		return -1;
+	}
+
+	/*
+	 * If the EC can hash its flash, compare digests instead of reading
+	 * every block back.
+	 */
+	if (ec_cmd_version_supported(EC_CMD_FLASH_HASH, 0)) {
+		digests = malloc(size / block * SHA256_DIGEST_SIZE);
+		if (!digests) {
+			fprintf(stderr, "Unable to allocate buffer.\n");
+			free(rbuf);
+			return -1;
+		}
+
+		rv = ec_flash_hash(digests, offset, size, block);
+		if (rv < 0)
+			goto exit;
+
+		memset(rbuf, erased, block);
+		memcpy(erased_digest, hash_buf(&ctx, rbuf, block),
+		       SHA256_DIGEST_SIZE);
+	}
+
+	for (i = 0; i < size; i += block) {
+		if (digests) {
+			const uint8_t *d = digests +
+				i / block * SHA256_DIGEST_SIZE;
+
+			same = !memcmp(d, hash_buf(&ctx, buf + i, block),
+				       SHA256_DIGEST_SIZE);
+			blank = !memcmp(d, erased_digest, SHA256_DIGEST_SIZE);
+		} else {
+			rv = ec_flash_read(rbuf, offset + i, block);
+			if (rv < 0)
+				break;
+
+			same = !memcmp(rbuf, buf + i, block);
+			blank = is_erased(rbuf, block, erased);
+		}
+
+		if (same) {
+			unchanged++;
+			continue;
+		}
+
+		/* Only erase if something has been written there */
+		if (!blank) {
+			rv = ec_flash_erase(offset + i, block);
+			if (rv < 0) {
+				fprintf(stderr, "Erase error at offset %d\n",
+					i);
+				break;
+			}
+			erases++;
+		}
+
+		/* The block is now erased, so skip erased chunks */
+		rv = write_chunks(buf + i, offset + i, block, step,
+				  1, erased);
+		if (rv < 0)
+			break;
+		writes++;
+	}
+
+exit:
+	free(digests);
+	free(rbuf);
+
+	if (rv < 0)
+		return rv;
+
+	printf("%d blocks: %d unchanged, %d erased, %d written\n",
+	       size / block, unchanged, erases, writes);
+	return 0;
+}
+
 int ec_flash_erase(int offset, int size)
 {
 	struct ec_params_flash_erase p;
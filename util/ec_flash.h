@@ -20,6 +20,9 @@ int ec_flash_read(uint8_t *buf, int offset, int size);
 /**
  * Verify EC flash memory
  *
+ * Compares digests of each erase block if the EC supports EC_CMD_FLASH_HASH,
+ * or else reads the whole region back.
+ *
  * @param buf		Source buffer to verify against EC flash
  * @param offset	Offset in EC flash to check
  * @param size		Number of bytes to check
@@ -39,6 +42,24 @@ int ec_flash_verify(const uint8_t *buf, int offset, int size);
  */
 int ec_flash_write(const uint8_t *buf, int offset, int size);
 
+/**
+ * Update EC flash memory, erasing and writing only what has changed
+ *
+ * Each erase block is compared first, by digest if the EC supports
+ * EC_CMD_FLASH_HASH or else by reading it back.  Blocks which already hold the
+ * new data are skipped, blocks which are already erased are not erased again,
+ * and write chunks which are entirely erased in the new data are not written.
+ *
+ * @param buf		Source buffer
+ * @param offset	Offset in EC flash to write; must be a multiple of
+ *			the erase block size
+ * @param size		Number of bytes to write; must be a multiple of the
+ *			erase block size
+ *
+ * @return 0 if success, negative if error.
+ */
+int ec_flash_update(const uint8_t *buf, int offset, int size);
+
 /**
  * Erase EC flash memory
  *
@@ -84,6 +84,8 @@ const char help_str[] =
 	"      Prints or sets EC flash protection state\n"
 	"  flashread <offset> <size> <outfile>\n"
 	"      Reads from EC flash to a file\n"
+	"  flashupdate <offset> <infile>\n"
+	"      Writes to EC flash from a file, only where it differs\n"
 	"  flashwrite <offset> <infile>\n"
 	"      Writes to EC flash from a file\n"
 	"  gpioget <GPIO name>\n"
@@ -92,6 +94,8 @@ const char help_str[] =
 	"      Set the value of GPIO signal\n"
 	"  hangdetect <flags> <event_msec> <reboot_msec> | stop | start\n"
 	"      Configure or start/stop the hang detect timer\n"
+	"  hcstats [reset]\n"
+	"      Prints or resets host command timing statistics\n"
 	"  hello\n"
 	"      Checks for basic communication with EC\n"
 	"  kbpress\n"
@@ -146,6 +150,8 @@ const char help_str[] =
 	"      Set real-time clock\n"
 	"  sertest\n"
 	"      Serial output test for COM2\n"
+	"  shmem\n"
+	"      Prints EC shared memory usage\n"
 	"  switches\n"
 	"      Prints current EC switch positions\n"
 	"  temps <sensorid>\n"
@@ -618,7 +624,18 @@ int cmd_flash_read(int argc, char *argv[])
 	return 0;
 }
 
-int cmd_flash_write(int argc, char *argv[])
+/**
+ * Write a file to flash and verify it.
+ *
+ * @param argc, argv	Command arguments: <offset> <filename>
+ * @param action	Progress message, e.g. "Writing to"
+ * @param write_func	Function to write the data; ec_flash_write() or
+ *			ec_flash_update()
+ * @return 0 if success, or negative if error.
+ */
+static int flash_write_file(int argc, char *argv[], const char *action,
+			    int (*write_func)(const uint8_t *buf, int offset,
+					      int size))
 {
 	int offset, size;
 	int rv;
@@ -641,10 +658,15 @@ int cmd_flash_write(int argc, char *argv[])
 	if (!buf)
 		return -1;
 
-	printf("Writing to offset %d...\n", offset);
+	printf("%s offset %d...\n", action, offset);
 
-	/* Write data in chunks */
-	rv = ec_flash_write(buf, offset, size);
+	rv = write_func((const uint8_t *)buf, offset, size);
+
+	/* Check it took; this only transfers digests if the EC can hash */
+	if (rv >= 0) {
+		printf("Verifying...\n");
+		rv = ec_flash_verify((const uint8_t *)buf, offset, size);
+	}
 
 	free(buf);
 
@@ -655,6 +677,18 @@ int cmd_flash_write(int argc, char *argv[])
 	return 0;
 }
 
+int cmd_flash_write(int argc, char *argv[])
+{
+	/* Write data in chunks */
+	return flash_write_file(argc, argv, "Writing to", ec_flash_write);
+}
+
+int cmd_flash_update(int argc, char *argv[])
+{
+	/* Erase and write only the blocks which have changed */
+	return flash_write_file(argc, argv, "Updating", ec_flash_update);
+}
+
 int cmd_flash_erase(int argc, char *argv[])
 {
 	int offset, size;
@@ -3561,6 +3595,73 @@ int cmd_proto_info(int argc, char *argv[])
 	return 0;
 }
 
+int cmd_hc_stats(int argc, char *argv[])
+{
+	struct ec_params_get_cmd_stats p;
+	struct ec_response_get_cmd_stats *r = ec_inbuf;
+	int rv;
+	int i;
+
+	memset(&p, 0, sizeof(p));
+
+	if (argc > 1) {
+		if (strcasecmp(argv[1], "reset")) {
+			fprintf(stderr, "Usage: %s [reset]\n", argv[0]);
+			return -1;
+		}
+		p.flags = EC_CMD_STATS_FLAG_RESET;
+		rv = ec_command(EC_CMD_GET_CMD_STATS, 0, &p, sizeof(p),
+				ec_inbuf, ec_max_insize);
+		return rv < 0 ? rv : 0;
+	}
+
+	printf("Cmd      Calls   Errs  Min us  Avg us  Max us  MaxLat us\n");
+	do {
+		rv = ec_command(EC_CMD_GET_CMD_STATS, 0, &p, sizeof(p),
+				ec_inbuf, ec_max_insize);
+		if (rv < 0)
+			return rv;
+		if (rv < sizeof(*r) ||
+		    rv < sizeof(*r) + r->count * sizeof(r->stats[0])) {
+			fprintf(stderr, "Truncated response\n");
+			return -1;
+		}
+
+		for (i = 0; i < r->count; i++) {
+			const struct ec_cmd_stats *st = r->stats + i;
+
+			if (!st->calls)
+				continue;
+
+			printf("0x%02x %9u %6u %7u %7u %7u %10u\n",
+			       st->command, st->calls, st->errors, st->min_us,
+			       st->avg_us, st->max_us, st->max_latency_us);
+		}
+
+		p.index += r->count;
+	} while (r->count && p.index < r->total);
+
+	return 0;
+}
+
+int cmd_shared_mem(int argc, char *argv[])
+{
+	struct ec_response_shared_mem_info r;
+	int rv;
+
+	rv = ec_command(EC_CMD_SHARED_MEM_INFO, 0, NULL, 0, &r, sizeof(r));
+	if (rv < 0)
+		return rv;
+
+	printf("Size: %6u\n", r.size);
+	printf("Used: %6u in %u blocks\n", r.used, r.blocks_used);
+	printf("Max:  %6u\n", r.max_used);
+	printf("Free: %6u in %u blocks, largest %u (%u%% fragmented)\n",
+	       r.free, r.blocks_free, r.largest_free,
+	       r.free ? 100 - r.largest_free * 100 / r.free : 0);
+	return 0;
+}
+
 static int ec_hash_help(const char *cmd)
 {
 	printf("Usage:\n");
@@ -3576,12 +3677,16 @@ static int ec_hash_help(const char *cmd)
 }
 
 
-static int ec_hash_print(const struct ec_response_vboot_hash *r)
+static int ec_hash_print(const struct ec_response_vboot_hash_1 *r,
+			 int version)
 {
 	int i;
 
 	if (r->status == EC_VBOOT_HASH_STATUS_BUSY) {
 		printf("status:  busy\n");
+		if (version >= 1)
+			printf("done:    0x%08x of 0x%08x in %d us\n",
+			       r->bytes_hashed, r->size, r->elapsed_us);
 		return 0;
 	} else if (r->status == EC_VBOOT_HASH_STATUS_NONE) {
 		printf("status:  unavailable\n");
@@ -3604,6 +3709,9 @@ static int ec_hash_print(const struct ec_response_vboot_hash *r)
 	for (i = 0; i < r->digest_size; i++)
 		printf("%02x", r->hash_digest[i]);
 	printf("\n");
+
+	if (version >= 1)
+		printf("time:    %d us\n", r->elapsed_us);
 	return 0;
 }
 
@@ -3611,19 +3719,29 @@ static int ec_hash_print(const struct ec_response_vboot_hash *r)
 int cmd_ec_hash(int argc, char *argv[])
 {
 	struct ec_params_vboot_hash p;
-	struct ec_response_vboot_hash r;
+	struct ec_response_vboot_hash_1 r;
+	int version = 1;
+	int rsize = sizeof(r);
 	char *e;
 	int rv;
 
+	memset(&r, 0, sizeof(r));
+
+	if (!ec_cmd_version_supported(EC_CMD_VBOOT_HASH, version)) {
+		/* Fall back to version 0 command, without progress */
+		version = 0;
+		rsize = sizeof(struct ec_response_vboot_hash);
+	}
+
 	if (argc < 2) {
 		/* Get hash status */
 		p.cmd = EC_VBOOT_HASH_GET;
-		rv = ec_command(EC_CMD_VBOOT_HASH, 0,
-				&p, sizeof(p), &r, sizeof(r));
+		rv = ec_command(EC_CMD_VBOOT_HASH, version,
+				&p, sizeof(p), &r, rsize);
 		if (rv < 0)
 			return rv;
 
-		return ec_hash_print(&r);
+		return ec_hash_print(&r, version);
 	}
 
 	if (argc == 2 && !strcasecmp(argv[1], "abort")) {
@@ -3689,7 +3807,7 @@ int cmd_ec_hash(int argc, char *argv[])
 	} else
 		p.nonce_size = 0;
 
-	rv = ec_command(EC_CMD_VBOOT_HASH, 0, &p, sizeof(p), &r, sizeof(r));
+	rv = ec_command(EC_CMD_VBOOT_HASH, version, &p, sizeof(p), &r, rsize);
 	if (rv < 0)
 		return rv;
 
@@ -3698,7 +3816,7 @@ int cmd_ec_hash(int argc, char *argv[])
 		return 0;
 
 	/* Recalc command does wait around, so a result is ready now */
-	return ec_hash_print(&r);
+	return ec_hash_print(&r, version);
 }
 
 
@@ -4216,11 +4334,13 @@ const struct command commands[] = {
 	{"flasherase", cmd_flash_erase},
 	{"flashprotect", cmd_flash_protect},
 	{"flashread", cmd_flash_read},
+	{"flashupdate", cmd_flash_update},
 	{"flashwrite", cmd_flash_write},
 	{"flashinfo", cmd_flash_info},
 	{"gpioget", cmd_gpio_get},
 	{"gpioset", cmd_gpio_set},
 	{"hangdetect", cmd_hang_detect},
+	{"hcstats", cmd_hc_stats},
 	{"hello", cmd_hello},
 	{"kbpress", cmd_kbpress},
 	{"i2cread", cmd_i2c_read},
@@ -4248,6 +4368,7 @@ const struct command commands[] = {
 	{"rtcget", cmd_rtc_get},
 	{"rtcset", cmd_rtc_set},
 	{"sertest", cmd_serial_test},
+	{"shmem", cmd_shared_mem},
 	{"port80flood", cmd_port_80_flood},
 	{"switches", cmd_switches},
 	{"temps", cmd_temperature},